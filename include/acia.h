@@ -1,18 +1,22 @@
 #pragma once
 #include <cstdint>
 
+class StateArchive;
+
 class ACIA
 {
 public:
     ACIA();
 
     void reset();
+    void serialize(StateArchive &ar);
 
     // Memory-mapped access
     uint8_t read(uint16_t addr);
     void write(uint16_t addr, uint8_t data);
     void receiveByte(uint8_t data, bool framingError, bool parityError);
     void Clock();
+    bool irqLine() const { return irqAsserted_; }
 
     // --- Register offsets ---
     static constexpr uint8_t REG_DATA = 0x00;    // Transmit/Receive data
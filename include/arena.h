@@ -0,0 +1,95 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <utility>
+
+// Pooled allocation
+// ------------------------------------------------------------
+// Everything a machine allocates while it runs (RAM pages on their first
+// write after a fork, frame buffers on their first draw, machine objects
+// themselves through MachinePool) comes from size-classed block pools.
+// Blocks are carved from 2 MiB chunks, aligned to a cache line, and go
+// back on their pool's free list when released, so creating and
+// destroying machines stops touching malloc once the pools are warm.
+// Chunks are never returned to the OS.
+//
+// With huge pages on, chunks are requested as 2 MiB pages (MAP_HUGETLB,
+// else transparent huge pages via madvise), cutting TLB misses when
+// thousands of machines are live. Set it before the first allocation.
+
+constexpr std::size_t ArenaChunkSize = 2 * 1024 * 1024;
+constexpr std::size_t ArenaAlign = 64;
+
+void setArenaHugePages(bool enable);
+
+// Any size; blocks larger than a chunk go straight to and from the OS
+void *arenaAllocate(std::size_t bytes);
+void arenaFree(void *p, std::size_t bytes);
+
+struct ArenaStats
+{
+    std::size_t chunks;      // obtained from the OS
+    std::size_t chunkBytes;
+    std::size_t blocksInUse;
+    bool hugePages;          // MAP_HUGETLB succeeded for every chunk
+};
+
+ArenaStats arenaStats();
+
+// std allocator over the pools, e.g. for allocate_shared
+template <typename T>
+struct PoolAllocator
+{
+    using value_type = T;
+
+    PoolAllocator() = default;
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U> &) {}
+
+    T *allocate(std::size_t n) { return static_cast<T *>(arenaAllocate(n * sizeof(T))); }
+    void deallocate(T *p, std::size_t n) { arenaFree(p, n * sizeof(T)); }
+
+    template <typename U>
+    bool operator==(const PoolAllocator<U> &) const { return true; }
+    template <typename U>
+    bool operator!=(const PoolAllocator<U> &) const { return false; }
+};
+
+// Machines in pooled, cache-line aligned blocks of their own size class.
+// Handles release the block back to the pool, so a fleet that keeps
+// replacing machines reuses the same memory.
+template <class MachineT>
+class MachinePool
+{
+public:
+    static_assert(alignof(MachineT) <= ArenaAlign, "machine alignment exceeds the arena's");
+
+    struct Release
+    {
+        void operator()(MachineT *m) const
+        {
+            m->~MachineT();
+            arenaFree(m, sizeof(MachineT));
+        }
+    };
+    using Handle = std::unique_ptr<MachineT, Release>;
+
+    // A powered-on machine, or a copy of one (sharing its RAM, as Fork)
+    template <typename... Args>
+    static Handle create(Args &&...args)
+    {
+        void *block = arenaAllocate(sizeof(MachineT));
+        try
+        {
+            return Handle(new (block) MachineT(std::forward<Args>(args)...));
+        }
+        catch (...)
+        {
+            arenaFree(block, sizeof(MachineT));
+            throw;
+        }
+    }
+    static Handle fork(const MachineT &from) { return create(from); }
+};
@@ -0,0 +1,31 @@
+#pragma once
+#include <cstddef>
+#include "tia_audio.h"
+
+// Paces emulation from the audio device instead of the wall clock. The
+// emulator runs freely while the audio ring is below its target fill and
+// blocks on the consumer once it is above it, so the fill stays at the
+// target. What remains (the emulator falling behind, the overshoot of one
+// call) is absorbed by slowly steering the TIA's resampling ratio.
+class AudioPacer
+{
+public:
+    // targetFill: samples to keep queued (e.g. two device periods)
+    AudioPacer(AudioRing &ring, TIAAudio &audio, std::size_t targetFill);
+
+    // Called periodically between instructions. Never sleeps; it only
+    // waits on the audio consumer when the ring is above the target.
+    void pace();
+
+    double rateAdjust() const { return adjust_; }
+    std::size_t targetFill() const { return target_; }
+
+    // Largest correction applied to the resampling ratio
+    static constexpr double MaxAdjust = 0.005;
+
+private:
+    AudioRing &ring_;
+    TIAAudio &audio_;
+    std::size_t target_;
+    double adjust_ = 1.0;
+};
@@ -0,0 +1,108 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include "image.h"
+#include "memory.h"
+
+class StateArchive;
+
+// Bank switching
+// ------------------------------------------------------------
+// ROM images larger than the window the CPU sees are mapped into the page
+// table a bank at a time (Memory::MapPage): a bank switch rewrites the
+// pointers of the pages it covers to another offset of the image, so no
+// ROM byte is ever copied. Only the bank registers are machine state; the
+// image is configuration, shared by every fork, and a saved state must be
+// loaded into a machine with the same image inserted.
+
+// 2600 cartridge bank-switching schemes
+enum class CartScheme : uint8_t
+{
+    Auto,          // guessCartScheme from the image size
+    Plain,         // 2K or 4K, no switching
+    F8,            // 8K: 2 x 4K, hotspots $1FF8-$1FF9
+    F6,            // 16K: 4 x 4K, hotspots $1FF6-$1FF9
+    F4,            // 32K: 8 x 4K, hotspots $1FF4-$1FFB
+    E0,            // Parker Bros 8K: three 1K windows, hotspots $1FE0-$1FF7
+    Tigervision3F, // 2K banks at $1000 selected by writes to $00-$3F
+    ActivisionFE   // 8K: 2 x 4K, selected by the stack access after $01FE
+};
+
+// Short names for command lines: auto, 2k4k, f8, f6, f4, e0, 3f, fe
+const char *cartSchemeName(CartScheme scheme);
+bool parseCartScheme(const std::string &name, CartScheme &scheme);
+
+// The scheme an image of this size most likely uses: 2K/4K plain, 8K F8,
+// 16K F6, 32K F4, larger 3F. E0 and FE images are also 8K and must be
+// named explicitly.
+CartScheme guessCartScheme(std::size_t size);
+
+// A 2600 cartridge: its image, scheme and bank registers. The window is
+// $1000-$1FFF of the 6507's space, split into equal segments.
+class Cartridge2600
+{
+public:
+    // Bank per segment (up to four), then FE's pending flag
+    static constexpr int RegisterCount = 5;
+
+    // False, leaving the cartridge as it was, for a size the scheme can't
+    // use
+    bool insert(RomImage image, CartScheme scheme = CartScheme::Auto);
+    bool inserted() const { return image_ != nullptr; }
+    CartScheme scheme() const { return scheme_; }
+
+    // Power-on banks: the last one for the F schemes
+    void reset();
+
+    // Map every segment's bank and mark the scheme's hotspot pages
+    void attach(Memory &mem) const;
+
+    // A hotspot access. `addr` is as the CPU drove it, before the 6507's
+    // mask; `data` is the byte moved.
+    void access(uint16_t addr, uint8_t data, Memory &mem);
+
+    const uint8_t *registers() const { return regs_; }
+    void serialize(StateArchive &ar);
+
+private:
+    void mapSegment(int segment, Memory &mem) const;
+    void select(int segment, uint32_t bank, Memory &mem);
+    void setPending(bool pending, Memory &mem);
+
+    RomImage image_;
+    CartScheme scheme_ = CartScheme::Plain;
+    uint32_t segmentSize_ = 0x1000;
+    int segments_ = 1;
+    uint32_t banks_ = 1; // segment-sized banks in the image
+    uint8_t regs_[RegisterCount] = {};
+};
+
+// BBC Micro sideways ROMs: sixteen 16K sockets sharing $8000-$BFFF, the
+// one shown selected by the low nibble of ROMSEL ($FE30). Until a ROM is
+// inserted the window is left to whatever was loaded into RAM there.
+class SidewaysRoms
+{
+public:
+    static constexpr int Slots = 16;
+    static constexpr uint32_t SlotSize = 0x4000;
+
+    // Whole pages up to 16K; a smaller image repeats through the window.
+    // False for any other size or a bad slot.
+    bool insert(int slot, RomImage image);
+    bool active() const { return active_; }
+
+    void reset() { romsel_ = 0; }
+    void attach(Memory &mem) const;
+
+    // A ROMSEL write
+    void select(uint8_t romsel, Memory &mem);
+
+    const uint8_t *registers() const { return &romsel_; }
+    void serialize(StateArchive &ar);
+
+private:
+    RomImage slots_[Slots];
+    bool active_ = false;
+    uint8_t romsel_ = 0;
+};
@@ -0,0 +1,77 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "machine.h"
+
+// Registers and counters of one machine at one point of a bisection
+struct MachineState
+{
+    uint64_t instructions;
+    uint64_t cycles;
+    uint64_t fingerprint;
+    uint16_t PC;
+    uint8_t A, X, Y, SP, P;
+    uint8_t opcode; // at PC
+};
+
+struct RamDifference
+{
+    uint16_t addr;
+    uint8_t a, b;
+};
+
+// The first instruction after which the two machines differ
+struct Divergence
+{
+    uint64_t instruction;          // index of the diverging instruction
+    MachineState before[2];        // both machines just before it
+    MachineState after[2];         // and just after
+    std::vector<RamDifference> ram; // RAM bytes that differ afterwards
+};
+
+// Runs two configurations of the same machine in lockstep (e.g. per-cycle
+// against catch-up clocking), comparing fingerprints every `interval`
+// instructions. On a mismatch both are rewound to the last matching
+// snapshot and the diverging instruction is found by binary search.
+// Instantiated for every machine profile in bisector.cpp.
+template <MachineType Type>
+class Bisector
+{
+public:
+    using MachineT = Machine<Type>;
+
+    // Both machines should start from the same state (copy one into the
+    // other) with their state hashes enabled
+    Bisector(const MachineT &a, const MachineT &b, uint64_t interval);
+
+    void setLabels(const std::string &a, const std::string &b);
+    void setMaxRamDifferences(std::size_t n) { maxRamDiffs_ = n; }
+
+    // Returns true if a divergence was found within `instructions`
+    bool run(uint64_t instructions);
+
+    bool diverged() const { return diverged_; }
+    const Divergence &divergence() const { return divergence_; }
+    uint64_t instructionsChecked() const { return checked_; }
+
+    // Both states side by side, then the differing RAM bytes
+    void print(std::ostream &out) const;
+
+private:
+    static MachineState capture(const MachineT &m);
+    static bool stepBoth(MachineT &a, MachineT &b, uint64_t n);
+    void bisect(uint64_t bad);
+
+    MachineT a_, b_;
+    MachineT goodA_, goodB_; // last snapshot where the fingerprints agreed
+    uint64_t interval_;
+    uint64_t checked_ = 0;
+    std::size_t maxRamDiffs_ = 32;
+    std::string labels_[2] = {"A", "B"};
+
+    bool diverged_ = false;
+    Divergence divergence_{};
+};
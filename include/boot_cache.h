@@ -0,0 +1,113 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "hash64.h"
+#include "image.h"
+#include "machine.h"
+
+// Where a boot counts as done, by name: "frames:<n>" (completed frames),
+// "pc:<hex>" (the first time the CPU fetches there) or "cycles:<n>"
+struct BootPoint
+{
+    enum class Kind : uint8_t
+    {
+        Frames,
+        Pc,
+        Cycles
+    };
+    Kind kind = Kind::Frames;
+    uint64_t value = 1;
+};
+
+std::string bootPointName(const BootPoint &point);
+bool parseBootPoint(const std::string &name, BootPoint &point);
+
+// Saved states of machines that have just booted, kept on disk (and in
+// memory, for runs sharing a process) under a key covering everything
+// the boot depends on: the profile, the inserted images, the machine's
+// state before reset (RAM loaded so far, device configuration), the host
+// configuration that isn't state (OS traps, CPU clocking and pacing, the
+// BBC's disk turbo) and the boot point. Files the traps serve from the
+// host are not covered. A run whose key is cached loads the state instead of
+// running the boot. Entries are never invalidated: clear the directory
+// after changing the emulator itself.
+class BootCache
+{
+public:
+    static constexpr uint64_t DefaultMaxCycles = 200000000;
+
+    // An empty directory keeps entries in memory only
+    explicit BootCache(std::string dir, uint64_t maxCycles = DefaultMaxCycles)
+        : dir_(std::move(dir)), maxCycles_(maxCycles)
+    {
+    }
+
+    enum class Outcome
+    {
+        Cached,    // started from a cached boot
+        Booted,    // booted, and the result is now cached
+        NotReached // halted or ran out of cycles first; nothing cached
+    };
+
+    // Resets and boots m, images already inserted (the same images, in
+    // any order, give the same key)
+    template <class MachineT>
+    Outcome boot(MachineT &m, const std::vector<RomImage> &images, const BootPoint &point)
+    {
+        uint64_t k = key(MachineT::type, m.StateHash() ^ m.cpu.powerOnSeed, config(m), images, point);
+        RomImage state = find(MachineT::type, k);
+        if (state && m.LoadState(state->data(), state->size()))
+            return Outcome::Cached;
+        m.Reset();
+        if (!reach(m, point))
+            return Outcome::NotReached;
+        store(MachineT::type, k, m.SaveState());
+        return Outcome::Booted;
+    }
+
+private:
+    static uint64_t key(MachineType type, uint64_t preBootState, uint64_t config, const std::vector<RomImage> &images,
+                        const BootPoint &point);
+
+    template <class MachineT>
+    static uint64_t config(const MachineT &m)
+    {
+        const OsTraps *traps = m.mem.Traps();
+        uint64_t words[4] = {traps ? traps->configHash() : 0, static_cast<uint64_t>(m.cpu.clockMode),
+                             static_cast<uint64_t>(m.cpu.pacing), 0};
+        if constexpr (MachineT::type == MachineType::BBCMicro)
+            words[3] = m.mem.disk.turboFactor();
+        return hash64(words, sizeof(words));
+    }
+    RomImage find(MachineType type, uint64_t key); // states held as images, mapped from disk
+    void store(MachineType type, uint64_t key, std::vector<uint8_t> state);
+    std::string path(MachineType type, uint64_t key) const;
+
+    template <class MachineT>
+    bool reach(MachineT &m, const BootPoint &point) const
+    {
+        const uint64_t start = m.cpu.total_cycles + m.cpu.cycles;
+        const uint64_t target = point.kind == BootPoint::Kind::Frames ? m.mem.FrameSequence() + point.value
+                                                                     : start + point.value;
+        for (;;)
+        {
+            const uint64_t now = m.cpu.total_cycles + m.cpu.cycles;
+            if ((point.kind == BootPoint::Kind::Frames && m.mem.FrameSequence() >= target) ||
+                (point.kind == BootPoint::Kind::Pc && m.cpu.PC == point.value) ||
+                (point.kind == BootPoint::Kind::Cycles && now >= target))
+                return true;
+            if (m.cpu.halted || !m.cpu.running || now - start >= maxCycles_)
+                return false;
+            m.Step();
+        }
+    }
+
+    std::string dir_;
+    uint64_t maxCycles_;
+    std::mutex mutex_;
+    std::unordered_map<uint64_t, RomImage> loaded_;
+};
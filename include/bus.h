@@ -0,0 +1,57 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include "memory.h"
+#include "speed.h"
+
+// Machine profiles
+// ------------------------------------------------------------
+// Every supported machine is a specialisation of Bus<> holding exactly
+// its own devices, decoded in front of the Memory it derives from. The
+// CPU and Machine are templates over the bus, so within one profile
+// every bus access is a direct, inlinable call; a program picks its
+// profile once, at startup, through AnyMachine (machine.h).
+//
+// Each bus provides what the CPU and the tools call: Is6507 and ClockHz
+// (the CPU clock that wall-clock pacing follows), Read, Write, Clock,
+// CheckIRQLines, Reset, Serialize, RebindDevices, and optionally
+// CheckNMILine, Peek, Load, Frame, FrameSequence, FramePalette, hiding
+// Memory's versions.
+
+enum class MachineType : uint8_t
+{
+    Generic,   // bare 6502 and 64K of RAM
+    Atari2600, // 6507, TIA, RIOT
+    VIC20,     // 6560 VIC, two 6522 VIAs
+    BBCMicro,  // system and user VIAs, 6850 ACIA, 1770 disk controller
+    PET,       // 6520 PIA, 6522 VIA
+    Plus4      // 6529 user port latch
+};
+
+constexpr int MachineTypeCount = 6;
+
+// Expands X(type) once per profile, e.g. for explicit instantiations
+#define FOR_EACH_MACHINE_TYPE(X) \
+    X(MachineType::Generic)      \
+    X(MachineType::Atari2600)    \
+    X(MachineType::VIC20)        \
+    X(MachineType::BBCMicro)     \
+    X(MachineType::PET)          \
+    X(MachineType::Plus4)
+
+// Short names for command lines: generic, 2600, vic20, bbc, pet, plus4
+const char *machineTypeName(MachineType type);
+bool parseMachineType(const std::string &name, MachineType &type);
+
+template <MachineType Type>
+class Bus;
+
+template <>
+class Bus<MachineType::Generic> : public Memory
+{
+public:
+    static constexpr bool Is6507 = false;
+    static constexpr double ClockHz = CPU_FREQ_GENERIC;
+
+    Bus() : Memory(RomSpace::NONE) {}
+};
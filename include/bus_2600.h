@@ -0,0 +1,96 @@
+#pragma once
+#include "banking.h"
+#include "bus.h"
+#include "riot.h"
+#include "tia.h"
+
+// Atari 2600: a 6507 sees 13 address lines. A12 selects the cartridge;
+// below it A7 clear is the TIA and A7 set the RIOT, whose RAM (A9 clear)
+// is the machine's only RAM and appears at $80-$FF and the stack page.
+// A cartridge is either loaded into RAM at $1000 (4K or less) or inserted
+// with a bank-switching scheme.
+template <>
+class Bus<MachineType::Atari2600> : public Memory
+{
+public:
+    static constexpr bool Is6507 = true;
+    static constexpr double ClockHz = CPU_FREQ_ATARI_2600;
+
+    TIA tia;
+    RIOT6532 riot;
+    Cartridge2600 cart;
+
+    Bus();
+
+    // Map a cartridge image in place of the RAM at $1000 and power-cycle
+    // its banks. False, with nothing changed, if the scheme can't use it.
+    bool InsertCartridge(RomImage image, CartScheme scheme = CartScheme::Auto);
+
+    uint8_t Read(uint16_t addr)
+    {
+        if (IsReadHotspot(addr & 0x1FFF))
+            BankRead(addr);
+        addr &= 0x1FFF;
+        if (addr & 0x1000)
+            return Memory::Peek(addr); // cartridge
+        if ((addr & 0x0080) == 0)
+            return tia.read(addr & 0x3F);
+        return riot.read(addr);
+    }
+
+    void Write(uint16_t addr, uint8_t value)
+    {
+        if (IsWriteHotspot(addr & 0x1FFF))
+            BankWrite(addr, value);
+        addr &= 0x1FFF;
+        if (addr & 0x1000)
+            return; // cartridge ROM
+        if ((addr & 0x0080) == 0)
+        {
+            tia.write(addr & 0x3F, value);
+            return;
+        }
+        if ((addr & 0x0200) == 0 && StateHashEnabled())
+            UpdateStateHash(DeviceRamKey(0) | (addr & 0x7F), riot.ram()[addr & 0x7F], value);
+        riot.write(addr, value);
+    }
+
+    void Clock()
+    {
+        tia.tick(3); // Advance TIA video/audio by one CPU cycle (3 color clocks)
+        riot.tick();
+    }
+
+    // The 6507 has no IRQ pin; the RIOT's line is reported regardless
+    bool CheckIRQLines() { return riot.irqLine(); }
+
+    // RIOT RAM included
+    uint8_t Peek(uint16_t addr) const
+    {
+        addr &= 0x1FFF;
+        if ((addr & 0x1280) == 0x0080)
+            return riot.ram()[addr & 0x7F];
+        return Memory::Peek(addr);
+    }
+
+    // Into the 8K the 6507 sees, so images and vectors can be given at
+    // their $Fxxx addresses
+    void Load(uint16_t addr, const uint8_t *bytes, std::size_t size);
+    void Reset();
+    void Serialize(StateArchive &ar);
+    void RebindDevices()
+    {
+        SetDeviceRam(0, riot.ram(), RIOT6532::RamSize);
+        SetDeviceRam(1, cart.registers(), Cartridge2600::RegisterCount);
+    }
+
+    FrameView Frame() const { return tia.frame(); }
+    uint64_t FrameSequence() const { return tia.frameSequence(); }
+    const Palette &FramePalette() const { return tia.palette(); }
+
+private:
+    // Out of line: only hotspot pages get here
+    void BankRead(uint16_t addr);
+    void BankWrite(uint16_t addr, uint8_t value);
+    void BankAccess(uint16_t addr, uint8_t data);
+};
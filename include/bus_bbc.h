@@ -0,0 +1,88 @@
+#pragma once
+#include "acia.h"
+#include "banking.h"
+#include "bus.h"
+#include "via.h"
+#include "wd1770.h"
+
+// BBC Micro Model B: every device sits in SHEILA, page $FE. The 6850
+// ACIA at $FE08, the system VIA at $FE40 (mirrored at $FE50), the user
+// VIA at $FE60 and the Acorn 1770 interface: drive control at $FE80,
+// controller registers at $FE84-$FE87. Writes to $FE30-$FE3F set ROMSEL, which picks the sideways
+// ROM at $8000-$BFFF.
+template <>
+class Bus<MachineType::BBCMicro> : public Memory
+{
+public:
+    static constexpr bool Is6507 = false;
+    static constexpr double ClockHz = CPU_FREQ_BBC_MICRO;
+
+    VIA6522 systemVia;
+    VIA6522 userVia;
+    ACIA acia;
+    WD1770 disk;
+    SidewaysRoms sideways;
+
+    Bus();
+
+    // Put an image in a sideways socket and remap the window. False if the
+    // slot or size is bad.
+    bool InsertSidewaysRom(int slot, RomImage image);
+
+    uint8_t Read(uint16_t addr)
+    {
+        if ((addr >> 8) != 0xFE)
+            return Memory::Read(addr);
+        uint8_t reg = addr & 0xFF;
+        if ((reg & 0xF8) == 0x08)
+            return acia.read(reg & 0x01);
+        if ((reg & 0xE0) == 0x40)
+            return systemVia.Read(reg & 0x0F);
+        if ((reg & 0xE0) == 0x60)
+            return userVia.Read(reg & 0x0F);
+        if ((reg & 0xFC) == 0x84)
+            return disk.read(reg & 0x03);
+        return 0xFE; // unmapped SHEILA reads float
+    }
+
+    void Write(uint16_t addr, uint8_t value)
+    {
+        if ((addr >> 8) != 0xFE)
+        {
+            Memory::Write(addr, value);
+            return;
+        }
+        uint8_t reg = addr & 0xFF;
+        if ((reg & 0xF8) == 0x08)
+            acia.write(reg & 0x01, value);
+        else if ((reg & 0xE0) == 0x40)
+            systemVia.Write(reg & 0x0F, value);
+        else if ((reg & 0xE0) == 0x60)
+            userVia.Write(reg & 0x0F, value);
+        else if ((reg & 0xFC) == 0x84)
+            disk.write(reg & 0x03, value);
+        else if ((reg & 0xFC) == 0x80)
+            disk.writeControl(value);
+        else if ((reg & 0xF0) == 0x30)
+            SelectRom(value);
+    }
+
+    void Clock()
+    {
+        systemVia.Tick();
+        userVia.Tick();
+        acia.Clock();
+        disk.tick();
+    }
+
+    bool CheckIRQLines() { return systemVia.irq_line || userVia.irq_line || acia.irqLine(); }
+    // The 1770's INTRQ and DRQ are ORed onto NMI, serviced at &0D00
+    bool CheckNMILine() { return disk.irqLine() || disk.drqLine(); }
+
+    void Reset();
+    void Serialize(StateArchive &ar);
+    void RebindDevices() { SetDeviceRam(0, sideways.registers(), 1); }
+
+private:
+    void SelectRom(uint8_t romsel);
+};
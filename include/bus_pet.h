@@ -0,0 +1,44 @@
+#pragma once
+#include "bus.h"
+#include "pia.h"
+#include "via.h"
+
+// Commodore PET: the keyboard PIA at $E810 and the 6522 VIA at $E840,
+// both mirrored through their 16-byte slots
+template <>
+class Bus<MachineType::PET> : public Memory
+{
+public:
+    static constexpr bool Is6507 = false;
+    static constexpr double ClockHz = CPU_FREQ_PET;
+
+    PIA pia;
+    VIA6522 via;
+
+    Bus();
+
+    uint8_t Read(uint16_t addr)
+    {
+        if ((addr & 0xFFF0) == 0xE810)
+            return pia.read(addr & 0x03);
+        if ((addr & 0xFFF0) == 0xE840)
+            return via.Read(addr & 0x0F);
+        return Memory::Read(addr);
+    }
+
+    void Write(uint16_t addr, uint8_t value)
+    {
+        if ((addr & 0xFFF0) == 0xE810)
+            pia.write(addr & 0x03, value);
+        else if ((addr & 0xFFF0) == 0xE840)
+            via.Write(addr & 0x0F, value);
+        else
+            Memory::Write(addr, value);
+    }
+
+    void Clock() { via.Tick(); }
+    bool CheckIRQLines() { return pia.irqLine() || via.irq_line; }
+
+    void Reset();
+    void Serialize(StateArchive &ar);
+};
@@ -0,0 +1,35 @@
+#pragma once
+#include "bus.h"
+#include "mos6529.h"
+
+// Commodore Plus/4: the user port 6529 at $FD10, mirrored through its
+// 16-byte slot. The TED is not emulated.
+template <>
+class Bus<MachineType::Plus4> : public Memory
+{
+public:
+    static constexpr bool Is6507 = false;
+    static constexpr double ClockHz = CPU_FREQ_PLUS4;
+
+    MOS6529 io;
+
+    Bus();
+
+    uint8_t Read(uint16_t addr)
+    {
+        if ((addr & 0xFFF0) == 0xFD10)
+            return io.read();
+        return Memory::Read(addr);
+    }
+
+    void Write(uint16_t addr, uint8_t value)
+    {
+        if ((addr & 0xFFF0) == 0xFD10)
+            io.write(value);
+        else
+            Memory::Write(addr, value);
+    }
+
+    void Reset();
+    void Serialize(StateArchive &ar);
+};
@@ -0,0 +1,66 @@
+#pragma once
+#include "bus.h"
+#include "via.h"
+#include "vic.h"
+
+// Commodore VIC-20: the 6560 VIC at $9000 and two 6522 VIAs at $9110 and
+// $9120. The VIC fetches screen and character data straight from the
+// page table.
+template <>
+class Bus<MachineType::VIC20> : public Memory
+{
+public:
+    static constexpr bool Is6507 = false;
+    static constexpr double ClockHz = CPU_FREQ_VIC20;
+
+    VIC vic;
+    VIA6522 via1; // RESTORE, RS-232, NMI
+    VIA6522 via2; // keyboard, IRQ
+
+    Bus();
+
+    uint8_t Read(uint16_t addr)
+    {
+        if ((addr & 0xFFF0) == 0x9000)
+            return vic.read(addr & 0x0F);
+        if ((addr & 0xFFF0) == 0x9110)
+            return via1.Read(addr & 0x0F);
+        if ((addr & 0xFFF0) == 0x9120)
+            return via2.Read(addr & 0x0F);
+        return Memory::Read(addr);
+    }
+
+    void Write(uint16_t addr, uint8_t value)
+    {
+        if ((addr & 0xFFF0) == 0x9000)
+            vic.write(addr & 0x0F, value);
+        else if ((addr & 0xFFF0) == 0x9110)
+            via1.Write(addr & 0x0F, value);
+        else if ((addr & 0xFFF0) == 0x9120)
+            via2.Write(addr & 0x0F, value);
+        else
+        {
+            vic.noteWrite(addr); // lets the VIC skip lines whose memory is unchanged
+            Memory::Write(addr, value);
+        }
+    }
+
+    void Clock()
+    {
+        vic.tick();
+        via1.Tick();
+        via2.Tick();
+    }
+
+    bool CheckIRQLines() { return via2.irq_line; }
+    bool CheckNMILine() { return via1.irq_line; }
+
+    void Load(uint16_t addr, const uint8_t *bytes, std::size_t size);
+    void Reset();
+    void Serialize(StateArchive &ar);
+    void RebindDevices() { vic.setMemory(Pages()); }
+
+    FrameView Frame() const { return vic.frame(); }
+    uint64_t FrameSequence() const { return vic.frameSequence(); }
+    const Palette &FramePalette() const { return vic.palette(); }
+};
@@ -1,11 +1,15 @@
+#pragma once
 #include <iostream>
 #include <cstdint> // uint8_t, uint16_t, etc.
 #include <chrono>  // std::chrono::high_resolution_clock, duration
 #include <thread>  // std::this_thread::sleep_for
-#include <random>  // for random_device, mt19937, uniform_int_distribution
-#include "../include/memory.h"
-#include "../include/flags.h"
-#include "../include/speed.h"
+#include "bus.h"
+#include "flags.h"
+#include "os_traps.h"
+#include "speed.h"
+#include "audio_pacer.h"
+#include "port.h"
+#include "state_archive.h"
 
 // Base cycle counts for NMOS 6502 opcodes (0x00–0xFF)
 // Includes official + stable undocumented opcodes
@@ -66,8 +70,27 @@ constexpr uint8_t page_cross_table[256] = {
     1, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 1, 0, 0  // F0–FF
 };
 
-const double SECONDS_PER_CYCLE = 1.0 / CPU_FREQ;
+// How Run() keeps emulated time in step with the host
+enum class Pacing
+{
+    WallClock,   // sleep to match real time
+    AudioClock,  // follow the audio device through an AudioPacer
+    Unthrottled  // run as fast as possible
+};
 
+// How owed cycles are handed to the devices
+enum class ClockMode
+{
+    PerCycle, // Bus::Clock and an IRQ check after every cycle
+    CatchUp   // all of an instruction's cycles at once, IRQ sampled after
+};
+
+// Instructions between pacing checks
+constexpr uint64_t PACING_INTERVAL = 2000;
+
+// The CPU is a template over its machine's bus (see bus.h), so every
+// memory access is a direct call into that profile's decoding
+template <class BusType>
 struct CPU6502
 {
     uint8_t A = 0;     // Accumulator
@@ -76,24 +99,27 @@ struct CPU6502
     uint8_t SP = 0xFD; // Stack Pointer
     uint16_t PC = 0;   // Program Counter
     Flags P;           // Processor Status
-    Memory *mem = nullptr;
+    BusType *mem = nullptr;
     bool isNMOS6507 = false;
 
-    void Reset(Memory &memory, bool is6507 = false)
+    void Reset(BusType &memory, bool is6507 = false)
     {
         this->mem = &memory;
         this->isNMOS6507 = is6507;
         mem->use6507addresspace = is6507;
 
-        // Randomise A, X, Y to simulate undefined power-on state
-        static std::random_device rd;
-        static std::mt19937 gen(rd());
-        static std::uniform_int_distribution<uint8_t> dist(0, 255);
-
-        A = dist(gen);
-        X = dist(gen);
-        Y = dist(gen);
+        // A, X and Y are undefined at power-on: take them from this CPU's
+        // seed (splitmix64), so resets reproduce and machines don't share
+        // a generator across threads
+        uint64_t r = powerOnSeed + 0x9E3779B97F4A7C15ULL;
+        r = (r ^ (r >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        r = (r ^ (r >> 27)) * 0x94D049BB133111EBULL;
+        r ^= r >> 31;
+        A = static_cast<uint8_t>(r);
+        X = static_cast<uint8_t>(r >> 8);
+        Y = static_cast<uint8_t>(r >> 16);
         halted = false;
+        nmiLine = false;
 
         // Stack pointer after reset sequence
         SP = 0xFD;
@@ -1629,10 +1655,26 @@ struct CPU6502
     bool page_crossed;
     bool branch_taken;
     bool halted = false;
+    bool nmiLine = false; // NMI level last sampled: NMI is taken on its rising edge
 
-    uint32_t cycles;
+    uint32_t cycles = 0;        // owed to the devices, see CatchUp
+    uint64_t total_cycles = 0;  // clocked since power-on
+    uint64_t instructions = 0;  // executed since power-on
     uint64_t throttle_counter = 0;
 
+    ClockMode clockMode = ClockMode::PerCycle;
+
+    // Configuration, like clockMode: what Reset leaves in A, X and Y
+    uint64_t powerOnSeed = 0;
+
+    Pacing pacing = Pacing::WallClock;
+    AudioPacer *audioPacer = nullptr; // required for Pacing::AudioClock
+
+    // Called between instructions once a new frame has been published
+    // (e.g. to hand it to a Recorder)
+    Port<void()> onFrame;
+    uint64_t lastFrameSeq = 0;
+
     void HandleNMI()
     {
         // Push PC high byte, then low byte
@@ -1645,7 +1687,7 @@ struct CPU6502
         Push(this->P.reg);
 
         // Set I flag to disable further IRQs (NMI ignores it, but IRQs will be masked)
-        this->P.Set(Flags::I, false);
+        this->P.Set(Flags::I, true);
 
         // Fetch new PC from NMI vector
         uint8_t lo = mem->Read(0xFFFA);
@@ -1671,7 +1713,7 @@ struct CPU6502
             Push(this->P.reg);
 
             // Set I flag to disable further IRQs
-            this->P.Set(Flags::I, false);
+            this->P.Set(Flags::I, true);
 
             // Fetch new PC from IRQ vector ($FFFE/$FFFF)
             uint8_t lo = mem->Read(0xFFFE);
@@ -1683,28 +1725,151 @@ struct CPU6502
         }
     }
 
+    // Registers and cycle counters; the bus is serialized by its owner
+    void Serialize(StateArchive &ar)
+    {
+        ar.io(A);
+        ar.io(X);
+        ar.io(Y);
+        ar.io(SP);
+        ar.io(PC);
+        ar.io(P.reg);
+        ar.io(isNMOS6507);
+        ar.io(halted);
+        ar.io(nmiLine);
+        ar.io(cycles);
+        ar.io(total_cycles);
+        ar.io(instructions);
+    }
+
+    // O(1) fingerprint of the registers folded into the memory's
+    // incremental RAM hash (which must be switched on with
+    // Memory::EnableStateHash). Devices are not covered; see
+    // Machine::Fingerprint for the whole state.
+    uint64_t Fingerprint() const
+    {
+        uint64_t regs = (uint64_t)A | (uint64_t)X << 8 | (uint64_t)Y << 16 |
+                        (uint64_t)SP << 24 | (uint64_t)PC << 32 | (uint64_t)P.reg << 48;
+        regs = (regs ^ (regs >> 33)) * 0xFF51AFD7ED558CCDULL;
+        regs = (regs ^ (regs >> 33)) * 0xC4CEB9FE1A85EC53ULL;
+        return (regs ^ (regs >> 33)) ^ mem->StateHash();
+    }
+
+    // Bring the devices level with the CPU by clocking off the cycles owed
+    // for the previous instruction, taking any NMI or IRQ they raise
+    void CatchUp()
+    {
+        if (clockMode == ClockMode::CatchUp)
+        {
+            // Clock everything owed in one run, sample the lines once at
+            // the end; an NMI pulse shorter than the run is missed
+            while (cycles > 0)
+            {
+                cycles--;
+                total_cycles++;
+                mem->Clock();
+            }
+            SampleInterrupts(); // their 7 cycles are owed to the next CatchUp
+            return;
+        }
+
+        while (cycles > 0)
+        {
+            cycles--;
+            total_cycles++;
+            mem->Clock(); // tick peripherals every CPU cycle
+            SampleInterrupts();
+        }
+    }
+
+    // NMI is edge triggered and taken first; IRQ is a level, and masked
+    // by the I flag the NMI entry sets. The 6507 has neither pin.
+    void SampleInterrupts()
+    {
+        if (isNMOS6507)
+            return;
+        bool nmi = mem->CheckNMILine();
+        if (nmi && !nmiLine)
+            HandleNMI();
+        nmiLine = nmi;
+        if (mem->CheckIRQLines())
+            HandleIRQ();
+    }
+
+    // An OS call trap at PC (see os_traps.h) in place of the instruction
+    // there: runs it and returns to the caller as RTS would. False if
+    // there is none or it declines.
+    bool RunTrap()
+    {
+        const OsTraps *traps = mem->Traps();
+        if (!traps || !traps->has(PC))
+            return false;
+        TrapCpu t{A, X, Y, P.reg,
+                  Port<uint8_t(uint16_t)>::bind<&BusType::Read>(mem),
+                  Port<void(uint16_t, uint8_t)>::bind<&BusType::Write>(mem),
+                  Port<void(uint16_t, const uint8_t *, std::size_t)>::bind<&BusType::Load>(mem)};
+        uint32_t cost = 0;
+        if (!traps->run(PC, t, cost))
+            return false;
+        A = t.A;
+        X = t.X;
+        Y = t.Y;
+        P.reg = t.P | Flags::U;
+        if (t.jump >= 0)
+            PC = static_cast<uint16_t>(t.jump);
+        else
+            RTS();
+        cycles += cost;
+        instructions++;
+        return true;
+    }
+
+    // Execute one instruction. Its cycles are owed to the devices until
+    // the next Step (or CatchUp), so two CPUs stepped in lockstep have
+    // always run the same number of instructions.
+    void Step()
+    {
+        CatchUp();
+        if (halted)
+            return;
+
+        if (mem->IsTrapPage(PC) && RunTrap())
+            return;
+
+        // Fetch and execute next instruction
+        uint8_t opcode = mem->Read(PC++);
+        page_crossed = false;
+        branch_taken = false;
+
+        Execute(opcode);
+
+        cycles += cycle_table[opcode];
+        if (branch_taken)
+            cycles++;
+        if (page_crossed)
+            cycles++;
+        instructions++;
+    }
+
     void Run()
     {
         auto start_time = std::chrono::high_resolution_clock::now();
-        uint64_t total_cycles = 0;
+        uint64_t start_cycles = total_cycles;
 
         while (running && !halted)
         {
-            if (cycles > 0)
+            // Pace between instructions, never in the per-cycle path
+            if (++throttle_counter >= PACING_INTERVAL)
             {
-                cycles--;
-                total_cycles++;
-                mem->Clock(); // tick peripherals every CPU cycle
-                if (!isNMOS6507 && mem->CheckIRQLines())
+                throttle_counter = 0;
+                if (pacing == Pacing::AudioClock && audioPacer)
                 {
-                    // Intrupt for US!
-                    HandleIRQ();
+                    // Blocks only while the audio ring is over-full
+                    audioPacer->pace();
                 }
-                // TODO: add Support Later for NMI.
-                if (throttle_counter >= 2000)
+                else if (pacing == Pacing::WallClock)
                 {
-                    // Throttle here per cycle
-                    double emu_time = total_cycles * SECONDS_PER_CYCLE;
+                    double emu_time = (total_cycles - start_cycles) / BusType::ClockHz;
                     auto now = std::chrono::high_resolution_clock::now();
                     double real_time = std::chrono::duration<double>(now - start_time).count();
                     if (emu_time > real_time)
@@ -1712,45 +1877,20 @@ struct CPU6502
                         std::this_thread::sleep_for(
                             std::chrono::duration<double>(emu_time - real_time));
                     }
-                    throttle_counter = 0;
                 }
-                continue;
             }
 
-            // Fetch and execute next instruction
-            uint8_t opcode = mem->Read(PC++);
-            page_crossed = false;
-            branch_taken = false;
+            Step();
 
-            Execute(opcode);
-
-            cycles += cycle_table[opcode];
-            if (branch_taken)
-                cycles++;
-            if (page_crossed)
-                cycles++;
+            if (onFrame)
+            {
+                uint64_t seq = mem->FrameSequence();
+                if (seq != lastFrameSeq)
+                {
+                    lastFrameSeq = seq;
+                    onFrame();
+                }
+            }
         }
     }
 };
-
-int main(int argc, char *argv[])
-{
-    Memory mem;
-    CPU6502 cpu;
-    RomSpace romSpace = RomSpace::NONE; // default until set by user/system
-
-    uint16_t startAddr = 0x8000;
-    // Simple test program: LDA #$42; STA $0200; BRK
-    mem.Write(startAddr + 0, 0xA9);
-    mem.Write(startAddr + 1, 0x42);
-    mem.Write(startAddr + 2, 0x8D);
-    mem.Write(startAddr + 3, 0x00);
-    mem.Write(startAddr + 4, 0x02);
-    mem.Write(startAddr + 5, 0x00);
-
-    cpu.Reset(mem, false);
-
-    cpu.Run();
-
-    return 0;
-}
@@ -0,0 +1,59 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "image.h"
+#include "os_traps.h"
+
+class DiskOverlay;
+
+// Acorn DFS catalogue of an SSD or DSD image, for loading files without
+// going through the disk controller. Side 0 is drive 0, side 1 (DSD
+// only) drive 2. Sectors the machine has written (its WD1770 overlay)
+// are read in place of the image's.
+struct DfsEntry
+{
+    std::string name; // without trailing spaces
+    char dir;
+    bool locked;
+    uint32_t load, exec, length; // 18-bit, with &3xxxx read as &FFFFxxxx
+    uint16_t startSector;
+};
+
+class DfsCatalogue
+{
+public:
+    // False, leaving the catalogue empty, if a side has no valid one
+    bool read(RomImage image, bool doubleSided);
+
+    // The overlay to read over the image; it must outlive the catalogue's
+    // use of it
+    void setOverlay(const DiskOverlay *overlay) { overlay_ = overlay; }
+
+    const std::vector<DfsEntry> &entries(int side) const { return sides_[side & 1]; }
+    std::string title(int side) const { return titles_[side & 1]; }
+
+    // "[:drive.][dir.]name", case-insensitive, default directory $.
+    // Copies the file out of the image with its addresses (OsHost::open),
+    // first reading the catalogue again if its sectors have been written.
+    bool open(const std::string &name, OsFile &file);
+
+private:
+    const uint8_t *sector(int side, uint32_t logical) const; // nullptr past the image
+    bool parse();
+    bool catalogueChanged() const;
+
+    RomImage image_;
+    const DiskOverlay *overlay_ = nullptr;
+    bool doubleSided_ = false;
+    uint8_t parsed_[2][512] = {}; // sectors 0 and 1 of each side, as last parsed
+    std::vector<DfsEntry> sides_[2];
+    std::string titles_[2];
+};
+
+// Fast load: OSFILE loads and *LOAD / *RUN commands are served from the
+// catalogue by the traps, cycles each, instead of by the DFS ROM through
+// the 1770. The OSFILE trap runs even though the DFS has claimed FILEV.
+// Files the catalogue lacks, and every other call, still go to the ROM.
+// The catalogue must outlive the traps.
+void enableDfsFastLoad(OsTraps &traps, DfsCatalogue &disk, uint32_t cycles = 2000);
@@ -0,0 +1,130 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include "spsc_ring.h"
+
+class StateArchive;
+class DiskJournal;
+
+// What becomes of sectors a machine writes to its disk. The image itself
+// is never written: it stays mapped read-only and shared by every
+// machine that inserted it.
+//   protect: the disk is write protected (the default)
+//   discard: writes succeed but are thrown away
+//   memory:  written sectors are kept per machine, over the image
+//   journal: as memory, and also appended to a journal file
+enum class DiskWrites : uint8_t
+{
+    Protect,
+    Discard,
+    Memory,
+    Journal
+};
+
+const char *diskWritesName(DiskWrites mode);
+bool parseDiskWrites(const std::string &name, DiskWrites &mode);
+
+struct DiskSector
+{
+    uint8_t bytes[256];
+};
+
+// Sparse sector-level write layer over a disk image, keyed by the
+// sector's offset in the image / 256. Memory grows with the sectors
+// written, not the image size. Sectors are immutable blocks shared with
+// forks until one side writes them again. Written sectors are machine
+// state; the mode and journal are configuration.
+class DiskOverlay
+{
+public:
+    DiskOverlay() = default;
+    DiskOverlay(const DiskOverlay &other) : mode_(other.mode_), sectors_(other.sectors_) {} // forks don't journal
+    DiskOverlay &operator=(const DiskOverlay &other);
+
+    void setMode(DiskWrites mode) { mode_ = mode; }
+    DiskWrites mode() const { return mode_; }
+    bool writable() const { return mode_ != DiskWrites::Protect; }
+
+    // Where Journal mode sends writes; without one it acts as Memory.
+    // The journal must outlive the overlay's use of it.
+    void setJournal(DiskJournal *journal) { journal_ = journal; }
+
+    // The written copy of a sector, nullptr if it has none
+    const uint8_t *find(uint32_t sector) const;
+
+    // A write from the controller, as the mode says. Never blocks.
+    void write(uint32_t sector, const uint8_t *bytes);
+
+    // Writes waiting in the journal's backlog, and a non-blocking try at
+    // moving them on, which the controller makes while it is idle
+    bool journalBacklogged() const { return journalBacklog_; }
+    void flushJournal();
+
+    // Store a sector whatever the mode (journal replay)
+    void put(uint32_t sector, const uint8_t *bytes);
+
+    void clear() { sectors_.clear(); }
+    std::size_t sectors() const { return sectors_.size(); }
+
+    void serialize(StateArchive &ar);
+
+private:
+    DiskWrites mode_ = DiskWrites::Protect;
+    DiskJournal *journal_ = nullptr;
+    bool journalBacklog_ = false;
+    std::map<uint32_t, std::shared_ptr<const DiskSector>> sectors_; // ordered, so states are deterministic
+};
+
+// Append-only file of sector writes, put on disk by a background thread.
+// append() only copies the sector into a lock-free ring and never blocks
+// the emulation thread. If the writer has fallen that far behind, writes
+// wait in a per-sector backlog (the latest of each sector wins) that
+// later appends, flushBacklog() and close() move on. One machine per
+// journal: the ring has a single producer.
+class DiskJournal
+{
+public:
+    explicit DiskJournal(std::size_t queueSectors = 256) : ring_(queueSectors) {}
+    ~DiskJournal();
+
+    DiskJournal(const DiskJournal &) = delete;
+    DiskJournal &operator=(const DiskJournal &) = delete;
+
+    // Appends to an existing journal, or starts a new one
+    bool open(const std::string &path);
+    void close(); // writes out everything queued and backlogged
+    bool isOpen() const { return file_ != nullptr; }
+
+    bool append(uint32_t sector, const uint8_t *bytes);
+
+    // Moves backlogged writes into the ring as far as it has room; never
+    // blocks. Producer side, like append().
+    void flushBacklog();
+    std::size_t backlog() const { return backlog_.size(); }
+
+    // Loads a journal's sectors into an overlay, the last write of each
+    // winning. False if the file isn't a journal.
+    static bool replay(const std::string &path, DiskOverlay &overlay);
+
+private:
+    struct Record
+    {
+        uint32_t sector;
+        DiskSector data;
+    };
+
+    void writerLoop();
+    void writeRecord(const Record &record);
+
+    SpscRing<Record> ring_;
+    std::FILE *file_ = nullptr;
+    std::map<uint32_t, DiskSector> backlog_; // producer-owned
+    std::atomic<bool> stopping_{false};
+    std::thread writer_;
+};
@@ -0,0 +1,220 @@
+#ifndef EMU6502_H
+#define EMU6502_H
+/*
+ * C interface to the emulator core, for embedding it in other programs
+ * and calling it over FFI. Every call that runs the machine covers a whole
+ * budget of cycles or frames, so one crossing does thousands of cycles of
+ * work. Machines are opaque handles; none of the calls below keep the
+ * caller's pointers past their return.
+ *
+ * No C++ exception crosses this interface. A call that fails inside the
+ * core (out of memory, mostly) returns its failure value: NULL, 0,
+ * EMU6502_STOP_ERROR or EMU6502_BOOT_FAILED; a peek reads 0xFF and a
+ * void call returns with its work partly done. The machine can still be
+ * destroyed, but its state is then unspecified.
+ *
+ * Bump EMU6502_ABI_VERSION on any incompatible change to this header.
+ */
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_WIN32)
+#if defined(EMU6502_BUILD)
+#define EMU6502_API __declspec(dllexport)
+#else
+#define EMU6502_API
+#endif
+#else
+#define EMU6502_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define EMU6502_ABI_VERSION 3
+
+typedef struct emu6502_machine emu6502_machine;
+
+/* Machine profiles, as MachineType */
+enum emu6502_machine_type
+{
+    EMU6502_MACHINE_GENERIC = 0, /* bare 6502 and 64K of RAM */
+    EMU6502_MACHINE_ATARI_2600 = 1,
+    EMU6502_MACHINE_VIC20 = 2,
+    EMU6502_MACHINE_BBC_MICRO = 3,
+    EMU6502_MACHINE_PET = 4,
+    EMU6502_MACHINE_PLUS4 = 5
+};
+
+/* Why a run call returned */
+enum emu6502_stop
+{
+    EMU6502_STOP_DONE = 0,   /* reached the target (cycles, frames or PC) */
+    EMU6502_STOP_BUDGET = 1, /* max_cycles ran out first */
+    EMU6502_STOP_HALTED = 2, /* the CPU jammed or stopped */
+    EMU6502_STOP_ERROR = 3   /* failed inside the core, see above */
+};
+
+/* How emu6502_boot got the machine booted */
+enum emu6502_boot
+{
+    EMU6502_BOOT_FAILED = 0, /* halted or out of cycles before the boot point */
+    EMU6502_BOOT_RAN = 1,    /* booted, and the result cached */
+    EMU6502_BOOT_CACHED = 2  /* started from a cached boot */
+};
+
+/* Pixel formats for emu6502_convert_frame, as PixelFormat */
+enum emu6502_pixel_format
+{
+    EMU6502_PIXEL_INDEX8 = 0,
+    EMU6502_PIXEL_RGBA8888 = 1,
+    EMU6502_PIXEL_BGRA8888 = 2,
+    EMU6502_PIXEL_RGB565 = 3,
+    EMU6502_PIXEL_LUMA8 = 4
+};
+
+/* What trapped character output leaves to the ROM, as OutputTrap */
+enum emu6502_trap_output
+{
+    EMU6502_OUTPUT_MIRROR = 0, /* the ROM still draws every character */
+    EMU6502_OUTPUT_REPLACE = 1 /* printable characters skip the ROM */
+};
+
+/* What happens to BBC disk writes (emu6502_set_disk_writes) */
+enum emu6502_disk_writes
+{
+    EMU6502_DISK_PROTECT = 0,
+    EMU6502_DISK_DISCARD = 1,
+    EMU6502_DISK_MEMORY = 2,
+    EMU6502_DISK_JOURNAL = 3
+};
+
+typedef struct emu6502_registers
+{
+    uint8_t a, x, y, sp, p;
+    uint16_t pc;
+    uint64_t cycles;       /* clocked since power-on */
+    uint64_t instructions; /* executed since power-on */
+} emu6502_registers;
+
+/* The last completed frame, in colour indices. Valid until the machine
+ * next runs; pixels is NULL before the first frame or without a video
+ * device. */
+typedef struct emu6502_frame
+{
+    const uint8_t *pixels;
+    int width;
+    int height;
+    int stride;
+    uint64_t sequence;
+} emu6502_frame;
+
+EMU6502_API int emu6502_abi_version(void);
+
+/* Back machine memory with 2 MiB huge pages where the OS allows. Call
+ * before creating the first machine. */
+EMU6502_API void emu6502_use_huge_pages(int enable);
+
+/* Lifetime. create returns NULL for an unknown machine type; fork copies
+ * the full state, sharing RAM copy-on-write. */
+EMU6502_API emu6502_machine *emu6502_create(int machine_type);
+EMU6502_API emu6502_machine *emu6502_fork(const emu6502_machine *m);
+EMU6502_API void emu6502_destroy(emu6502_machine *m);
+
+EMU6502_API int emu6502_machine_type(const emu6502_machine *m);
+
+/* Copies an image into memory, bypassing ROM protection and devices */
+EMU6502_API void emu6502_load_image(emu6502_machine *m, uint16_t addr, const uint8_t *data, size_t size);
+EMU6502_API void emu6502_reset(emu6502_machine *m);
+
+/* Maps a ROM, cartridge, program or disk image file, detects its format
+ * and puts it in its place on this machine (raw images read-only at addr).
+ * Returns 0 if the file can't be opened or the machine has no place for
+ * it. Call emu6502_reset after. */
+EMU6502_API int emu6502_insert_file(emu6502_machine *m, const char *path, uint16_t addr);
+
+/* Running. Each returns an emu6502_stop. */
+EMU6502_API int emu6502_run_cycles(emu6502_machine *m, uint64_t cycles);
+EMU6502_API int emu6502_run_frames(emu6502_machine *m, uint32_t frames, uint64_t max_cycles);
+EMU6502_API int emu6502_run_until_pc(emu6502_machine *m, uint16_t pc, uint64_t max_cycles);
+
+/* Runs emu6502_run_frames on every machine in parallel; results[i] gets
+ * machine i's stop reason (results may be NULL) */
+EMU6502_API void emu6502_run_frames_batch(emu6502_machine *const *machines, int *results, size_t count,
+                                          uint32_t frames, uint64_t max_cycles);
+
+/* Bus access. Peeks have no side effects on devices; pokes go through
+ * the bus like a CPU store. */
+EMU6502_API uint8_t emu6502_peek(const emu6502_machine *m, uint16_t addr);
+EMU6502_API void emu6502_poke(emu6502_machine *m, uint16_t addr, uint8_t value);
+EMU6502_API void emu6502_peek_block(const emu6502_machine *m, uint16_t addr, uint8_t *dst, size_t size);
+EMU6502_API void emu6502_poke_block(emu6502_machine *m, uint16_t addr, const uint8_t *src, size_t size);
+
+/* set_registers leaves the cycle and instruction counts alone */
+EMU6502_API void emu6502_get_registers(const emu6502_machine *m, emu6502_registers *regs);
+EMU6502_API void emu6502_set_registers(emu6502_machine *m, const emu6502_registers *regs);
+
+/* Snapshots. save_state returns the size needed and writes only if it
+ * fits in capacity, so call it with buf NULL to size the buffer. A state
+ * only loads into a machine of the type that saved it. */
+EMU6502_API size_t emu6502_save_state(const emu6502_machine *m, uint8_t *buf, size_t capacity);
+EMU6502_API int emu6502_load_state(emu6502_machine *m, const uint8_t *buf, size_t size);
+
+/* Runs the profile's OS calls natively (see os_traps.h): character
+ * output goes to output(ctx, ch), files load from file_dir; either may be
+ * NULL, and calls needing it then run in the ROM as usual. Forks made
+ * afterwards share the traps. Returns 0 for a profile without an OS. */
+EMU6502_API int emu6502_enable_traps(emu6502_machine *m, const char *file_dir,
+                                     void (*output)(void *ctx, uint8_t ch), void *ctx);
+
+/* Whether trapped output still runs the ROM's character routine (the
+ * default, keeping the screen and cursor exact) or skips it for
+ * printable characters (see OutputTrap in os_traps.h). Forks made
+ * before keep their mode. Returns 0 if traps aren't enabled. */
+EMU6502_API int emu6502_set_trap_output(emu6502_machine *m, int mode);
+
+/* BBC: loads files from the last DFS disk inserted straight into RAM
+ * (OSFILE, *LOAD, *RUN) instead of through the disk controller (see
+ * dfs.h). Keeps any trapped output set up before. Returns 0 without a
+ * DFS disk. */
+EMU6502_API int emu6502_enable_dfs_fast_load(emu6502_machine *m);
+
+/* BBC: runs the disk drive factor times faster than real time (1, the
+ * default, loads as slowly as the hardware; see wd1770.h). Returns 0 on
+ * other profiles. */
+EMU6502_API int emu6502_set_disk_turbo(emu6502_machine *m, uint32_t factor);
+
+/* BBC disk writes (see disk_overlay.h): the image is never written;
+ * sectors the machine writes are write protected, discarded, kept in
+ * memory, or kept and journaled to journal_path by a background thread,
+ * after loading the sectors the journal already holds. Forks keep the
+ * written sectors but don't journal. Returns 0 on other profiles or if
+ * the journal can't be opened. */
+EMU6502_API int emu6502_set_disk_writes(emu6502_machine *m, int mode, const char *journal_path);
+
+/* Resets and boots the machine up to boot_point ("frames:<n>", "pc:<hex>"
+ * or "cycles:<n>"), or starts it from the state a previous boot with the
+ * same profile, inserted files, loaded images and boot point left in
+ * cache_dir (see boot_cache.h). An empty cache_dir caches in memory only.
+ * Returns an emu6502_boot. */
+EMU6502_API int emu6502_boot(emu6502_machine *m, const char *cache_dir, const char *boot_point, uint64_t max_cycles);
+
+/* Suspend to and resume from a state file that survives the process (see
+ * suspend_file.h). A suspend interrupted by a crash leaves the previous
+ * one resumable. resume returns 0 if the file holds no suspend of this
+ * machine's type; insert the same images before resuming. */
+EMU6502_API int emu6502_suspend(const emu6502_machine *m, const char *path);
+EMU6502_API int emu6502_resume(emu6502_machine *m, const char *path);
+
+EMU6502_API void emu6502_get_frame(const emu6502_machine *m, emu6502_frame *frame);
+
+/* Converts the last frame through the device palette into dst, stride
+ * bytes apart per row. Returns 0 if there is no frame yet. */
+EMU6502_API int emu6502_convert_frame(const emu6502_machine *m, int format, void *dst, size_t stride);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,62 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "framebuffer.h"
+
+// One entry per completed frame
+struct FrameHashRecord
+{
+    uint64_t sequence;  // frame number
+    uint64_t frameHash; // hash64 of the frame's pixel block
+    uint64_t ramHash;   // hash64 of RAM at the end of the frame
+};
+
+// Hash of a completed frame. Row padding is always zero, so the whole
+// block is hashed in one pass.
+uint64_t hashFrame(const FrameView &frame);
+
+// Compact log of per-frame hashes for golden-frame regression runs.
+// File layout: 8-byte magic "6502FHL1", then packed FrameHashRecords.
+// With a golden log loaded, every capture is compared against it and the
+// first differing frame is kept for reporting.
+class FrameHashLog
+{
+public:
+    FrameHashLog() = default;
+    ~FrameHashLog();
+
+    FrameHashLog(const FrameHashLog &) = delete;
+    FrameHashLog &operator=(const FrameHashLog &) = delete;
+
+    bool openOutput(const std::string &path);
+    bool loadGolden(const std::string &path);
+    void close();
+
+    // Hash the bus's current frame and RAM, append to the output log and
+    // check against the golden log. Returns false on the first mismatch
+    // (or when the run outlives the golden log).
+    template <class BusType>
+    bool capture(const BusType &mem)
+    {
+        FrameView frame = mem.Frame();
+        return record({frame.sequence, hashFrame(frame), mem.HashRam()});
+    }
+
+    bool record(const FrameHashRecord &rec);
+
+    bool diverged() const { return diverged_; }
+    const FrameHashRecord &mismatch() const { return mismatch_; }  // what we saw
+    const FrameHashRecord &expected() const { return expected_; }  // what golden had
+    uint64_t framesChecked() const { return checked_; }
+
+private:
+    std::FILE *out_ = nullptr;
+    std::vector<FrameHashRecord> golden_;
+    uint64_t checked_ = 0;
+    bool diverged_ = false;
+    FrameHashRecord mismatch_{};
+    FrameHashRecord expected_{};
+};
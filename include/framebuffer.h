@@ -0,0 +1,101 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "arena.h"
+
+// Read-only view of a completed frame. Pixels are colour indices laid out
+// row after row, `stride` bytes apart; padding at the end of each row is
+// always zero so the whole block can be hashed or copied in one go.
+struct FrameView
+{
+    const uint8_t *pixels = nullptr;
+    int width = 0;
+    int height = 0;
+    int stride = 0;
+    uint64_t sequence = 0; // 0 until the first frame has completed
+
+    const uint8_t *row(int y) const { return pixels + static_cast<std::size_t>(y) * stride; }
+    std::size_t bytes() const { return static_cast<std::size_t>(stride) * height; }
+};
+
+class StateArchive;
+
+// Double-buffered frame store. The device draws into the back buffer and
+// swap() publishes it as the front buffer, which consumers read in place.
+// The sequence number increments on every swap so pollers can tell when a
+// new frame is available. A consumer on another thread takes front(),
+// uses the pixels, then checks unchangedSince(view.sequence) and discards
+// what it read if a swap came in between. That covers swaps only: clear,
+// loading a state and copying must not overlap such a reader.
+//
+// Copies share the pixel block until one of them draws, so forking a
+// machine doesn't pay for its frames up front. That draw replaces the
+// block under the drawing copy: once a FrameBuffer has been copied or
+// copied from, front() on another thread must not run concurrently with
+// its draws either.
+class FrameBuffer
+{
+public:
+    static constexpr int RowAlign = 64; // stride is padded to a cache line
+
+    FrameBuffer(int width, int height);
+    FrameBuffer(const FrameBuffer &other);
+    FrameBuffer &operator=(const FrameBuffer &other);
+
+    void clear();
+    void swap();
+
+    void serialize(StateArchive &ar);
+
+    // Rows of the frame currently being drawn
+    uint8_t *backRow(int y) { return writable() + backOffset_ + static_cast<std::size_t>(y) * stride_; }
+    const uint8_t *backRow(int y) const { return storage_->data() + backOffset_ + static_cast<std::size_t>(y) * stride_; }
+
+    // Rows of the last completed frame
+    const uint8_t *frontRow(int y) const { return storage_->data() + frontOffset_.load(std::memory_order_relaxed) + static_cast<std::size_t>(y) * stride_; }
+
+    FrameView front() const;
+
+    // False if the frame a view was taken of has since been swapped out
+    bool unchangedSince(uint64_t sequence) const
+    {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return sequence_.load(std::memory_order_relaxed) == sequence;
+    }
+
+    int width() const { return width_; }
+    int height() const { return height_; }
+    int stride() const { return stride_; }
+    uint64_t sequence() const { return sequence_.load(std::memory_order_acquire); }
+
+private:
+    // Pooled, so the block starts on a cache line (rows can be streamed
+    // with aligned vector loads) and a fork's first draw reuses a freed one
+    using Storage = std::vector<uint8_t, PoolAllocator<uint8_t>>;
+
+    uint8_t *writable()
+    {
+        if (storage_.use_count() != 1)
+            unshare();
+        return storage_->data();
+    }
+    void unshare();
+
+    int width_;
+    int height_;
+    int stride_;
+    std::size_t frameBytes_;
+
+    // Both frames live in one allocation; offsets (not pointers) select the
+    // front and back halves so copies of a FrameBuffer stay self-contained.
+    // swap() publishes the front offset with a release increment of the
+    // sequence, which readers load with acquire; a release fence after it
+    // keeps the next frame's pixel writes from showing before it.
+    std::shared_ptr<Storage> storage_;
+    std::atomic<std::size_t> frontOffset_{0};
+    std::size_t backOffset_ = 0;
+    std::atomic<uint64_t> sequence_{0};
+};
@@ -0,0 +1,7 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// 64-bit non-cryptographic hash (XXH64 algorithm). Used for frame and RAM
+// fingerprints, so results are stable across platforms and builds.
+uint64_t hash64(const void *data, std::size_t len, uint64_t seed = 0);
@@ -0,0 +1,65 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Which file a mapped image came from, as the OS knows it: the same id
+// is the same file, unchanged since (size and modification time)
+struct FileId
+{
+    uint64_t device = 0;
+    uint64_t inode = 0;
+    uint64_t size = 0;
+    uint64_t mtime = 0; // nanoseconds, or the OS's own units
+
+    bool operator==(const FileId &other) const
+    {
+        return device == other.device && inode == other.inode && size == other.size && mtime == other.mtime;
+    }
+};
+
+// Read-only image bytes: a ROM, cartridge, program or disk image, either
+// mapped straight from its file or held in memory. Mapped files are
+// paged in on first touch, so opening one costs the same whatever its
+// size, and every process mapping the same file shares its physical
+// pages through the OS page cache. Immutable once made, so one image can
+// back any number of machines on any threads.
+class Image
+{
+public:
+    // nullptr if the file can't be opened. Falls back to reading it when
+    // the OS won't map it (empty files, special files).
+    static std::shared_ptr<const Image> map(const std::string &path);
+    static std::shared_ptr<const Image> fromBytes(std::vector<uint8_t> bytes);
+
+    ~Image();
+    Image(const Image &) = delete;
+    Image &operator=(const Image &) = delete;
+
+    const uint8_t *data() const { return data_; }
+    std::size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    bool mapped() const { return mapping_ != nullptr; }
+
+    // Where it came from, for format hints (file extension); empty if
+    // made from bytes
+    const std::string &path() const { return path_; }
+
+    // The file a mapped image came from; nullptr if it was read or made
+    // from bytes
+    const FileId *fileId() const { return mapping_ ? &fileId_ : nullptr; }
+
+private:
+    Image() = default;
+
+    const uint8_t *data_ = nullptr;
+    std::size_t size_ = 0;
+    void *mapping_ = nullptr;     // base of the file mapping, if mapped
+    std::vector<uint8_t> bytes_;  // otherwise the bytes themselves
+    std::string path_;
+    FileId fileId_;
+};
+
+using RomImage = std::shared_ptr<const Image>;
@@ -0,0 +1,99 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include "banking.h"
+#include "image.h"
+#include "machine.h"
+
+// Image loading
+// ------------------------------------------------------------
+// Images are opened with Image::map, so none is read or copied up front;
+// detectImage touches only the few bytes its checks need. A format is
+// told from the image's header, then its size and file extension; the
+// database overrides both for images whose contents don't say (most 8K
+// 2600 cartridges share one size across three schemes). The database is
+// only hashed against when it holds an entry of the image's size.
+
+enum class ImageFormat : uint8_t
+{
+    Unknown,     // nothing recognised: raw bytes
+    Raw,         // known raw ROM or binary
+    Prg,         // Commodore program: load address, then the bytes
+    Cart2600,    // Atari 2600 cartridge
+    SidewaysRom, // Acorn paged ROM, "(C)" header
+    DfsSsd,      // Acorn DFS disk, single sided
+    DfsDsd       // Acorn DFS disk, double sided, tracks interleaved
+};
+
+// Short names, as used in the database file: unknown, raw, prg, a26,
+// rom, ssd, dsd
+const char *imageFormatName(ImageFormat format);
+bool parseImageFormat(const std::string &name, ImageFormat &format);
+
+struct ImageInfo
+{
+    ImageFormat format = ImageFormat::Unknown;
+    CartScheme scheme = CartScheme::Auto; // Cart2600
+    uint16_t loadAddr = 0;                // Prg
+    std::string name;                     // database title, if listed
+};
+
+ImageInfo detectImage(const Image &image);
+
+// The 2600 scheme an image's code points to: the signature byte
+// sequences of E0, FE and 3F bank switches, else by size
+CartScheme detectCartScheme(const Image &image);
+
+// Database entries key on the image's hash64 and size. There are no
+// built-in entries; add them here or from a file of lines
+//   <hash64 hex> <size> <format> <scheme> [name]
+// with '#' comments, formats and schemes by their short names.
+struct KnownImage
+{
+    uint64_t hash;
+    uint64_t size;
+    ImageFormat format;
+    CartScheme scheme;
+    std::string name;
+};
+
+void addKnownImage(const KnownImage &entry);
+int loadImageDatabase(const std::string &path); // entries added, -1 if unreadable
+
+// Puts an image where its format goes on this profile: a cartridge or
+// sideways ROM into its slot, a disk into the drive, a program into RAM
+// at its load address. Anything else, or a format this profile has no
+// slot for, is mapped read-only at `addr`. False only for a disk on a
+// profile without a drive, or an image its slot refused.
+template <class MachineT>
+bool insertImage(MachineT &m, const RomImage &image, const ImageInfo &info, uint16_t addr = 0, int romSlot = 15)
+{
+    if (!image)
+        return false;
+    if (info.format == ImageFormat::Prg)
+    {
+        if (image->size() < 2)
+            return false;
+        m.mem.Load(info.loadAddr, image->data() + 2, image->size() - 2);
+        return true;
+    }
+    if constexpr (MachineT::type == MachineType::Atari2600)
+    {
+        if (info.format == ImageFormat::Cart2600)
+            return m.mem.InsertCartridge(image, info.scheme);
+    }
+    if constexpr (MachineT::type == MachineType::BBCMicro)
+    {
+        if (info.format == ImageFormat::SidewaysRom)
+            return m.mem.InsertSidewaysRom(romSlot, image);
+        if (info.format == ImageFormat::DfsSsd || info.format == ImageFormat::DfsDsd)
+        {
+            m.mem.disk.insertDisk(image, info.format == ImageFormat::DfsDsd);
+            return true;
+        }
+    }
+    if (info.format == ImageFormat::DfsSsd || info.format == ImageFormat::DfsDsd)
+        return false;
+    m.mem.MapImage(addr, image);
+    return true;
+}
@@ -0,0 +1,161 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <variant>
+#include <vector>
+#include "bus.h"
+#include "bus_2600.h"
+#include "bus_bbc.h"
+#include "bus_pet.h"
+#include "bus_plus4.h"
+#include "bus_vic20.h"
+#include "cpu6502.h"
+#include "hash64.h"
+#include "state_archive.h"
+
+// A CPU and the bus it drives, copyable as one value. Copying is how
+// snapshots are taken, and is cheap since RAM pages are shared until
+// written: the copy's CPU and devices are re-pointed at the copy's own
+// memory. Bindings (onFrame, device ports, audio output) are
+// copied as they are.
+template <MachineType Type>
+struct Machine
+{
+    static constexpr MachineType type = Type;
+    using BusType = Bus<Type>;
+
+    BusType mem;
+    CPU6502<BusType> cpu;
+
+    Machine() { cpu.mem = &mem; }
+
+    Machine(const Machine &other) : mem(other.mem), cpu(other.cpu) { Rebind(); }
+
+    Machine &operator=(const Machine &other)
+    {
+        mem = other.mem;
+        cpu = other.cpu;
+        Rebind();
+        return *this;
+    }
+
+    // Branch point for search: RAM pages are shared copy-on-write (see
+    // Memory::Pages), CPU and device state are copied by value
+    Machine Fork() const { return Machine(*this); }
+
+    void Reset(bool is6507 = BusType::Is6507) { cpu.Reset(mem, is6507); }
+    void Step() { cpu.Step(); }
+
+    // Full state as a flat blob, and back. Loading keeps this machine's
+    // bindings and configuration (clock mode, pacing, state hashing), and
+    // fails on a state saved by another profile. Without RAM, the state
+    // covers the CPU and devices only, and loads only as such.
+    std::vector<uint8_t> SaveState(bool withRam = true) const
+    {
+        StateArchive ar;
+        if (!withRam)
+            ar.excludeRam();
+        const_cast<Machine *>(this)->Serialize(ar);
+        return ar.data();
+    }
+
+    bool LoadState(const uint8_t *bytes, std::size_t size, bool withRam = true)
+    {
+        StateArchive ar(bytes, size);
+        if (!withRam)
+            ar.excludeRam();
+        Serialize(ar);
+        return ar.ok();
+    }
+
+    // hash64 of the full saved state, frame pixels included, at the cost
+    // of a serialization pass over RAM
+    uint64_t StateHash() const
+    {
+        std::vector<uint8_t> state = SaveState();
+        return hash64(state.data(), state.size());
+    }
+
+    // hash64 of the device state alone: every register, counter, beam
+    // position, timer and latch the bus saves, but not RAM or frame pixels
+    uint64_t DeviceHash() const
+    {
+        StateArchive ar;
+        ar.excludeRam();
+        ar.excludeFrames();
+        const_cast<BusType &>(mem).Serialize(ar);
+        return hash64(ar.data().data(), ar.data().size());
+    }
+
+    // The whole machine state folded into one word, for duplicate-state
+    // pruning: CPU registers, RAM and device RAM through the incremental
+    // hash (mem.EnableStateHash(true) must be on), DeviceHash() and the
+    // elapsed cycles. Only frame pixels, which the devices redraw from
+    // that state, are left out. The RAM part is O(1); the device part is
+    // a pass over a few hundred bytes of registers.
+    uint64_t Fingerprint() const
+    {
+        return cpu.Fingerprint() ^ (DeviceHash() * 0xC2B2AE3D27D4EB4FULL) ^
+               (cpu.total_cycles * 0x9E3779B97F4A7C15ULL);
+    }
+
+private:
+    void Serialize(StateArchive &ar)
+    {
+        MachineType saved = Type; // leads every state, see stateMachineType
+        ar.io(saved);
+        if (saved != Type)
+        {
+            ar.fail();
+            return;
+        }
+        cpu.Serialize(ar);
+        mem.Serialize(ar);
+    }
+
+    void Rebind()
+    {
+        cpu.mem = &mem;
+        mem.RebindDevices();
+    }
+};
+
+// Profile of a saved state, from its first byte
+inline bool stateMachineType(const uint8_t *state, std::size_t size, MachineType &type)
+{
+    if (size < 1 || state[0] >= MachineTypeCount)
+        return false;
+    type = static_cast<MachineType>(state[0]);
+    return true;
+}
+
+// Any profile's machine, chosen at run time. Dispatch once per coarse
+// operation with std::visit and a generic lambda; everything inside runs
+// on the concrete Machine<> type.
+using AnyMachine = std::variant<Machine<MachineType::Generic>, Machine<MachineType::Atari2600>,
+                                Machine<MachineType::VIC20>, Machine<MachineType::BBCMicro>,
+                                Machine<MachineType::PET>, Machine<MachineType::Plus4>>;
+
+#define CHECK_VARIANT_ORDER(T) \
+    static_assert(std::variant_alternative_t<static_cast<int>(T), AnyMachine>::type == T, "AnyMachine order");
+FOR_EACH_MACHINE_TYPE(CHECK_VARIANT_ORDER)
+#undef CHECK_VARIANT_ORDER
+
+inline AnyMachine makeMachine(MachineType type)
+{
+    switch (type)
+    {
+    case MachineType::Atari2600:
+        return AnyMachine(std::in_place_index<1>);
+    case MachineType::VIC20:
+        return AnyMachine(std::in_place_index<2>);
+    case MachineType::BBCMicro:
+        return AnyMachine(std::in_place_index<3>);
+    case MachineType::PET:
+        return AnyMachine(std::in_place_index<4>);
+    case MachineType::Plus4:
+        return AnyMachine(std::in_place_index<5>);
+    default:
+        return AnyMachine(std::in_place_index<0>);
+    }
+}
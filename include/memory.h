@@ -1,77 +1,216 @@
 #ifndef MEMORY_H
 #define MEMORY_H
 
+#include <atomic>
+#include <cstddef>
 #include <cstdint>
+#include <memory>
+#include <vector>
+#include "../include/image.h"
 #include "../include/rom_space.h"
+#include "../include/framebuffer.h"
 
+class OsTraps;
+class Palette;
+class StateArchive;
 
-#ifdef USE_TIA
-#include "tia.h"
-#endif
-#ifdef USE_RIOT
-#include "riot.h"
-#endif
-#ifdef USE_VIC
-#include "vic.h"
-#endif
-#ifdef USE_PIA
-#include "pia.h"
-#endif
-#ifdef USE_ACIA
-#include "acia.h"
-#endif
-#ifdef USE_VIA
-#include "via.h"
-#ifdef USE_MICRO
-#include "wd1770.h"
-#endif
-#endif
-#ifdef USE_6529
-#include "mos6529.h"
-#endif
+// The RAM side of a bus: 64 KiB of copy-on-write pages, ROM protection
+// and the state hash. On its own it is a plain 6502 with nothing but
+// memory; each machine profile's Bus<> (see bus.h) derives from it and
+// decodes its devices in front of the RAM. Calls are resolved against
+// the concrete bus type, never through a Memory reference.
 class Memory
 {
 public:
-#ifdef USE_TIA
-    TIA tia;
-#endif
-#ifdef USE_RIOT
-    RIOT6532 riot;
-#endif
-#ifdef USE_VIA
-    VIA6522 via;
-#ifdef USE_MICRO
-    VIA via2; // BBC Micro's second VIA
-    WD1770 disk; // BBC Micro's Disk Controller
-#endif
-
-#endif
-#ifdef USE_VIC
-    VIC vic;
-#endif
-#ifdef USE_PIA
-    PIA pia;
-#endif
-#ifdef USE_ACIA
-    ACIA acia;
-#endif
-#ifdef USE_6529
-  MOS6529 io;
-#endif
-
     static constexpr uint32_t MAX_MEM = 64 * 1024;
+    static constexpr uint32_t PAGE_SIZE = 256;
+    static constexpr uint32_t PAGE_COUNT = MAX_MEM / PAGE_SIZE;
 
-    Memory(RomSpace romSpace = RomSpace::NONE);
+    explicit Memory(RomSpace romSpace = RomSpace::NONE);
     void Reset();
-    uint8_t Read(uint16_t addr) const;
-    void Write(uint16_t addr, uint8_t data);
-    void Clock();
-    bool CheckIRQLines();
+
+    uint8_t Read(uint16_t addr) const
+    {
+        if (use6507addresspace)
+            addr &= 0x1FFF; // 8KB wrap , hard eltircal limit
+        return readPages[addr >> 8][addr & 0xFF];
+    }
+
+    void Write(uint16_t addr, uint8_t value)
+    {
+        if (use6507addresspace)
+            addr &= 0x1FFF;
+        if (!IsRom(addr))
+            WriteRam(addr, value);
+    }
+
+    // No devices to clock or to raise an interrupt
+    void Clock() {}
+    bool CheckIRQLines() { return false; }
+    bool CheckNMILine() { return false; }
+
+    // Copy an image straight into the RAM array, bypassing ROM protection
+    // and device decoding (how ROMs and programs are put in place). Whole
+    // pages come from the process-wide store (rom_store.h), so machines
+    // that load the same bytes share them until one writes.
+    void Load(uint16_t addr, const uint8_t *bytes, std::size_t size);
+
+    // RAM array contents with no device side effects (for tools)
+    uint8_t Peek(uint16_t addr) const { return readPages[addr >> 8][addr & 0xFF]; }
+
+    // RAM is a table of 256-byte pages shared copy-on-write: copying a
+    // Memory (a fork) shares every page, and a page is only duplicated
+    // the first time one of the sharers writes it. Pages never written
+    // (ROM, untouched RAM) stay shared by every copy.
+    const uint8_t *const *Pages() const { return readPages; }
+    int PrivatePages() const; // pages this copy has had to duplicate
+
+    // The RAM page under any bank mapping, as Serialize saves it
+    const uint8_t *RamPage(uint8_t page) const { return pageOwners[page].get(); }
+
+    // A zeroed page from the pooled allocator (arena.h)
+    static std::shared_ptr<uint8_t> NewPage();
+
+    // Bank switching: point a page's reads at read-only storage outside
+    // the page table (a bank of a loaded ROM image, which must outlive
+    // the mapping), and back. Writes to a mapped page are ignored; the RAM
+    // page under it is kept, and is what Load, Serialize and the hashes
+    // see. A remap is one pointer store per page, never a copy.
+    void MapPage(uint8_t page, const uint8_t *data)
+    {
+        readPages[page] = data;
+        pageFlags[page] |= PAGE_MAPPED;
+    }
+    void UnmapPage(uint8_t page)
+    {
+        readPages[page] = pageOwners[page].get();
+        pageFlags[page] &= ~PAGE_MAPPED;
+    }
+
+    // Map an image read-only at a page-aligned address, in place of the
+    // RAM there, without copying it: the page table points into the image
+    // (a file mapping, for Image::map) and the machine holds a reference
+    // to it. A partial last page, or an image at an unaligned address, is
+    // loaded into RAM instead. Like banks,
+    // the mapping is configuration, not saved state.
+    void MapImage(uint16_t addr, RomImage image);
+
+    // Pages whose reads or writes the bus hands to its banking logic
+    // (hotspots); every other access pays one flag test
+    void SetHotspotPage(uint8_t page, bool reads, bool writes)
+    {
+        pageFlags[page] &= ~(PAGE_HOT_READ | PAGE_HOT_WRITE);
+        pageFlags[page] |= (reads ? PAGE_HOT_READ : 0) | (writes ? PAGE_HOT_WRITE : 0);
+    }
+    bool IsReadHotspot(uint16_t addr) const { return (pageFlags[addr >> 8] & PAGE_HOT_READ) != 0; }
+    bool IsWriteHotspot(uint16_t addr) const { return (pageFlags[addr >> 8] & PAGE_HOT_WRITE) != 0; }
+
+    // OS call traps (os_traps.h) the CPU runs in place of the ROM, or
+    // none. Host configuration like a mapping: copied to forks, never
+    // saved. The table must outlive the machine.
+    void SetTraps(const OsTraps *traps);
+    const OsTraps *Traps() const { return traps; }
+    bool IsTrapPage(uint16_t addr) const { return (pageFlags[addr >> 8] & PAGE_TRAP) != 0; }
+
+    // Save or restore RAM. The incremental hash is rebuilt after a load
+    // rather than stored.
+    void Serialize(StateArchive &ar);
+
+    // Memory copies by value; afterwards the copy must call this so
+    // devices that read RAM directly point at its own page table
+    void RebindDevices() {}
+
+    // Last completed frame of the display device and a counter that
+    // advances each time a new one is published; none without one
+    FrameView Frame() const { return FrameView{}; }
+    uint64_t FrameSequence() const { return 0; }
+    const Palette &FramePalette() const;
+
+    RomSpace GetRomSpace() const { return romSpace; }
+
+    // hash64 over all RAM (the bus array plus device-owned RAM)
+    uint64_t HashRam() const;
+
+    // Optional incrementally maintained RAM hash: the XOR over every RAM
+    // byte of a mix of (address, value). Write() patches it in O(1), so a
+    // state fingerprint never needs a pass over memory. Kept per 256-byte
+    // page as well, and cleared (0) while disabled.
+    void EnableStateHash(bool enable);
+    bool StateHashEnabled() const { return stateHashOn; }
+    uint64_t StateHash() const { return stateHash; }
+    uint64_t PageHash(uint8_t page) const { return pageHash[page]; }
     bool use6507addresspace = false;
 
+protected:
+    // State hash keys: bus RAM uses its address, each device RAM slot is
+    // tagged above it
+    static constexpr int DEVICE_RAM_SLOTS = 2;
+    static constexpr uint32_t DeviceRamKey(int slot) { return static_cast<uint32_t>(slot + 1) << 16; }
+
+    bool IsRom(uint16_t addr) const { return (pageFlags[addr >> 8] & (PAGE_ROM | PAGE_MAPPED)) != 0; }
+
+    void WriteRam(uint16_t addr, uint8_t value)
+    {
+        if (stateHashOn)
+            UpdateStateHash(addr, RamByte(addr), value);
+        WritablePage(addr >> 8)[addr & 0xFF] = value;
+    }
+
+    // State a device keeps outside the page table (the 2600's RIOT RAM,
+    // bank registers), folded into HashRam and the state hash under
+    // DeviceRamKey(slot) | offset. The bus writes it through the device
+    // and reports each change itself.
+    void SetDeviceRam(int slot, const uint8_t *ram, uint32_t size)
+    {
+        deviceRam[slot] = ram;
+        deviceRamSize[slot] = size;
+    }
+
+    void SerializeRam(StateArchive &ar);
+    void RecomputeStateHash();
+    void UpdateStateHash(uint32_t key, uint8_t oldValue, uint8_t newValue);
+
 private:
+    using Page = uint8_t[PAGE_SIZE];
+
+    enum : uint8_t
+    {
+        PAGE_ROM = 1,       // write protected by romSpace
+        PAGE_MAPPED = 2,    // reads come from a MapPage bank
+        PAGE_HOT_READ = 4,  // bank-switch hotspots
+        PAGE_HOT_WRITE = 8,
+        PAGE_TRAP = 16      // holds an OS call trap
+    };
+
+    // The RAM page under any mapping
+    uint8_t RamByte(uint16_t addr) const { return pageOwners[addr >> 8].get()[addr & 0xFF]; }
+
+    // Writable view of a page, duplicating it first if it is shared
+    uint8_t *WritablePage(uint32_t page)
+    {
+        if (pageOwners[page].use_count() != 1)
+            CopyPage(page);
+        else // sole owner: order after a sibling's last read before it let go
+            std::atomic_thread_fence(std::memory_order_acquire);
+        return pageOwners[page].get();
+    }
+    void CopyPage(uint32_t page);
+    void SharePage(uint32_t page, const uint8_t *bytes); // content from the store
+
     RomSpace romSpace; // Which ROM layout to protect
-    uint8_t data[MAX_MEM];
+    uint8_t pageFlags[PAGE_COUNT] = {};
+    std::shared_ptr<uint8_t> pageOwners[PAGE_COUNT];
+    const uint8_t *readPages[PAGE_COUNT] = {}; // pageOwners[i].get() or a mapped bank, for the read path
+
+    std::vector<RomImage> images; // kept alive for MapImage's pages
+    const OsTraps *traps = nullptr;
+
+    const uint8_t *deviceRam[DEVICE_RAM_SLOTS] = {};
+    uint32_t deviceRamSize[DEVICE_RAM_SLOTS] = {};
+
+    bool stateHashOn = false;
+    uint64_t stateHash = 0;
+    uint64_t pageHash[PAGE_COUNT] = {};
 };
 
-#endif // MEMORY_H
\ No newline at end of file
+#endif // MEMORY_H
@@ -7,6 +7,8 @@
 // Simple 8-bit parallel I/O port with global direction control.
 // No timers, no interrupts, no handshaking.
 
+class StateArchive;
+
 class MOS6529
 {
 public:
@@ -15,6 +17,9 @@ public:
     // Reset to power-on state
     void reset();
 
+    // Save or restore the port state
+    void serialize(StateArchive &ar);
+
     // Read from the port's memory-mapped register
     uint8_t read() const;
 
@@ -0,0 +1,156 @@
+#pragma once
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "bus.h"
+#include "port.h"
+
+// High-level emulation of OS entry points. A trap table maps the address
+// of an OS call (OSWRCH at $FFEE, CHROUT at $FFD2, ...) to a native
+// routine; when the CPU is about to fetch an instruction there, the
+// routine does the call's work on the guest's registers and memory,
+// charges a fixed cycle cost and returns to the caller as RTS would, so
+// the ROM code never runs. A routine may decline a call it does not
+// cover (an OSBYTE it does not know, a file the host does not have, a
+// vector a program has redirected): the ROM routine then runs as usual.
+//
+// Character output is the exception by default: see OutputTrap.
+//
+// Each profile has its own table (see OsTraps(MachineType)); a machine
+// uses one once its bus is given it with SetTraps. Only pages holding a
+// trap pay for the lookup; every other fetch tests one page flag.
+
+enum class OsCall : uint8_t
+{
+    Oswrch, // BBC: write character A
+    Osrdch, // BBC: read character into A
+    Osbyte, // BBC: the calls listed in os_traps.cpp
+    Osfile, // BBC: A=&FF, load a whole file
+    Chrout, // Commodore: write character A
+    Load,   // Commodore: A=0, load a program file
+    Oscli   // BBC: *LOAD and *RUN
+};
+
+const char *osCallName(OsCall call);
+bool parseOsCall(const std::string &name, OsCall &call);
+
+// What the OSWRCH and CHROUT traps leave to the ROM. Both hand every
+// character to OsHost::output first.
+//   mirror:  the ROM routine still runs, so screen memory, the cursor
+//            (POS, VPOS) and the VDU queue change exactly as without
+//            traps (the default)
+//   replace: printable characters skip the ROM and never reach the
+//            screen or move the cursor; control codes, and on the BBC
+//            every byte while a VDU sequence is queued, still run there
+enum class OutputTrap : uint8_t
+{
+    Mirror,
+    Replace
+};
+
+const char *outputTrapName(OutputTrap mode);
+bool parseOutputTrap(const std::string &name, OutputTrap &mode);
+
+// A file handed to the guest. Without addresses (a plain host file), a
+// BBC load needs an address from the caller; a Commodore file carries
+// its own in its first two bytes.
+struct OsFile
+{
+    std::vector<uint8_t> data;
+    uint32_t load = 0;
+    uint32_t exec = 0;
+    bool hasAddresses = false;
+};
+
+// What the traps do on the host's side. Any may be left unbound; the
+// calls that need it are then declined.
+struct OsHost
+{
+    Port<void(uint8_t)> output;                           // OSWRCH, CHROUT
+    Port<int()> input;                                    // OSRDCH, OSBYTE &81: -1 if none waiting
+    Port<bool(const std::string &name, OsFile &file)> open; // OSFILE, LOAD
+};
+
+// Files from a host directory, for OsHost::open. A BBC name loses its
+// directory prefix ("$.NAME" opens NAME); addresses come from a
+// NAME.inf file beside it when there is one ("$.NAME FF1900 FF8023").
+class HostDirectory
+{
+public:
+    explicit HostDirectory(std::string dir) : dir_(std::move(dir)) {}
+    bool open(const std::string &name, OsFile &file);
+
+private:
+    std::string dir_;
+};
+
+// The guest side of a trap: registers in and out, and the bus
+struct TrapCpu
+{
+    uint8_t A, X, Y, P;
+    Port<uint8_t(uint16_t)> read;
+    Port<void(uint16_t, uint8_t)> write;
+    Port<void(uint16_t, const uint8_t *, std::size_t)> load; // into RAM, as Bus::Load
+    int32_t jump = -1; // set to continue there instead of returning (*RUN)
+};
+
+class OsTraps
+{
+public:
+    // Cycles charged for a call unless set otherwise, roughly what the
+    // ROM routine takes for one character or one parameter block
+    static constexpr uint32_t DefaultCycles = 200;
+
+    // The profile's entry points; none for profiles without an OS ROM
+    explicit OsTraps(MachineType type = MachineType::Generic);
+
+    void add(uint16_t pc, OsCall call, uint32_t cycles = DefaultCycles, uint16_t vector = 0);
+    void remove(uint16_t pc);
+    void setCycles(OsCall call, uint32_t cycles); // for every entry of the call
+
+    bool empty() const { return entries_.empty(); }
+    bool has(uint16_t pc) const { return pcs_[pc]; }
+    bool hasPage(uint8_t page) const;
+
+    // Runs the trap at pc; false if it declines. On success the registers
+    // are the call's results and cycles its cost.
+    bool run(uint16_t pc, TrapCpu &cpu, uint32_t &cycles) const;
+
+    // The entries, their costs, the output mode and which host ports are
+    // bound, for caches of what a machine computes (BootCache). What the
+    // bound ports serve isn't covered.
+    uint64_t configHash() const;
+
+    OsHost host;
+    OutputTrap output = OutputTrap::Mirror;
+
+private:
+    struct Entry
+    {
+        uint16_t pc;
+        OsCall call;
+        uint32_t cycles;
+        uint16_t vector; // indirection the ROM entry jumps through, 0 if none
+    };
+
+    // Zero-page layout of the Commodore KERNAL's file parameters
+    struct KernalFiles
+    {
+        uint16_t fnLen, fnAddr, secondary, status, endAddr;
+    };
+
+    bool vectorRedirected(const Entry &e, TrapCpu &cpu) const;
+    bool writeCharacter(OsCall call, TrapCpu &cpu) const;
+    bool osbyte(TrapCpu &cpu) const;
+    bool osfile(TrapCpu &cpu) const;
+    bool load(TrapCpu &cpu) const;
+    bool oscli(TrapCpu &cpu) const;
+
+    std::vector<Entry> entries_;
+    std::bitset<65536> pcs_;
+    uint16_t romStart_ = 0xC000; // where an OS vector points until redirected
+    uint16_t romEnd_ = 0xFF00;
+    KernalFiles kernal_ = {};
+};
@@ -0,0 +1,62 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include "framebuffer.h"
+
+// Output pixel formats for palette conversion. Byte order names the order
+// in memory, e.g. RGBA8888 writes R, G, B, A.
+enum class PixelFormat : uint8_t
+{
+    Index8,   // colour index copied through unchanged
+    RGBA8888,
+    BGRA8888,
+    RGB565,   // native-endian 16-bit
+    Luma8     // Rec.601 luminance, for grayscale consumers
+};
+
+inline int bytesPerPixel(PixelFormat fmt)
+{
+    switch (fmt)
+    {
+    case PixelFormat::RGBA8888:
+    case PixelFormat::BGRA8888:
+        return 4;
+    case PixelFormat::RGB565:
+        return 2;
+    default:
+        return 1;
+    }
+}
+
+// Colour-index to pixel lookup tables, pre-expanded for every output
+// format. Tables always hold 256 entries (indices wrap modulo the palette
+// size) so vector gathers never read out of bounds.
+class Palette
+{
+public:
+    Palette(const uint32_t *rgb, int count); // entries as 0xRRGGBB
+
+    // Built-in palettes
+    static const Palette &tiaNTSC();
+    static const Palette &tiaPAL();
+    static const Palette &vicNTSC();
+    static const Palette &vicPAL();
+
+    int size() const { return count_; }
+    uint32_t rgb(uint8_t index) const { return rgb_[index]; }
+
+    // Convert `count` indices into `dst` (bytesPerPixel(fmt) bytes each)
+    void convertRow(const uint8_t *src, int count, PixelFormat fmt, void *dst) const;
+
+    // Convert a whole frame into a caller-provided buffer, `dstStride`
+    // bytes between rows.
+    void convertFrame(const FrameView &src, PixelFormat fmt, void *dst, std::size_t dstStride) const;
+
+private:
+    int count_;
+    alignas(64) uint32_t rgb_[256];
+    alignas(64) uint32_t rgba_[256];
+    alignas(64) uint32_t bgra_[256];
+    alignas(64) uint32_t rgb565_[256]; // widened so gathers can use 32-bit lanes
+    alignas(64) uint32_t luma_[256];
+};
@@ -1,17 +1,21 @@
 #pragma once
 #include <cstdint>
 
+class StateArchive;
+
 class PIA {
 public:
     PIA();
 
     void reset();
+    void serialize(StateArchive& ar);
 
     // Memory-mapped access
     uint8_t read(uint16_t addr);
     void    write(uint16_t addr, uint8_t data);
     void setPortAInput(uint8_t val);
     void setPortBInput(uint8_t val);
+    bool irqLine() const { return ((cra_ | crb_) & CR_IRQ1_FLAG) != 0; }
 
     // --- Register offsets (relative to base address) ---
     static constexpr uint8_t REG_PORTA   = 0x00; // Data register A
@@ -0,0 +1,45 @@
+#pragma once
+
+// Device callback binding: a plain function pointer plus an opaque context
+// pointer. Unlike std::function it never allocates, copies as two words,
+// and bind<&Host::method>() generates a thunk the compiler can inline the
+// host's method into. An unbound port is a null pointer test.
+template <typename Signature>
+class Port;
+
+template <typename R, typename... Args>
+class Port<R(Args...)>
+{
+public:
+    using Thunk = R (*)(void *ctx, Args...);
+
+    Port() = default;
+    Port(Thunk fn, void *ctx) : fn_(fn), ctx_(ctx) {}
+
+    // Bind a member function of a host object
+    template <auto Method, typename T>
+    static Port bind(T *host)
+    {
+        return Port([](void *ctx, Args... args) -> R
+                    { return (static_cast<T *>(ctx)->*Method)(args...); },
+                    host);
+    }
+
+    // Bind a free function that needs no context
+    template <R (*Fn)(Args...)>
+    static Port bind()
+    {
+        return Port([](void *, Args... args) -> R
+                    { return Fn(args...); },
+                    nullptr);
+    }
+
+    explicit operator bool() const { return fn_ != nullptr; }
+    R operator()(Args... args) const { return fn_(ctx_, args...); }
+
+    void *context() const { return ctx_; }
+
+private:
+    Thunk fn_ = nullptr;
+    void *ctx_ = nullptr;
+};
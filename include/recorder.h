@@ -0,0 +1,145 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "framebuffer.h"
+
+// Streaming recording container
+// ------------------------------------------------------------
+// File header (RecordingHeader), then a sequence of chunks, each a
+// ChunkHeader followed by `size` payload bytes. Frames are stored as
+// palette indices, width*height bytes without row padding, either as a
+// keyframe or XOR'd against the previous frame, and always RLE-coded
+// (see rle.h). Audio chunks hold raw native-endian int16 PCM.
+
+#pragma pack(push, 1)
+struct RecordingHeader
+{
+    char magic[8];       // "6502REC1"
+    uint16_t width;
+    uint16_t height;
+    uint8_t paletteId;   // RecordingPalette
+    uint8_t reserved[3];
+    uint32_t audioRate;  // Hz, 0 if there is no audio
+};
+
+struct ChunkHeader
+{
+    uint8_t type;        // ChunkType
+    uint8_t reserved[3];
+    uint32_t size;       // payload bytes
+    uint64_t sequence;   // frame number
+};
+#pragma pack(pop)
+
+enum class ChunkType : uint8_t
+{
+    KeyFrame = 1,
+    DeltaFrame = 2,
+    Audio = 3
+};
+
+enum class RecordingPalette : uint8_t
+{
+    TiaNTSC,
+    TiaPAL,
+    VicNTSC,
+    VicPAL
+};
+
+struct RecorderConfig
+{
+    int encoderThreads = 2;
+    int keyframeInterval = 60;  // frames between keyframes
+    std::size_t queueDepth = 32; // frames in flight before dropping
+    RecordingPalette palette = RecordingPalette::TiaNTSC;
+    uint32_t audioRate = 0;
+    std::size_t audioFrameSamples = 2048; // per slot, allocated up front
+};
+
+// Records completed frames (and the audio generated with them) to disk.
+// submitFrame() runs on the emulation thread and only copies the frame
+// into a free slot; RLE coding happens on a pool of encoder threads and a
+// single writer thread puts chunks on disk in order. If every slot is
+// still busy the frame is dropped (the next one becomes a keyframe)
+// rather than ever blocking the caller. Slots are allocated by open(); a
+// frame with more than audioFrameSamples of audio grows its slot once.
+class Recorder
+{
+public:
+    explicit Recorder(const RecorderConfig &config = RecorderConfig{});
+    ~Recorder();
+
+    Recorder(const Recorder &) = delete;
+    Recorder &operator=(const Recorder &) = delete;
+
+    bool open(const std::string &path, int width, int height);
+    void close(); // drains the pipeline and closes the file
+
+    bool submitFrame(const FrameView &frame, const int16_t *audio = nullptr, std::size_t audioSamples = 0);
+
+    uint64_t framesSubmitted() const { return submitted_; }
+    uint64_t framesDropped() const { return dropped_; }
+    uint64_t bytesWritten() const { return bytesWritten_.load(std::memory_order_relaxed); }
+
+private:
+    enum SlotState : int
+    {
+        Free,
+        Filled,
+        Encoded
+    };
+
+    struct Slot
+    {
+        std::atomic<int> state{Free};
+        uint64_t sequence = 0;
+        bool keyframe = false;
+        std::vector<uint8_t> pixels;  // raw or XOR-delta indices
+        std::vector<int16_t> audio;   // capacity, audioSamples used
+        std::size_t audioSamples = 0;
+        std::vector<uint8_t> encoded; // finished chunks
+    };
+
+    void encoderLoop();
+    void writerLoop();
+    void encode(Slot &slot);
+    bool claim(uint64_t &ticket);
+
+    RecorderConfig config_;
+    std::FILE *file_ = nullptr;
+    int width_ = 0;
+    int height_ = 0;
+
+    std::unique_ptr<Slot[]> slots_;
+    std::vector<uint8_t> previous_; // last submitted frame, for deltas
+    bool forceKeyframe_ = true;
+
+    // Producer-owned counters
+    uint64_t nextSequence_ = 0;
+    uint64_t submitted_ = 0;
+    uint64_t dropped_ = 0;
+
+    // Tickets: slots [claimed_, published_) are waiting for an encoder
+    std::atomic<uint64_t> published_{0};
+    std::atomic<uint64_t> claimed_{0};
+    std::atomic<uint64_t> bytesWritten_{0};
+    std::atomic<bool> stopping_{false};
+
+    // Waiters check their condition under the mutex and notifiers take
+    // it before notifying, so no wakeup is lost between the two
+    std::mutex workMutex_;
+    std::condition_variable workCv_;   // encoders: new frames published
+    std::mutex doneMutex_;
+    std::condition_variable doneCv_;   // writer: a slot finished encoding
+
+    std::vector<std::thread> encoders_;
+    std::thread writer_;
+};
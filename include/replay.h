@@ -0,0 +1,182 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "machine.h"
+
+// Input recordings
+// ------------------------------------------------------------
+// A recording is the machine's starting state plus every change on its
+// input lines, keyed by the CPU instruction count at which it was seen.
+// Replaying it from the same state reproduces the run exactly. It may
+// also carry checkpoints: full machine states taken along the way, with
+// the input line values at that moment, which let segments of a long
+// recording be replayed independently.
+//
+// File layout: magic "6502INP1", then u64 event count and the packed
+// InputEvents, u64 length in instructions, u64 checkpoint count and for
+// each checkpoint: u64 instruction, u64 state hash, the input values,
+// u64 state size and the state bytes.
+
+enum class InputLine : uint8_t
+{
+    RiotPortA, // joysticks
+    RiotPortB, // console switches
+    TiaInput0, // paddle / trigger pins INPT0..INPT5
+    TiaInput1,
+    TiaInput2,
+    TiaInput3,
+    TiaInput4,
+    TiaInput5
+};
+
+constexpr int InputLineCount = 8;
+
+#pragma pack(push, 1)
+struct InputEvent
+{
+    uint64_t instruction; // applied before this instruction executes
+    uint8_t line;         // InputLine
+    uint8_t value;
+};
+#pragma pack(pop)
+
+struct InputValues
+{
+    // Idle levels: port bits are active low; TIA pins hold the level read
+    // into bit 7, and the triggers (INPT4/5) idle high
+    uint8_t lines[InputLineCount] = {0xFF, 0xFF, 0, 0, 0, 0, 1, 1};
+};
+
+struct Checkpoint
+{
+    uint64_t instruction = 0;
+    uint64_t stateHash = 0; // Machine::StateHash of `state`
+    InputValues inputs;
+    std::vector<uint8_t> state;
+};
+
+// Checkpoint of a machine's current state
+template <class MachineT>
+Checkpoint makeCheckpoint(const MachineT &m, const InputValues &inputs)
+{
+    Checkpoint cp;
+    cp.instruction = m.cpu.instructions;
+    cp.inputs = inputs;
+    cp.state = m.SaveState();
+    cp.stateHash = hash64(cp.state.data(), cp.state.size());
+    return cp;
+}
+
+class InputRecording
+{
+public:
+    // Recording side: start from the machine's current state, log input
+    // changes as the frontend sees them, and optionally drop checkpoints
+    template <class MachineT>
+    void begin(const MachineT &m)
+    {
+        start(makeCheckpoint(m, InputValues{}));
+    }
+
+    void record(uint64_t instruction, InputLine line, uint8_t value);
+
+    template <class MachineT>
+    void checkpoint(const MachineT &m)
+    {
+        checkpoints_.push_back(makeCheckpoint(m, current_));
+    }
+
+    template <class MachineT>
+    void finish(const MachineT &m) // final checkpoint and length
+    {
+        length_ = m.cpu.instructions;
+        if (checkpoints_.empty() || checkpoints_.back().instruction != length_)
+            checkpoint(m);
+    }
+
+    bool save(const std::string &path) const;
+    bool load(const std::string &path);
+
+    const std::vector<InputEvent> &events() const { return events_; }
+    const std::vector<Checkpoint> &checkpoints() const { return checkpoints_; }
+    std::vector<Checkpoint> &checkpoints() { return checkpoints_; }
+    uint64_t length() const { return length_; }
+
+private:
+    void start(Checkpoint first);
+
+    std::vector<InputEvent> events_;
+    std::vector<Checkpoint> checkpoints_;
+    InputValues current_;
+    uint64_t length_ = 0;
+};
+
+// Feeds a recording's input events to a machine's devices through their
+// input ports while it is stepped
+class ReplayInput
+{
+public:
+    explicit ReplayInput(const std::vector<InputEvent> &events) : events_(events) {}
+
+    // Bind the machine's input ports to this object (the 2600's are the
+    // only input lines recorded so far)
+    template <class MachineT>
+    void attach(MachineT &m)
+    {
+        if constexpr (MachineT::type == MachineType::Atari2600)
+        {
+            m.mem.riot.setPortA(RIOT6532::ReadPort::bind<&ReplayInput::readPortA>(this), {});
+            m.mem.riot.setPortB(RIOT6532::ReadPort::bind<&ReplayInput::readPortB>(this), {});
+            m.mem.tia.setInputReader(TIA::InputReader::bind<&ReplayInput::readTiaInput>(this));
+        }
+    }
+
+    // Start at a checkpoint: its line values, next event after it
+    void seek(uint64_t instruction, const InputValues &values);
+
+    // Apply every event due at or before this instruction
+    void advance(uint64_t instruction)
+    {
+        while (next_ < events_.size() && events_[next_].instruction <= instruction)
+        {
+            const InputEvent &e = events_[next_++];
+            if (e.line < InputLineCount)
+                values_.lines[e.line] = e.value;
+        }
+    }
+
+    const InputValues &values() const { return values_; }
+
+private:
+    uint8_t readPortA() { return values_.lines[static_cast<int>(InputLine::RiotPortA)]; }
+    uint8_t readPortB() { return values_.lines[static_cast<int>(InputLine::RiotPortB)]; }
+    bool readTiaInput(int pin);
+
+    const std::vector<InputEvent> &events_;
+    std::size_t next_ = 0;
+    InputValues values_;
+};
+
+struct SegmentResult
+{
+    uint64_t start;    // instruction of the checkpoint it starts from
+    uint64_t end;      // and of the one it must reach
+    uint64_t expected; // state hash recorded at the end checkpoint
+    uint64_t actual;   // state hash the replay arrived at
+    bool ok;
+};
+
+// Replays `rec` from its first checkpoint to its length on one thread,
+// adding a checkpoint every `interval` instructions (replacing any the
+// recording already had). `prototype` supplies the profile and
+// configuration.
+template <class MachineT>
+void captureCheckpoints(const MachineT &prototype, InputRecording &rec, uint64_t interval);
+
+// Re-executes every segment between consecutive checkpoints on its own
+// core and checks it ends in the next checkpoint's state hash. Results
+// are in segment order.
+template <class MachineT>
+std::vector<SegmentResult> verifyReplay(const MachineT &prototype, const InputRecording &rec, unsigned threads = 0);
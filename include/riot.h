@@ -1,31 +1,39 @@
 #pragma once
 #include <cstdint>
 #include <array>
-#include <functional>
+#include "port.h"
+
+class StateArchive;
 
 class RIOT6532 {
 public:
-    using ReadPort = std::function<uint8_t()>;
-    using WritePort = std::function<void(uint8_t)>;
+    using ReadPort = Port<uint8_t()>;
+    using WritePort = Port<void(uint8_t)>;
 
     RIOT6532();
 
     void reset();
+    void serialize(StateArchive& ar);
 
-    // Memory-mapped access
+    // Memory-mapped access; A9 selects I/O + timer (set) or RAM (clear)
     uint8_t read(uint16_t addr);
     void    write(uint16_t addr, uint8_t data);
 
     // Advance timer by 1 CPU cycle
     void tick();
 
+    bool irqLine() const { return timerIRQ_; }
+
+    static constexpr int RamSize = 128;
+    const uint8_t* ram() const { return ram_.data(); }
+
     // Hook up external I/O
     void setPortA(ReadPort in, WritePort out);
     void setPortB(ReadPort in, WritePort out);
 
 private:
     // Internal RAM (128 bytes)
-    std::array<uint8_t, 128> ram_{};
+    std::array<uint8_t, RamSize> ram_{};
 
     // I/O ports
     uint8_t ora_ = 0; // Output register A
@@ -41,10 +49,11 @@ private:
     // Timer
     uint16_t timer_ = 0;
     uint8_t  timerShift_ = 0; // prescaler shift: 0=1, 3=8, 6=64, 10=1024
+    uint16_t prescale_ = 0;   // cycles since the last timer decrement
     bool     timerRunning_ = false;
     bool     timerIRQ_ = false;
 
     // Helper: read/write ports with DDR masking
-    uint8_t portRead(uint8_t out, uint8_t ddr, ReadPort in);
-    void    portWrite(uint8_t& out, uint8_t ddr, WritePort outFn, uint8_t data);
+    uint8_t portRead(uint8_t out, uint8_t ddr, const ReadPort& in) const;
+    void    portWrite(uint8_t& out, uint8_t ddr, const WritePort& outFn, uint8_t data);
 };
\ No newline at end of file
@@ -0,0 +1,19 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Byte-oriented run-length codec, fast enough to run per frame and tuned
+// for XOR-delta frames, which are mostly long runs of zero.
+//
+// Stream format, one control byte per token:
+//   0x00..0x7F  literal: the next (c + 1) bytes are copied as-is
+//   0x80..0xFF  run: the next byte repeated (c - 0x80 + 3) times
+
+// Worst-case encoded size for n input bytes
+inline std::size_t rleBound(std::size_t n) { return n + n / 128 + 1; }
+
+// Encode n bytes into dst (at least rleBound(n) bytes); returns the size
+std::size_t rleEncode(const uint8_t *src, std::size_t n, uint8_t *dst);
+
+// Decode into exactly outSize bytes; false if the stream is malformed
+bool rleDecode(const uint8_t *src, std::size_t n, uint8_t *dst, std::size_t outSize);
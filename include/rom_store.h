@@ -0,0 +1,36 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include "image.h"
+
+// Process-wide store of immutable pages and images, shared by content
+// (images mapped from a file, by the file). Interning returns the one
+// copy the store holds, so every machine that loads the same ROM (or
+// program, or saved state) points its page table at the same physical
+// pages, whether or not it was forked from the others. The store keeps a reference to everything
+// it hands out, which is what keeps an interned page shared and so
+// copy-on-write; entries nothing else references any more are pruned as
+// the store grows.
+
+// 256 bytes (Memory::PAGE_SIZE) in, the shared page with that content out
+std::shared_ptr<uint8_t> internPage(const uint8_t *bytes);
+
+// The first image interned from the same unchanged file (FileId) or,
+// for images not mapped from a file, with the same bytes; else this one.
+// A mapped image costs the same whatever its size: none of it is read.
+// The one returned may have another path, so detect the format from the
+// image passed in.
+RomImage internImage(RomImage image);
+
+struct RomStoreStats
+{
+    std::size_t pages;
+    std::size_t images;
+    std::size_t bytes; // held by the store itself, images' mapped bytes excluded
+};
+
+RomStoreStats romStoreStats();
+
+// Drop entries nothing outside the store references
+void pruneRomStore();
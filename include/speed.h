@@ -12,6 +12,9 @@ constexpr double CPU_FREQ_ATARI_2600 = 1193191.0; // Atari 2600 ~1.19 MHz
 constexpr double CPU_FREQ_NES        = 1789773.0; // NTSC NES ~1.789 MHz
 constexpr double CPU_FREQ_ATARI_8BIT = 1773447.0; // NTSC Atari 8-bit ~1.773 MHz
 constexpr double CPU_FREQ_VIC20      = 1108404.0; // PAL VIC-20 ~1.108 MHz
+constexpr double CPU_FREQ_PET        = 1000000.0; // Commodore PET 1 MHz
+constexpr double CPU_FREQ_PLUS4      = 886724.0;  // PAL Plus/4 ~0.887 MHz (single clock)
+constexpr double CPU_FREQ_GENERIC    = 2000000.0; // bare 6502, at the old default 2 MHz
 
 #pragma once
 
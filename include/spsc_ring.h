@@ -0,0 +1,125 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+// Lock-free single-producer / single-consumer ring buffer. The producer
+// only advances head_, the consumer only advances tail_, so neither side
+// ever waits on the other. Bulk read/write copy whole spans at a time.
+// A producer that wants to be paced by the consumer can opt in to
+// waitForSpace(); the consumer then wakes it from read().
+template <typename T>
+class SpscRing
+{
+public:
+    explicit SpscRing(std::size_t capacity)
+    {
+        std::size_t cap = 1;
+        while (cap < capacity)
+            cap <<= 1;
+        buf_.resize(cap);
+        mask_ = cap - 1;
+    }
+
+    SpscRing(const SpscRing &) = delete;
+    SpscRing &operator=(const SpscRing &) = delete;
+
+    std::size_t capacity() const { return buf_.size(); }
+
+    // Items available to the consumer
+    std::size_t size() const
+    {
+        return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire);
+    }
+    std::size_t space() const { return capacity() - size(); }
+
+    // Producer: copy up to n items in, returns how many fit
+    std::size_t write(const T *src, std::size_t n)
+    {
+        std::size_t head = head_.load(std::memory_order_relaxed);
+        std::size_t tail = tail_.load(std::memory_order_acquire);
+        n = std::min(n, capacity() - (head - tail));
+        copyIn(head, src, n);
+        head_.store(head + n, std::memory_order_release);
+        return n;
+    }
+
+    // Consumer: copy up to n items out, returns how many were available
+    std::size_t read(T *dst, std::size_t n)
+    {
+        std::size_t tail = tail_.load(std::memory_order_relaxed);
+        std::size_t head = head_.load(std::memory_order_acquire);
+        n = std::min(n, head - tail);
+        copyOut(tail, dst, n);
+        tail_.store(tail + n, std::memory_order_release);
+
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (n > 0 && waiting_.load(std::memory_order_relaxed))
+        {
+            std::lock_guard<std::mutex> lock(waitMutex_);
+            waitCv_.notify_one();
+        }
+        return n;
+    }
+
+    // Consumer: take exactly n items or nothing, for callers that work in
+    // fixed-size buffers (e.g. an audio device period)
+    bool readBlock(T *dst, std::size_t n)
+    {
+        if (size() < n)
+            return false;
+        read(dst, n);
+        return true;
+    }
+
+    // Producer: block until at least n slots are free or the timeout
+    // passes. Returns whether the space is available.
+    template <typename Rep, typename Period>
+    bool waitForSpace(std::size_t n, std::chrono::duration<Rep, Period> timeout)
+    {
+        if (space() >= n)
+            return true;
+        std::unique_lock<std::mutex> lock(waitMutex_);
+        waiting_.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        bool ok = waitCv_.wait_for(lock, timeout, [&] { return space() >= n; });
+        waiting_.store(false, std::memory_order_relaxed);
+        return ok;
+    }
+
+    // Consumer: drop everything currently queued
+    void clear() { tail_.store(head_.load(std::memory_order_acquire), std::memory_order_release); }
+
+private:
+    void copyIn(std::size_t pos, const T *src, std::size_t n)
+    {
+        std::size_t start = pos & mask_;
+        std::size_t first = std::min(n, capacity() - start);
+        std::copy(src, src + first, buf_.begin() + start);
+        std::copy(src + first, src + n, buf_.begin());
+    }
+
+    void copyOut(std::size_t pos, T *dst, std::size_t n) const
+    {
+        std::size_t start = pos & mask_;
+        std::size_t first = std::min(n, capacity() - start);
+        std::copy(buf_.begin() + start, buf_.begin() + start + first, dst);
+        std::copy(buf_.begin(), buf_.begin() + (n - first), dst + first);
+    }
+
+    std::vector<T> buf_;
+    std::size_t mask_ = 0;
+
+    // Kept on separate cache lines so producer and consumer don't contend
+    alignas(64) std::atomic<std::size_t> head_{0};
+    alignas(64) std::atomic<std::size_t> tail_{0};
+
+    // Only touched when the producer asks to wait
+    std::atomic<bool> waiting_{false};
+    std::mutex waitMutex_;
+    std::condition_variable waitCv_;
+};
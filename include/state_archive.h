@@ -0,0 +1,92 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+// Flat binary machine state. Every component has one serialize(ar) that
+// lists its state with ar.io(member); the same list saves or restores
+// depending on the archive's direction. Host bindings (ports, output
+// rings, device pointers into RAM) are never part of the state.
+class StateArchive
+{
+public:
+    // Saving into an internal buffer
+    StateArchive() = default;
+
+    // Loading from existing bytes (not copied, must outlive the archive)
+    StateArchive(const uint8_t *bytes, std::size_t size) : loading_(true), in_(bytes), inSize_(size) {}
+
+    bool loading() const { return loading_; }
+    bool saving() const { return !loading_; }
+
+    // False once a load has run past the end of its input, or been failed
+    bool ok() const { return ok_; }
+    void fail() { ok_ = false; }
+
+    const std::vector<uint8_t> &data() const { return out_; }
+
+    // Leave the RAM page array out, for a state whose RAM is kept
+    // elsewhere (see SuspendFile); saving and loading must agree
+    void excludeRam() { ram_ = false; }
+    bool ram() const { return ram_; }
+
+    // Leave frame pixels out too, for hashing device state; such a state
+    // is never loaded
+    void excludeFrames() { frames_ = false; }
+    bool frames() const { return frames_; }
+
+    void bytes(void *p, std::size_t n)
+    {
+        if (!loading_)
+        {
+            const uint8_t *src = static_cast<const uint8_t *>(p);
+            out_.insert(out_.end(), src, src + n);
+        }
+        else if (ok_ && inSize_ - inPos_ >= n)
+        {
+            std::memcpy(p, in_ + inPos_, n);
+            inPos_ += n;
+        }
+        else
+        {
+            ok_ = false;
+        }
+    }
+
+    template <typename T>
+    void io(T &value)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "serialize members individually");
+        bytes(&value, sizeof(value));
+    }
+
+    template <typename T, typename Alloc>
+    void io(std::vector<T, Alloc> &v)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "serialize elements individually");
+        uint64_t n = v.size();
+        io(n);
+        if (loading_)
+        {
+            if (!ok_ || n > (inSize_ - inPos_) / (sizeof(T) ? sizeof(T) : 1))
+            {
+                ok_ = false;
+                return;
+            }
+            v.resize(static_cast<std::size_t>(n));
+        }
+        bytes(v.data(), static_cast<std::size_t>(n) * sizeof(T));
+    }
+
+private:
+    bool loading_ = false;
+    bool ok_ = true;
+    bool ram_ = true;
+    bool frames_ = true;
+    std::vector<uint8_t> out_;
+    const uint8_t *in_ = nullptr;
+    std::size_t inSize_ = 0;
+    std::size_t inPos_ = 0;
+};
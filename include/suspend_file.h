@@ -0,0 +1,95 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "machine.h"
+
+// Machine state kept in a file mapped read-write, for suspending a
+// machine and resuming it in a later process without replaying its boot.
+//
+// The file holds a header and two slots. A slot is the 64 KiB RAM page
+// array laid out flat, followed by the CPU and device state in archive
+// form without RAM (Machine::SaveState(false)), which is a few KiB.
+// Suspend writes the slot the last suspend did not use: only pages that
+// changed since that slot was written are stored, so only they dirty the
+// mapping. Once the slot is synced the header is pointed at it and
+// synced in turn, so a power cut at any moment leaves the previous
+// suspend intact. Resume maps the file and loads the newest slot's pages
+// through the page store (rom_store.h), then the device state; its cost
+// does not depend on how long the guest took to get there.
+//
+// Images (cartridges, mapped ROMs, disks) are configuration, not state:
+// insert the same ones before resuming.
+class SuspendFile
+{
+public:
+    static constexpr std::size_t DefaultDeviceCapacity = 1 << 20;
+
+    SuspendFile() = default;
+    ~SuspendFile() { close(); }
+    SuspendFile(const SuspendFile &) = delete;
+    SuspendFile &operator=(const SuspendFile &) = delete;
+
+    // Maps the file, creating it if needed. A new or empty file, or a
+    // suspend file of another layout, is initialized with room for
+    // deviceCapacity bytes of device state per slot; a valid one keeps
+    // its own. Fails, touching nothing, on any other non-empty file.
+    bool open(const std::string &path, std::size_t deviceCapacity = DefaultDeviceCapacity);
+    void close();
+    bool isOpen() const { return base_ != nullptr; }
+
+    // Profile of the newest completed suspend; false if there is none
+    bool savedType(MachineType &type) const;
+
+    // False if the file is not open or the device state does not fit
+    template <class MachineT>
+    bool suspend(const MachineT &m)
+    {
+        if (!base_)
+            return false;
+        std::vector<uint8_t> devices = m.SaveState(false);
+        if (devices.size() > deviceCapacity_)
+            return false;
+        int slot = nextSlot();
+        uint8_t *ram = slotRam(slot);
+        for (uint32_t page = 0; page < Memory::PAGE_COUNT; ++page)
+        {
+            const uint8_t *src = m.mem.RamPage(static_cast<uint8_t>(page));
+            uint8_t *dst = ram + page * Memory::PAGE_SIZE;
+            if (std::memcmp(dst, src, Memory::PAGE_SIZE) != 0)
+                std::memcpy(dst, src, Memory::PAGE_SIZE);
+        }
+        std::memcpy(slotDevices(slot), devices.data(), devices.size());
+        return commit(slot, MachineT::type, devices.size());
+    }
+
+    // False if the file holds no suspend of this profile (the machine is
+    // left untouched) or its device state does not load
+    template <class MachineT>
+    bool resume(MachineT &m)
+    {
+        std::size_t deviceBytes = 0;
+        int slot = lastSlot(MachineT::type, deviceBytes);
+        if (slot < 0)
+            return false;
+        // RAM first, as a load would, so devices see it when restored
+        m.mem.Memory::Load(0, slotRam(slot), Memory::MAX_MEM);
+        return m.LoadState(slotDevices(slot), deviceBytes, false);
+    }
+
+private:
+    int nextSlot() const;
+    int lastSlot(MachineType type, std::size_t &deviceBytes) const; // -1 if none
+    uint8_t *slotRam(int slot) const;
+    uint8_t *slotDevices(int slot) const { return slotRam(slot) + Memory::MAX_MEM; }
+    bool commit(int slot, MachineType type, std::size_t deviceBytes);
+    bool sync();
+
+    uint8_t *base_ = nullptr;
+    std::size_t size_ = 0;
+    std::size_t deviceCapacity_ = 0;
+    std::size_t slotBytes_ = 0;
+    void *file_ = nullptr; // kept open on Windows to flush it
+};
@@ -0,0 +1,124 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include "port.h"
+
+// Fixed set of worker threads for data-parallel loops over independent
+// machines. parallelFor hands out indices one at a time, so segments of
+// uneven length still balance across cores; the calling thread works too.
+class ThreadPool
+{
+public:
+    explicit ThreadPool(unsigned threads = 0)
+    {
+        if (threads == 0)
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        // The caller is one of the workers
+        for (unsigned i = 1; i < threads; ++i)
+            workers_.emplace_back(&ThreadPool::workerLoop, this);
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        wake_.notify_all();
+        for (auto &t : workers_)
+            t.join();
+    }
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    unsigned size() const { return static_cast<unsigned>(workers_.size()) + 1; }
+
+    // Call fn(i) for every i in [0, count); returns once all calls are done
+    template <typename F>
+    void parallelFor(std::size_t count, F &&fn)
+    {
+        using Fn = std::remove_reference_t<F>;
+        Port<void(std::size_t)> body([](void *ctx, std::size_t i)
+                                     { (*static_cast<Fn *>(ctx))(i); },
+                                     &fn);
+
+        std::lock_guard<std::mutex> serial(runMutex_);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            body_ = body;
+            count_ = count;
+            next_.store(0);
+            done_.store(0);
+            generation_++;
+        }
+        wake_.notify_all();
+
+        work();
+
+        // Workers may still be leaving work(); none may be inside it when
+        // the next loop is set up
+        std::unique_lock<std::mutex> lock(mutex_);
+        finished_.wait(lock, [&] { return done_.load() == count_ && active_ == 0; });
+        body_ = {};
+    }
+
+private:
+    // Take indices until none are left
+    void work()
+    {
+        std::size_t i;
+        while ((i = next_.fetch_add(1)) < count_)
+        {
+            body_(i);
+            if (done_.fetch_add(1) + 1 == count_)
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                finished_.notify_all();
+            }
+        }
+    }
+
+    void workerLoop()
+    {
+        uint64_t seen = 0;
+        for (;;)
+        {
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                wake_.wait(lock, [&] { return stopping_ || generation_ != seen; });
+                if (stopping_)
+                    return;
+                seen = generation_;
+                active_++;
+            }
+            work();
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (--active_ == 0)
+                finished_.notify_all();
+        }
+    }
+
+    std::vector<std::thread> workers_;
+    std::mutex runMutex_; // one parallelFor at a time
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable finished_;
+    bool stopping_ = false;
+    uint64_t generation_ = 0;
+    unsigned active_ = 0; // workers inside work()
+
+    Port<void(std::size_t)> body_;
+    std::size_t count_ = 0;
+    std::atomic<std::size_t> next_{0};
+    std::atomic<std::size_t> done_{0};
+};
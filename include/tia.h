@@ -1,13 +1,23 @@
 #pragma once
+#include <cstddef>
 #include <cstdint>
-#include <functional>
-#include <vector>
+#include "framebuffer.h"
+#include "palette.h"
+#include "port.h"
+#include "tia_audio.h"
 
+// Output format for convertFrame(); values match PixelFormat
 enum class TIAColorSpace : uint8_t
 {
-    Index
+    Index,
+    RGBA8888,
+    BGRA8888,
+    RGB565,
+    Luma8
 };
 
+class StateArchive;
+
 class TIA
 {
 public:
@@ -17,14 +27,14 @@ public:
     static constexpr int CpuCyclesPerScanline = 76; // 3 color clocks per CPU cycle
 
     // Callbacks
-    using InputReader = std::function<bool(int line)>;     // INPT0..INPT5 -> returns "pressed" (true -> bit7=1)
-    using AudioSink = std::function<void(int16_t sample)>; // optional
-    using WsyncStall = std::function<void(int cpuCycles)>; // burn CPU cycles to end of scanline
+    using InputReader = Port<bool(int line)>;     // INPT0..INPT5 -> returns "pressed" (true -> bit7=1)
+    using WsyncStall = Port<void(int cpuCycles)>; // burn CPU cycles to end of scanline
 
     explicit TIA(TIAColorSpace cs = TIAColorSpace::Index);
 
     // Lifecycle
     void reset(bool ntsc = true);
+    void serialize(StateArchive &ar);
 
     // Memory-mapped IO (TIA mirrored every 64 bytes; pass system address, we’ll mask)
     void write(uint16_t addr, uint8_t data);
@@ -35,7 +45,14 @@ public:
 
     // Pixel access
     uint8_t currentPixel() const; // color index at current beam pos
-    const std::vector<std::vector<uint8_t>> &frame() const { return framebuffer_; }
+    FrameView frame() const { return framebuffer_.front(); } // last completed frame
+    uint64_t frameSequence() const { return framebuffer_.sequence(); }
+
+    // Convert the last completed frame into a caller-provided buffer using
+    // the NTSC or PAL palette and the colour space chosen at construction
+    void convertFrame(void *dst, std::size_t dstStride) const;
+    const Palette &palette() const { return ntsc_ ? Palette::tiaNTSC() : Palette::tiaPAL(); }
+    TIAColorSpace colorSpace() const { return colorSpace_; }
 
     // Introspection
     int scanline() const { return line_; }
@@ -43,9 +60,14 @@ public:
     bool inVBlank() const { return vblank_; }
 
     // Hooks
-    void setInputReader(InputReader f) { inputReader_ = std::move(f); }
-    void setAudioSink(AudioSink f) { audioSink_ = std::move(f); }
-    void setWsyncStall(WsyncStall f) { wsyncStall_ = std::move(f); }
+    void setInputReader(InputReader f) { inputReader_ = f; }
+    void setWsyncStall(WsyncStall f) { wsyncStall_ = f; }
+
+    // Audio is synthesized once per frame and pushed to the ring at the
+    // host sample rate; a consumer thread drains it in whole buffers
+    void setAudioOutput(AudioRing *ring, int hostRate) { audio_.setOutput(ring, hostRate); }
+    TIAAudio &audio() { return audio_; }
+    const TIAAudio &audio() const { return audio_; }
 
 private:
     // TIA register indices (masked to 0x00..0x3F)
@@ -122,30 +144,35 @@ private:
     void renderDot();
     void incrementBeam();
     void hmoveLatchAndApply(); // placeholder for future HMOVE details
+    void endFrame();
     uint8_t tiaReadReg(uint8_t reg);
     void tiaWriteReg(uint8_t reg, uint8_t v);
 
+    TIAColorSpace colorSpace_ = TIAColorSpace::Index;
+
     // Timing
     bool ntsc_ = true;
-    int line_ = 0; // 0..261
+    int line_ = 0; // 0..261, or on to 523 while a VSYNC-driven frame runs long
     int dot_ = 0;  // 0..227
     int frame_ = 0;
 
-    // Visible buffer of color indices (one per color clock)
-    std::vector<std::vector<uint8_t>> framebuffer_;
+    // Color indices (one per color clock), swapped to the front at frame end
+    FrameBuffer framebuffer_{ColorClocksPerScanline, ScanlinesPerFrame};
 
     // Callbacks
     InputReader inputReader_{};
-    AudioSink audioSink_{};
     WsyncStall wsyncStall_{};
 
+    TIAAudio audio_;
+
     // Minimal video state implemented so far
     bool vsync_ = false;
+    bool vsyncDriven_ = false; // the last frame ended on VSYNC
     bool vblank_ = false;
 
-    // Colors (7-bit)
+    // Colors (7-bit palette index: hue << 3 | luminance)
     uint8_t colubk_ = 0x00; // background
-    uint8_t colupf_ = 0x0E; // playfield
+    uint8_t colupf_ = 0x07; // playfield
 
     // Playfield registers
     uint8_t pf0_ = 0;
@@ -163,6 +190,8 @@ private:
         uint8_t size = 1;        // 1, 2, or 4 copies (NUSIZ)
         uint8_t copySpacing = 0; // spacing between copies in pixels
         int motion = 0;          // HMOVE offset (-8..+7)
+
+        void serialize(StateArchive &ar);
     };
 
     Object player0_, player1_;
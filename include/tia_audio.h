@@ -0,0 +1,88 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "spsc_ring.h"
+
+class StateArchive;
+
+using AudioRing = SpscRing<int16_t>;
+
+// TIA sound generator. Register writes are logged with the audio tick
+// they happened on; at the end of each block (normally one frame) the
+// two channels are synthesized in one pass from precomputed polynomial
+// tables, resampled to the host rate and pushed to an AudioRing.
+class TIAAudio
+{
+public:
+    static constexpr int TicksPerScanline = 2; // audio clock = colour clock / 114
+    static constexpr double NativeRateNTSC = 3579545.0 / 114.0;
+    static constexpr double NativeRatePAL = 3546894.0 / 114.0;
+
+    TIAAudio();
+
+    void reset(bool ntsc = true);
+
+    // Channel state, pending register writes and resampler phase
+    void serialize(StateArchive &ar);
+
+    // Direct output into a ring at the host sample rate (nullptr to mute)
+    void setOutput(AudioRing *ring, int hostRate);
+
+    // Fine adjustment of the resampling ratio (>1 produces more samples),
+    // used by pacing to absorb drift between emulated and host clocks
+    void setRateAdjust(double ratio) { rateAdjust_ = ratio; }
+    double rateAdjust() const { return rateAdjust_; }
+
+    // reg: 0 = AUDC0, 1 = AUDC1, 2 = AUDF0, 3 = AUDF1, 4 = AUDV0, 5 = AUDV1
+    // tickOffset: 0 or 1 for a write in the first or second half of a line
+    void write(uint8_t reg, uint8_t value, int tickOffset);
+
+    void advance(int ticks) { blockTicks_ += ticks; }
+
+    // Synthesize and emit everything since the previous block
+    void endBlock();
+
+    // Samples of the last block at the native rate
+    const std::vector<int16_t> &lastBlock() const { return native_; }
+
+    uint64_t droppedSamples() const { return dropped_; }
+
+private:
+    struct Channel
+    {
+        uint8_t audc = 0; // waveform select (4 bits)
+        uint8_t audf = 0; // frequency divider (5 bits)
+        uint8_t audv = 0; // volume (4 bits)
+        uint8_t divCounter = 0;
+        uint8_t div3 = 0;
+        uint16_t p4 = 0, p5 = 0, p9 = 0; // positions in the poly tables
+        uint8_t out = 0;
+    };
+
+    struct RegWrite
+    {
+        int tick;
+        uint8_t reg;
+        uint8_t value;
+    };
+
+    void apply(const RegWrite &w);
+    void clockChannel(Channel &c);
+    void resampleToOutput();
+
+    Channel ch_[2];
+    std::vector<RegWrite> log_;
+    int blockTicks_ = 0;
+    double nativeRate_ = NativeRateNTSC;
+
+    // Output
+    AudioRing *ring_ = nullptr;
+    int hostRate_ = 0;
+    double rateAdjust_ = 1.0;
+    double phase_ = 0.0;  // resampler position within the native block
+    int16_t prev_ = 0;    // last native sample of the previous block
+    std::vector<int16_t> native_;
+    std::vector<int16_t> host_;
+    uint64_t dropped_ = 0;
+};
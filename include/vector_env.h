@@ -0,0 +1,142 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "arena.h"
+#include "machine.h"
+#include "palette.h"
+#include "thread_pool.h"
+
+// Batched 2600 environment for reinforcement learning
+// ------------------------------------------------------------
+// N independent machines stepped together on a thread pool. One step()
+// applies an action to every machine, advances each by one frame (or
+// frameSkip, if set) and writes the results straight into caller-owned arrays: observations as
+// one contiguous [N][height][width][channels] uint8 block, then rewards
+// and done flags. Episodes that end are restarted from the boot state by
+// a copy-on-write fork.
+
+// Actions are joystick bitmasks
+enum EnvAction : uint8_t
+{
+    ActionNone = 0,
+    ActionUp = 1 << 0,
+    ActionDown = 1 << 1,
+    ActionLeft = 1 << 2,
+    ActionRight = 1 << 3,
+    ActionFire = 1 << 4
+};
+
+enum class ObservationFormat : uint8_t
+{
+    Gray, // 1 byte per pixel, Rec.601 luma
+    RGB   // 3 bytes per pixel
+};
+
+// Score held in RAM, e.g. the BCD digits of a game's score counter.
+// Rewards are the change in the sum of all sources over a step.
+struct RewardSource
+{
+    uint16_t addr;      // first (most significant) byte
+    uint8_t bytes = 1;
+    bool bcd = true;
+    int scale = 1;      // negate for penalties (lives lost, ...)
+};
+
+// An episode ends when (RAM[addr] & mask) == value
+struct DoneCondition
+{
+    uint16_t addr;
+    uint8_t mask = 0xFF;
+    uint8_t value = 0;
+};
+
+struct EnvConfig
+{
+    std::vector<uint8_t> rom;   // cartridge image
+    CartScheme scheme = CartScheme::Auto;
+    int instances = 1;
+    unsigned threads = 0;       // 0: one per core
+    int frameSkip = 1;          // frames per step, the action held throughout
+    int bootFrames = 60;        // frames run once before the boot snapshot
+    uint64_t maxEpisodeFrames = 108000;
+
+    // Observation window in colour clocks / scanlines, then a box filter
+    // of `downsample` x `downsample` source pixels per output pixel
+    ObservationFormat format = ObservationFormat::Gray;
+    int left = 68, top = 40, width = 160, height = 192;
+    int downsample = 2;
+
+    std::vector<RewardSource> rewards;
+    std::vector<DoneCondition> dones;
+};
+
+class VectorEnv
+{
+public:
+    using EnvMachine = Machine<MachineType::Atari2600>;
+
+    explicit VectorEnv(const EnvConfig &config);
+
+    int instances() const { return config_.instances; }
+    int observationWidth() const { return obsWidth_; }
+    int observationHeight() const { return obsHeight_; }
+    int observationChannels() const { return config_.format == ObservationFormat::RGB ? 3 : 1; }
+    std::size_t observationBytes() const
+    {
+        return static_cast<std::size_t>(obsWidth_) * obsHeight_ * observationChannels();
+    }
+
+    // Restart every instance from the boot state and write the initial
+    // observations (instances() * observationBytes() bytes)
+    void reset(uint8_t *observations);
+
+    // actions[instances()] in; observations, rewards and dones out, all
+    // caller-owned. An instance that reports done has already been reset:
+    // its observation is the first of the new episode.
+    void step(const uint8_t *actions, uint8_t *observations, float *rewards, uint8_t *dones);
+
+    // Direct access, e.g. to fork interesting states
+    EnvMachine &machine(int i) { return envs_[i]->machine; }
+
+private:
+    // Input lines of one instance, read by its RIOT and TIA through ports
+    struct Joystick
+    {
+        uint8_t swcha = 0xFF; // P0 in the high nibble, active low
+        bool fire = false;
+
+        void set(uint8_t action);
+        uint8_t readPortA() { return swcha; }
+        uint8_t readPortB() { return 0x0B; } // colour, difficulty B, reset/select released
+        bool readInput(int pin) { return pin == 4 ? !fire : true; }
+    };
+
+    struct Instance
+    {
+        EnvMachine machine;
+        Joystick joystick;
+        int64_t score = 0;
+        uint64_t frames = 0;
+    };
+
+    void attach(Instance &env);
+    void restart(Instance &env);
+    bool runFrame(EnvMachine &m) const;
+    int64_t score(const EnvMachine &m) const;
+    bool finished(const Instance &env) const;
+    void observe(const EnvMachine &m, uint8_t *dst) const;
+
+    EnvConfig config_;
+    int obsWidth_ = 0;
+    int obsHeight_ = 0;
+    const Palette *palette_ = nullptr;
+    uint8_t luma_[256];
+
+    EnvMachine boot_;
+    // Each in a pooled block of its own, so instances don't share cache
+    // lines across threads; fixed addresses, since ports point at them
+    std::vector<MachinePool<Instance>::Handle> envs_;
+    ThreadPool pool_;
+};
@@ -1,6 +1,8 @@
 #pragma once
 #include <cstdint>
 
+class StateArchive;
+
 class VIA6522 {
 public:
     VIA6522();
@@ -12,6 +14,8 @@ public:
     // Advance timers/shift register by one CPU cycle
     void Tick();
 
+    void Serialize(StateArchive& ar);
+
     // IRQ output line (true = active)
     bool irq_line = false;
 
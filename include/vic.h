@@ -1,9 +1,14 @@
 #pragma once
+#include <cstddef>
 #include <cstdint>
-#include <vector>
-#include <functional>
+#include "framebuffer.h"
+#include "palette.h"
+#include "port.h"
 
-enum class VICColorSpace : uint8_t { Index };
+// Output format for convertFrame(); values match PixelFormat
+enum class VICColorSpace : uint8_t { Index, RGBA8888, BGRA8888, RGB565, Luma8 };
+
+class StateArchive;
 
 class VIC {
 public:
@@ -11,25 +16,43 @@ public:
     static constexpr int ScreenWidth  = 176;
     static constexpr int ScreenHeight = 184;
 
-    using ReadMem = std::function<uint8_t(uint16_t)>;
+    using ReadMem = Port<uint8_t(uint16_t)>;
 
     explicit VIC(VICColorSpace cs = VICColorSpace::Index);
 
     void reset(bool pal = true);
+    void serialize(StateArchive &ar);
 
     void write(uint16_t addr, uint8_t data);
-    uint8_t read(uint16_t addr);
+    uint8_t read(uint16_t addr) const;
 
     void tick(); // advance one pixel
 
-    const std::vector<std::vector<uint8_t>>& frame() const { return framebuffer_; }
+    FrameView frame() const { return framebuffer_.front(); } // last completed frame
+    uint64_t frameSequence() const { return framebuffer_.sequence(); }
+
+    // Convert the last completed frame into a caller-provided buffer
+    void convertFrame(void* dst, std::size_t dstStride) const;
+    const Palette& palette() const { return pal_ ? Palette::vicPAL() : Palette::vicNTSC(); }
+    VICColorSpace colorSpace() const { return colorSpace_; }
+
+    void setMemoryReader(ReadMem f) { memRead_ = f; }
 
-    void setMemoryReader(ReadMem f) { memRead_ = std::move(f); }
+    // Direct view of the bus's 256-byte page table (RAM and character
+    // ROM). When set, fetches bypass the reader callback and unchanged
+    // lines are skipped.
+    void setMemory(const uint8_t* const* pages) { mem_ = pages; }
+
+    // The bus reports every RAM write so the VIC knows which lines to redraw
+    void noteWrite(uint16_t addr) { blockStamp_[addr >> 10] = stamp_; }
 
 private:
-    void renderPixel();
+    void renderLine();
+    bool lineUnchanged(int y, uint16_t screenAddr) const;
+    uint8_t fetch(uint16_t addr) const { return mem_ ? mem_[addr >> 8][addr & 0xFF] : memRead_(addr); }
     void nextRaster();
 
+    VICColorSpace colorSpace_ = VICColorSpace::Index;
     bool pal_ = true;
     int rasterX_ = 0;
     int rasterY_ = 0;
@@ -44,15 +67,27 @@ private:
     uint16_t screenMemBase_ = 0x1E00;
     uint16_t charMemBase_   = 0x1000;
 
-    // Framebuffer
-    std::vector<std::vector<uint8_t>> framebuffer_;
+    // Framebuffer, swapped to the front at the end of each frame
+    FrameBuffer framebuffer_{ScreenWidth, ScreenHeight};
 
     // Memory access
     ReadMem memRead_{};
+    const uint8_t* const* mem_ = nullptr;
+
+    // Change tracking: stamp_ advances once per drawn line; a line can be
+    // reused from the front buffer if nothing it depends on was written
+    // since it was last drawn.
+    uint32_t stamp_ = 1;
+    uint32_t regStamp_ = 0;                 // last register write
+    uint32_t blockStamp_[64] = {};          // last RAM write per 1 KiB block
+    uint32_t lineStamp_[ScreenHeight] = {}; // when each line was last drawn
 
     // Border size (simplified)
     static constexpr int BorderLeft   = 16;
     static constexpr int BorderRight  = 16;
     static constexpr int BorderTop    = 16;
     static constexpr int BorderBottom = 16;
+
+    static constexpr int TextColumns = 22; // screen memory row pitch
+    static constexpr uint8_t ForegroundColor = 1;
 };
\ No newline at end of file
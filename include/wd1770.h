@@ -1,21 +1,53 @@
 #pragma once
+#include <cstddef>
 #include <cstdint>
 #include <vector>
+#include "disk_overlay.h"
+#include "image.h"
 
+class StateArchive;
+
+// CRC-CCITT as the 1770 computes it over a field's address mark and
+// bytes (x^16 + x^12 + x^5 + 1, MSB first), carrying on from crc
+uint16_t crcCcitt(const uint8_t* bytes, size_t size, uint16_t crc = 0xFFFF);
+
+// WD1770 floppy controller with one drive of single-density Acorn DFS
+// disks. The disk turns under the head in real time (or faster, see
+// setTurbo): a command waits for the sector it wants to come round,
+// then data bytes arrive in REG_DATA with DRQ at the FM byte rate, and a
+// byte the CPU misses is lost. Sectors are found through an index of
+// the image built when it is inserted; sectors written go to the
+// overlay, which the mode set there may leave write protected.
 class WD1770 {
 public:
     WD1770();
 
     void reset();
+    void serialize(StateArchive& ar);
 
     // Memory-mapped register access
     uint8_t read(uint16_t reg);
     void    write(uint16_t reg, uint8_t value);
 
-    // Insert/eject disk image
-    void insertDisk(const std::vector<uint8_t>& image);
+    // Drive control latch of the Acorn 1770 interface: bit 1 selects
+    // drive 1 (always empty) over drive 0, bit 2 the disk's upper side
+    void writeControl(uint8_t value) { control = value; }
+
+    // Insert/eject an SSD, or a DSD with doubleSided. The image is
+    // shared, not copied, stays in across reset and is never written;
+    // a new disk starts with an empty overlay.
+    void insertDisk(RomImage image, bool doubleSided = false);
     void ejectDisk();
 
+    // Runs the drive factor times faster: head steps, settling, spin-up
+    // and the disk's rotation, so waits for a sector shrink too. Data
+    // bytes still come no faster than one per MIN_BYTE_CYCLES (the 1770's
+    // double-density rate), which a polling loop or NMI handler keeps up
+    // with. 1 (the default) is real time.
+    static constexpr uint32_t MIN_BYTE_CYCLES = 64;
+    void setTurbo(uint32_t factor);
+    uint32_t turboFactor() const { return turbo; }
+
     // Advance internal state by one emulated cycle
     void tick();
 
@@ -23,37 +55,89 @@ public:
     bool irqLine() const { return irq; }
     bool drqLine() const { return drq; }
 
+    // Sectors written to the disk in drive 0
+    DiskOverlay overlay;
+
 private:
     enum RegIndex { REG_CMD_STATUS = 0, REG_TRACK = 1, REG_SECTOR = 2, REG_DATA = 3 };
 
+    // What the running command is waiting for
+    enum Phase : uint8_t {
+        PHASE_IDLE,
+        PHASE_SPIN_UP, // motor reaching speed
+        PHASE_STEP,    // head moving
+        PHASE_VERIFY,  // an ID of the new track coming under the head
+        PHASE_SETTLE,  // head settling
+        PHASE_SEARCH,  // the wanted field coming under the head
+        PHASE_FIELD,   // bytes streaming to or from the CPU
+        PHASE_CRC      // the field's CRC passing after its last byte
+    };
+
     // Registers
-    uint8_t status;
+    uint8_t status;  // busy, error and record bits; the rest are derived
     uint8_t track;
     uint8_t sector;
     uint8_t data;
+    uint8_t control;
 
     // State
     bool irq;
     bool drq;
     bool busy;
     uint8_t command;
-    size_t dataPtr;
-
-    // Disk image
-    std::vector<uint8_t> diskImage;
-    bool diskInserted;
-    uint32_t commandCyclesRemaining; // countdown until command completes
+    size_t dataPtr;                  // bytes of the current field delivered
+    uint32_t commandCyclesRemaining; // countdown to the next event
+    Phase phase;
+    uint8_t headTrack;               // where the head is, whatever the track register says
+    bool stepIn;                     // direction of the last step
+    uint8_t fieldSector;             // the sector the field belongs to
+    bool motorOn;
+    uint64_t motorOffAt;             // idle motors stop after MOTOR_OFF_REVS turns
+    uint64_t clock;                  // cycles since reset: the disk's angle
+    uint8_t writeBuffer[256];        // the sector being written
 
+    // Disk image (configuration, like a ROM: not part of the saved state)
+    RomImage diskImage;
+    bool diskInserted = false;
+    uint8_t sides = 0;
+    uint8_t tracks = 0;
+    std::vector<uint32_t> sectorIndex; // image offset of (side, track, sector)
+    uint32_t turbo = 1;
+    uint32_t byteCycles = 0;           // one FM byte passing the head
+    uint32_t transferCycles = 0;       // between data bytes
 
     // Internal helpers
     void executeCommand(uint8_t cmd);
-    void finishCommand(bool error = false);
-
-    // Status bit masks (WD1770)
-    static constexpr uint8_t STATUS_BUSY   = 0x01;
-    static constexpr uint8_t STATUS_DRQ    = 0x02;
-    static constexpr uint8_t STATUS_CRCERR = 0x08;
-    static constexpr uint8_t STATUS_RNF    = 0x10; // Record Not Found
-    static constexpr uint8_t STATUS_WP     = 0x40; // Write Protect
-    static constexpr uint8_t STATUS_INTRQ  = 0x80; // IRQ pending
-};
\ No newline at end of file
+    void startCommand();
+    void advance(); // the event the countdown was for
+    void search();
+    void deliverByte();
+    void acceptByte();
+    void finishCommand(uint8_t errors = 0);
+
+    int side() const;
+    uint32_t sectorOffset(uint8_t sec) const; // on the head's track, NO_SECTOR if none
+    uint8_t sectorByte(uint8_t sec, size_t i) const;
+    uint8_t idByte(uint8_t sec, size_t i) const;
+    uint8_t trackByte(size_t pos) const;
+    uint8_t fieldByte(size_t i) const;
+    size_t fieldLength() const;
+    uint8_t nextId() const; // the sector whose ID comes by next
+    uint32_t revolution() const;
+    uint32_t cyclesUntil(uint32_t pos) const; // until track byte pos is under the head
+    uint32_t mechanical(double seconds) const;
+    bool typeOne() const;
+    bool writeSector() const { return (command & 0xE0) == 0xA0; }
+
+    // Status bit masks (WD1770); bits 1 and 2 depend on the command type
+    static constexpr uint8_t STATUS_BUSY    = 0x01;
+    static constexpr uint8_t STATUS_DRQ     = 0x02; // type II/III
+    static constexpr uint8_t STATUS_INDEX   = 0x02; // type I
+    static constexpr uint8_t STATUS_LOST    = 0x04; // type II/III: lost data
+    static constexpr uint8_t STATUS_TRACK0  = 0x04; // type I
+    static constexpr uint8_t STATUS_CRCERR  = 0x08;
+    static constexpr uint8_t STATUS_RNF     = 0x10; // Record Not Found / seek error
+    static constexpr uint8_t STATUS_SPUN_UP = 0x20; // type I
+    static constexpr uint8_t STATUS_WP      = 0x40; // Write Protect
+    static constexpr uint8_t STATUS_MOTOR   = 0x80; // Motor on
+};
@@ -1,4 +1,5 @@
 #include "acia.h"
+#include "state_archive.h"
 #include <algorithm>
 
 ACIA::ACIA() {
@@ -110,4 +111,17 @@ unsigned ACIA::txCyclesForCurrentBaud() const {
         case CR_CLK_DIV_64: return 640;
         default:            return 10;
     }
-}
\ No newline at end of file
+}
+
+void ACIA::serialize(StateArchive &ar)
+{
+    ar.io(dataReg_);
+    ar.io(statusReg_);
+    ar.io(controlReg_);
+    ar.io(txBuffer_);
+    ar.io(txBufferEmpty_);
+    ar.io(rxBufferFull_);
+    ar.io(irqAsserted_);
+    ar.io(txShiftCounter_);
+    ar.io(rxShiftCounter_);
+}
@@ -0,0 +1,263 @@
+#include "arena.h"
+#include <atomic>
+#include <mutex>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+// Size classes: multiples of ArenaAlign up to 4 KiB, then powers of two
+// up to a chunk
+static constexpr std::size_t SMALL_LIMIT = 4096;
+static constexpr int SMALL_CLASSES = SMALL_LIMIT / ArenaAlign;
+static constexpr int FIRST_MEDIUM_SHIFT = 13; // 8 KiB
+static constexpr int LAST_MEDIUM_SHIFT = 21;  // 2 MiB
+static constexpr int CLASS_COUNT = SMALL_CLASSES + LAST_MEDIUM_SHIFT - FIRST_MEDIUM_SHIFT + 1;
+static_assert((std::size_t(1) << LAST_MEDIUM_SHIFT) == ArenaChunkSize, "size classes must end at a chunk");
+
+static std::atomic<bool> hugePagesWanted{false};
+static std::atomic<bool> hugePagesGot{true};
+static std::atomic<std::size_t> chunkCount{0};
+static std::atomic<std::size_t> chunkBytes{0};
+static std::atomic<std::size_t> blocksInUse{0};
+
+static void *OsAllocate(std::size_t bytes, bool huge)
+{
+#if defined(_WIN32)
+    void *p = nullptr;
+    if (huge)
+        p = VirtualAlloc(nullptr, bytes, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+    if (!p)
+    {
+        if (huge)
+            hugePagesGot = false; // needs SeLockMemoryPrivilege
+        p = VirtualAlloc(nullptr, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    }
+    return p;
+#else
+    void *p = MAP_FAILED;
+#if defined(MAP_HUGETLB)
+    if (huge)
+        p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+    if (p == MAP_FAILED)
+    {
+        if (huge)
+            hugePagesGot = false;
+        p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED)
+            return nullptr;
+#if defined(MADV_HUGEPAGE)
+        if (huge) // no reserved huge pages: ask for transparent ones
+            madvise(p, bytes, MADV_HUGEPAGE);
+#endif
+    }
+    return p;
+#endif
+}
+
+static void OsFree(void *p, std::size_t bytes)
+{
+#if defined(_WIN32)
+    (void)bytes;
+    VirtualFree(p, 0, MEM_RELEASE);
+#else
+    munmap(p, bytes);
+#endif
+}
+
+namespace
+{
+struct FreeBlock
+{
+    FreeBlock *next;
+};
+
+// Shared free list and chunk cursor of one size class. Threads move
+// blocks to and from it in batches (see ThreadCache), so the lock is
+// taken once per batch rather than per block.
+struct SizeClass
+{
+    std::mutex mutex;
+    std::size_t blockSize = 0;
+    FreeBlock *free = nullptr;
+    char *bump = nullptr; // unused tail of the newest chunk
+    char *bumpEnd = nullptr;
+
+    // Up to n blocks, as a list
+    FreeBlock *take(int n)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        FreeBlock *list = nullptr;
+        for (int i = 0; i < n; ++i)
+        {
+            FreeBlock *b = free;
+            if (b)
+            {
+                free = b->next;
+            }
+            else
+            {
+                if (bump == bumpEnd)
+                {
+                    if (list)
+                        break; // enough for now; the next batch maps a chunk
+                    bump = static_cast<char *>(OsAllocate(ArenaChunkSize, hugePagesWanted));
+                    if (!bump)
+                        throw std::bad_alloc();
+                    bumpEnd = bump + ArenaChunkSize / blockSize * blockSize;
+                    chunkCount++;
+                    chunkBytes += ArenaChunkSize;
+                }
+                b = reinterpret_cast<FreeBlock *>(bump);
+                bump += blockSize;
+            }
+            b->next = list;
+            list = b;
+        }
+        return list;
+    }
+
+    void give(FreeBlock *first, FreeBlock *last)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        last->next = free;
+        free = first;
+    }
+};
+} // namespace
+
+// Never destroyed: blocks held by other statics are released during exit
+static SizeClass *Classes()
+{
+    static SizeClass *const classes = []
+    {
+        SizeClass *c = new SizeClass[CLASS_COUNT];
+        for (int i = 0; i < SMALL_CLASSES; ++i)
+            c[i].blockSize = (i + 1) * ArenaAlign;
+        for (int s = FIRST_MEDIUM_SHIFT; s <= LAST_MEDIUM_SHIFT; ++s)
+            c[SMALL_CLASSES + s - FIRST_MEDIUM_SHIFT].blockSize = std::size_t(1) << s;
+        return c;
+    }();
+    return classes;
+}
+
+// Blocks each thread keeps per class before handing some back
+static constexpr int CACHE_BATCH = 32;
+static constexpr int CACHE_LIMIT = 2 * CACHE_BATCH;
+
+// Set once this thread's cache is destroyed: statics released later in
+// exit go straight to the shared lists
+static thread_local bool threadCacheGone = false;
+
+namespace
+{
+struct ThreadCache
+{
+    FreeBlock *head[CLASS_COUNT] = {};
+    int count[CLASS_COUNT] = {};
+
+    void *allocate(int c)
+    {
+        if (!head[c])
+        {
+            head[c] = Classes()[c].take(CACHE_BATCH);
+            for (FreeBlock *b = head[c]; b; b = b->next)
+                count[c]++;
+        }
+        FreeBlock *b = head[c];
+        head[c] = b->next;
+        count[c]--;
+        return b;
+    }
+
+    void release(int c, void *p)
+    {
+        FreeBlock *b = static_cast<FreeBlock *>(p);
+        b->next = head[c];
+        head[c] = b;
+        if (++count[c] > CACHE_LIMIT)
+            flush(c, CACHE_BATCH);
+    }
+
+    // Hand the first n cached blocks back to the shared list
+    void flush(int c, int n)
+    {
+        FreeBlock *first = head[c];
+        FreeBlock *last = first;
+        for (int i = 1; i < n && last->next; ++i)
+            last = last->next;
+        head[c] = last->next;
+        count[c] -= n;
+        Classes()[c].give(first, last);
+    }
+
+    ~ThreadCache()
+    {
+        for (int c = 0; c < CLASS_COUNT; ++c)
+            if (head[c])
+                flush(c, count[c]);
+        threadCacheGone = true;
+    }
+};
+} // namespace
+
+static thread_local ThreadCache threadCache;
+
+// -1 for sizes over a chunk
+static int ClassOf(std::size_t bytes)
+{
+    if (bytes <= SMALL_LIMIT)
+        return bytes == 0 ? 0 : static_cast<int>((bytes - 1) / ArenaAlign);
+    if (bytes > ArenaChunkSize)
+        return -1;
+    int shift = FIRST_MEDIUM_SHIFT;
+    while ((std::size_t(1) << shift) < bytes)
+        ++shift;
+    return SMALL_CLASSES + shift - FIRST_MEDIUM_SHIFT;
+}
+
+void setArenaHugePages(bool enable)
+{
+    hugePagesWanted = enable;
+}
+
+void *arenaAllocate(std::size_t bytes)
+{
+    int c = ClassOf(bytes);
+    void *p;
+    if (c < 0)
+    {
+        p = OsAllocate(bytes, hugePagesWanted);
+        if (!p)
+            throw std::bad_alloc();
+    }
+    else
+    {
+        p = threadCacheGone ? Classes()[c].take(1) : threadCache.allocate(c);
+    }
+    blocksInUse++;
+    return p;
+}
+
+void arenaFree(void *p, std::size_t bytes)
+{
+    if (!p)
+        return;
+    int c = ClassOf(bytes);
+    if (c < 0)
+        OsFree(p, bytes);
+    else if (threadCacheGone)
+        Classes()[c].give(static_cast<FreeBlock *>(p), static_cast<FreeBlock *>(p));
+    else
+        threadCache.release(c, p);
+    blocksInUse--;
+}
+
+ArenaStats arenaStats()
+{
+    return ArenaStats{chunkCount, chunkBytes, blocksInUse, hugePagesWanted && hugePagesGot};
+}
@@ -0,0 +1,32 @@
+#include "audio_pacer.h"
+#include <algorithm>
+#include <chrono>
+
+// Proportional gain on the normalised fill error, and how much of each new
+// estimate is blended in per call (keeps pitch changes inaudible)
+static constexpr double FILL_GAIN = 0.01;
+static constexpr double SMOOTHING = 0.02;
+
+AudioPacer::AudioPacer(AudioRing &ring, TIAAudio &audio, std::size_t targetFill)
+    : ring_(ring), audio_(audio), target_(std::min(targetFill, ring.capacity() / 2))
+{
+    audio_.setRateAdjust(adjust_);
+}
+
+void AudioPacer::pace()
+{
+    // The fill the emulator ran up to. Blocking at the target below holds
+    // it there while the emulator keeps up, so the error is only what one
+    // call's samples overshoot by; it grows when the emulator falls behind.
+    std::size_t fill = ring_.size();
+
+    // Under target -> produce slightly more samples per emulated second
+    double error = (static_cast<double>(target_) - static_cast<double>(fill)) / static_cast<double>(target_);
+    double wanted = std::clamp(1.0 + FILL_GAIN * error, 1.0 - MaxAdjust, 1.0 + MaxAdjust);
+    adjust_ += SMOOTHING * (wanted - adjust_);
+    audio_.setRateAdjust(adjust_);
+
+    // Ahead of the consumer: let it drain back down to the target
+    if (fill > target_)
+        ring_.waitForSpace(ring_.capacity() - target_, std::chrono::milliseconds(100));
+}
@@ -0,0 +1,277 @@
+#include "banking.h"
+#include "state_archive.h"
+#include <algorithm>
+
+static constexpr int CART_SCHEME_COUNT = 8;
+static const char *const CART_SCHEME_NAMES[CART_SCHEME_COUNT] = {"auto", "2k4k", "f8", "f6", "f4", "e0", "3f", "fe"};
+
+const char *cartSchemeName(CartScheme scheme)
+{
+    int i = static_cast<int>(scheme);
+    return i < CART_SCHEME_COUNT ? CART_SCHEME_NAMES[i] : "unknown";
+}
+
+bool parseCartScheme(const std::string &name, CartScheme &scheme)
+{
+    for (int i = 0; i < CART_SCHEME_COUNT; ++i)
+    {
+        if (name == CART_SCHEME_NAMES[i])
+        {
+            scheme = static_cast<CartScheme>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+CartScheme guessCartScheme(std::size_t size)
+{
+    switch (size)
+    {
+    case 0x0800:
+    case 0x1000:
+        return CartScheme::Plain;
+    case 0x2000:
+        return CartScheme::F8;
+    case 0x4000:
+        return CartScheme::F6;
+    case 0x8000:
+        return CartScheme::F4;
+    default:
+        return size > 0x8000 && size % 0x800 == 0 ? CartScheme::Tigervision3F : CartScheme::Auto;
+    }
+}
+
+// Cartridge2600
+// ------------------------------------------------------------
+
+static constexpr uint8_t CART_FIRST_PAGE = 0x10; // $1000
+static constexpr int PENDING = 4;                // FE's register
+
+bool Cartridge2600::insert(RomImage image, CartScheme scheme)
+{
+    if (!image || image->empty())
+        return false;
+    std::size_t size = image->size();
+    if (scheme == CartScheme::Auto)
+        scheme = guessCartScheme(size);
+
+    uint32_t segmentSize = 0x1000;
+    int segments = 1;
+    switch (scheme)
+    {
+    case CartScheme::Plain:
+        if (size != 0x0800 && size != 0x1000)
+            return false;
+        break;
+    case CartScheme::F8:
+    case CartScheme::ActivisionFE:
+        if (size != 0x2000)
+            return false;
+        break;
+    case CartScheme::F6:
+        if (size != 0x4000)
+            return false;
+        break;
+    case CartScheme::F4:
+        if (size != 0x8000)
+            return false;
+        break;
+    case CartScheme::E0:
+        if (size != 0x2000)
+            return false;
+        segmentSize = 0x0400;
+        segments = 4;
+        break;
+    case CartScheme::Tigervision3F:
+        if (size < 0x1000 || size > 256 * 0x800 || size % 0x800 != 0)
+            return false;
+        segmentSize = 0x0800;
+        segments = 2;
+        break;
+    default:
+        return false;
+    }
+
+    image_ = std::move(image);
+    scheme_ = scheme;
+    segmentSize_ = segmentSize;
+    segments_ = segments;
+    banks_ = std::max<uint32_t>(1, static_cast<uint32_t>(size / segmentSize));
+    reset();
+    return true;
+}
+
+void Cartridge2600::reset()
+{
+    for (uint8_t &r : regs_)
+        r = 0;
+    switch (scheme_)
+    {
+    case CartScheme::F8:
+    case CartScheme::F6:
+    case CartScheme::F4:
+        regs_[0] = static_cast<uint8_t>(banks_ - 1);
+        break;
+    case CartScheme::E0:
+        for (int s = 0; s < 4; ++s)
+            regs_[s] = static_cast<uint8_t>(4 + s); // the last segment is fixed to slice 7
+        break;
+    case CartScheme::Tigervision3F:
+        regs_[1] = static_cast<uint8_t>(banks_ - 1); // fixed
+        break;
+    default:
+        break;
+    }
+}
+
+void Cartridge2600::attach(Memory &mem) const
+{
+    if (!image_)
+        return;
+    for (int page = 0; page < 0x20; ++page)
+        mem.SetHotspotPage(static_cast<uint8_t>(page), false, false);
+    for (int s = 0; s < segments_; ++s)
+        mapSegment(s, mem);
+
+    switch (scheme_)
+    {
+    case CartScheme::F8:
+    case CartScheme::F6:
+    case CartScheme::F4:
+    case CartScheme::E0:
+        mem.SetHotspotPage(0x1F, true, true);
+        break;
+    case CartScheme::Tigervision3F:
+        mem.SetHotspotPage(0x00, false, true);
+        break;
+    case CartScheme::ActivisionFE:
+        mem.SetHotspotPage(0x01, true, true);
+        if (regs_[PENDING])
+            for (int page = CART_FIRST_PAGE; page < 0x20; ++page)
+                mem.SetHotspotPage(static_cast<uint8_t>(page), true, true);
+        break;
+    default:
+        break;
+    }
+}
+
+void Cartridge2600::mapSegment(int segment, Memory &mem) const
+{
+    const uint8_t *data = image_->data();
+    std::size_t size = image_->size();
+    uint32_t pages = segmentSize_ / Memory::PAGE_SIZE;
+    uint32_t base = regs_[segment] * segmentSize_;
+    for (uint32_t i = 0; i < pages; ++i)
+    {
+        // Modulo so a 2K plain image repeats through the window
+        std::size_t offset = (base + i * Memory::PAGE_SIZE) % size;
+        mem.MapPage(static_cast<uint8_t>(CART_FIRST_PAGE + segment * pages + i), data + offset);
+    }
+}
+
+void Cartridge2600::select(int segment, uint32_t bank, Memory &mem)
+{
+    bank %= banks_;
+    if (regs_[segment] == bank)
+        return;
+    regs_[segment] = static_cast<uint8_t>(bank);
+    mapSegment(segment, mem);
+}
+
+void Cartridge2600::setPending(bool pending, Memory &mem)
+{
+    // While set, the next cartridge fetch is a hotspot too
+    regs_[PENDING] = pending;
+    for (int page = CART_FIRST_PAGE; page < 0x20; ++page)
+        mem.SetHotspotPage(static_cast<uint8_t>(page), pending, pending);
+}
+
+void Cartridge2600::access(uint16_t addr, uint8_t data, Memory &mem)
+{
+    uint16_t a = addr & 0x1FFF;
+    switch (scheme_)
+    {
+    case CartScheme::F8:
+    case CartScheme::F6:
+    case CartScheme::F4:
+    {
+        uint16_t first = scheme_ == CartScheme::F8 ? 0x1FF8 : scheme_ == CartScheme::F6 ? 0x1FF6 : 0x1FF4;
+        if (a >= first && a < first + banks_)
+            select(0, a - first, mem);
+        break;
+    }
+    case CartScheme::E0:
+        if (a >= 0x1FE0 && a < 0x1FF8)
+            select((a - 0x1FE0) >> 3, a & 0x07, mem);
+        break;
+    case CartScheme::Tigervision3F:
+        if (a < 0x0040)
+            select(0, data, mem);
+        break;
+    case CartScheme::ActivisionFE:
+        // The access after one to $01FE carries the high byte of the new
+        // PC: the $01FF pull of an RTS, or, as this CPU fetches a JSR's
+        // operand before pushing, the first fetch at the target. Bit 5
+        // (A13) clear selects the second bank.
+        if (regs_[PENDING])
+        {
+            setPending(false, mem);
+            bool high = (a & 0x1000) ? (addr & 0x2000) != 0 : (data & 0x20) != 0;
+            select(0, high ? 0 : 1, mem);
+        }
+        if (a == 0x01FE)
+            setPending(true, mem);
+        break;
+    default:
+        break;
+    }
+}
+
+void Cartridge2600::serialize(StateArchive &ar)
+{
+    ar.bytes(regs_, sizeof(regs_));
+}
+
+// SidewaysRoms
+// ------------------------------------------------------------
+
+// What an empty socket reads as
+static const uint8_t *EmptyRomPage()
+{
+    static const std::vector<uint8_t> page(Memory::PAGE_SIZE, 0xFF);
+    return page.data();
+}
+
+bool SidewaysRoms::insert(int slot, RomImage image)
+{
+    if (slot < 0 || slot >= Slots || !image || image->empty() || image->size() > SlotSize ||
+        image->size() % Memory::PAGE_SIZE != 0)
+        return false;
+    slots_[slot] = std::move(image);
+    active_ = true;
+    return true;
+}
+
+void SidewaysRoms::attach(Memory &mem) const
+{
+    if (!active_)
+        return;
+    const RomImage &rom = slots_[romsel_ & 0x0F];
+    for (uint32_t i = 0; i < SlotSize / Memory::PAGE_SIZE; ++i)
+    {
+        const uint8_t *data = rom ? rom->data() + (i * Memory::PAGE_SIZE) % rom->size() : EmptyRomPage();
+        mem.MapPage(static_cast<uint8_t>(0x80 + i), data);
+    }
+}
+
+void SidewaysRoms::select(uint8_t romsel, Memory &mem)
+{
+    romsel_ = romsel & 0x0F;
+    attach(mem);
+}
+
+void SidewaysRoms::serialize(StateArchive &ar)
+{
+    ar.io(romsel_);
+}
@@ -0,0 +1,177 @@
+#include "bisector.h"
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+template <MachineType Type>
+Bisector<Type>::Bisector(const MachineT &a, const MachineT &b, uint64_t interval)
+    : a_(a), b_(b), goodA_(a), goodB_(b), interval_(interval ? interval : 1)
+{
+}
+
+template <MachineType Type>
+void Bisector<Type>::setLabels(const std::string &a, const std::string &b)
+{
+    labels_[0] = a;
+    labels_[1] = b;
+}
+
+template <MachineType Type>
+MachineState Bisector<Type>::capture(const MachineT &m)
+{
+    MachineState s;
+    s.instructions = m.cpu.instructions;
+    s.cycles = m.cpu.total_cycles;
+    s.fingerprint = m.Fingerprint();
+    s.PC = m.cpu.PC;
+    s.A = m.cpu.A;
+    s.X = m.cpu.X;
+    s.Y = m.cpu.Y;
+    s.SP = m.cpu.SP;
+    s.P = m.cpu.P.reg;
+    s.opcode = m.mem.Peek(m.cpu.PC);
+    return s;
+}
+
+// Step both machines up to n instructions; false if either stops early
+template <MachineType Type>
+bool Bisector<Type>::stepBoth(MachineT &a, MachineT &b, uint64_t n)
+{
+    for (uint64_t i = 0; i < n; ++i)
+    {
+        if (a.cpu.halted || b.cpu.halted || !a.cpu.running || !b.cpu.running)
+            return false;
+        a.Step();
+        b.Step();
+    }
+    return true;
+}
+
+template <MachineType Type>
+bool Bisector<Type>::run(uint64_t instructions)
+{
+    diverged_ = false;
+    uint64_t end = checked_ + instructions;
+    while (checked_ < end)
+    {
+        uint64_t n = std::min(interval_, end - checked_);
+        goodA_ = a_;
+        goodB_ = b_;
+        bool more = stepBoth(a_, b_, n);
+        uint64_t done = a_.cpu.instructions - goodA_.cpu.instructions;
+
+        if (a_.Fingerprint() != b_.Fingerprint() || a_.cpu.halted != b_.cpu.halted)
+        {
+            bisect(done);
+            return true;
+        }
+        checked_ += done;
+        if (!more)
+            break;
+    }
+    return false;
+}
+
+// The snapshots agree and differ `bad` instructions later. Narrow down to
+// the single instruction, moving the good snapshot forward as we go so
+// each probe replays as little as possible.
+template <MachineType Type>
+void Bisector<Type>::bisect(uint64_t bad)
+{
+    uint64_t good = 0;
+    while (bad - good > 1)
+    {
+        uint64_t mid = good + (bad - good) / 2;
+        MachineT a = goodA_, b = goodB_;
+        stepBoth(a, b, mid - good);
+        if (a.Fingerprint() == b.Fingerprint() && a.cpu.halted == b.cpu.halted)
+        {
+            goodA_ = a;
+            goodB_ = b;
+            good = mid;
+        }
+        else
+        {
+            bad = mid;
+        }
+    }
+
+    MachineT a = goodA_, b = goodB_;
+    divergence_.instruction = a.cpu.instructions;
+    divergence_.before[0] = capture(a);
+    divergence_.before[1] = capture(b);
+    stepBoth(a, b, 1);
+    divergence_.after[0] = capture(a);
+    divergence_.after[1] = capture(b);
+
+    divergence_.ram.clear();
+    for (uint32_t page = 0; page < 256; ++page)
+    {
+        if (a.mem.PageHash(page) == b.mem.PageHash(page))
+            continue;
+        for (uint32_t i = 0; i < 256 && divergence_.ram.size() < maxRamDiffs_; ++i)
+        {
+            uint16_t addr = static_cast<uint16_t>(page << 8 | i);
+            if (a.mem.Peek(addr) != b.mem.Peek(addr))
+                divergence_.ram.push_back({addr, a.mem.Peek(addr), b.mem.Peek(addr)});
+        }
+    }
+
+    a_ = a;
+    b_ = b;
+    checked_ = divergence_.instruction;
+    diverged_ = true;
+}
+
+static void printRow(std::ostream &out, const std::string &name, uint64_t a, uint64_t b, int digits)
+{
+    out << "  " << std::left << std::setw(14) << name << std::right << std::hex << std::setfill('0')
+        << "$" << std::setw(digits) << a << std::setfill(' ') << std::setw(20 - digits) << ""
+        << std::setfill('0') << "$" << std::setw(digits) << b << std::setfill(' ')
+        << (a != b ? "   <--" : "") << std::dec << "\n";
+}
+
+static void printStates(std::ostream &out, const MachineState &a, const MachineState &b)
+{
+    printRow(out, "PC", a.PC, b.PC, 4);
+    printRow(out, "opcode", a.opcode, b.opcode, 2);
+    printRow(out, "A", a.A, b.A, 2);
+    printRow(out, "X", a.X, b.X, 2);
+    printRow(out, "Y", a.Y, b.Y, 2);
+    printRow(out, "SP", a.SP, b.SP, 2);
+    printRow(out, "P", a.P, b.P, 2);
+    printRow(out, "cycles", a.cycles, b.cycles, 8);
+    printRow(out, "fingerprint", a.fingerprint, b.fingerprint, 16);
+}
+
+template <MachineType Type>
+void Bisector<Type>::print(std::ostream &out) const
+{
+    if (!diverged_)
+    {
+        out << "No divergence in " << checked_ << " instructions\n";
+        return;
+    }
+
+    out << "First divergence at instruction " << divergence_.instruction << "\n";
+    out << "  " << std::left << std::setw(14) << "" << std::setw(21) << labels_[0] << labels_[1]
+        << std::right << "\n";
+    out << "Before:\n";
+    printStates(out, divergence_.before[0], divergence_.before[1]);
+    out << "After:\n";
+    printStates(out, divergence_.after[0], divergence_.after[1]);
+
+    if (!divergence_.ram.empty())
+    {
+        out << "RAM:\n";
+        for (const RamDifference &d : divergence_.ram)
+        {
+            std::ostringstream addr;
+            addr << "$" << std::hex << std::setw(4) << std::setfill('0') << d.addr;
+            printRow(out, addr.str(), d.a, d.b, 2);
+        }
+    }
+}
+
+#define INSTANTIATE_BISECTOR(T) template class Bisector<T>;
+FOR_EACH_MACHINE_TYPE(INSTANTIATE_BISECTOR)
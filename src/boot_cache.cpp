@@ -0,0 +1,115 @@
+#include "boot_cache.h"
+#include "hash64.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+
+// Folded into every key; bump when saved states change meaning
+static constexpr uint64_t BOOT_CACHE_VERSION = 2;
+
+std::string bootPointName(const BootPoint &point)
+{
+    char text[32];
+    switch (point.kind)
+    {
+    case BootPoint::Kind::Pc:
+        std::snprintf(text, sizeof(text), "pc:%04x", static_cast<unsigned>(point.value));
+        break;
+    case BootPoint::Kind::Cycles:
+        std::snprintf(text, sizeof(text), "cycles:%llu", static_cast<unsigned long long>(point.value));
+        break;
+    default:
+        std::snprintf(text, sizeof(text), "frames:%llu", static_cast<unsigned long long>(point.value));
+        break;
+    }
+    return text;
+}
+
+bool parseBootPoint(const std::string &name, BootPoint &point)
+{
+    std::size_t colon = name.find(':');
+    std::string kind = name.substr(0, colon);
+    const char *number = colon == std::string::npos ? "" : name.c_str() + colon + 1;
+    char *end = nullptr;
+    BootPoint parsed;
+    if (kind == "frames")
+        parsed.kind = BootPoint::Kind::Frames;
+    else if (kind == "pc")
+        parsed.kind = BootPoint::Kind::Pc;
+    else if (kind == "cycles")
+        parsed.kind = BootPoint::Kind::Cycles;
+    else
+        return false;
+    if (*number)
+        parsed.value = std::strtoull(number, &end, parsed.kind == BootPoint::Kind::Pc ? 16 : 10);
+    else if (parsed.kind != BootPoint::Kind::Frames) // "frames" alone is the first frame
+        return false;
+    if ((end && *end) || (parsed.kind == BootPoint::Kind::Pc && parsed.value > 0xFFFF))
+        return false;
+    point = parsed;
+    return true;
+}
+
+uint64_t BootCache::key(MachineType type, uint64_t preBootState, uint64_t config, const std::vector<RomImage> &images,
+                        const BootPoint &point)
+{
+    std::vector<uint64_t> words;
+    for (const RomImage &image : images)
+        if (image)
+            words.push_back(hash64(image->data(), image->size(), image->size()));
+    std::sort(words.begin(), words.end());
+    words.push_back(BOOT_CACHE_VERSION);
+    words.push_back(static_cast<uint64_t>(type));
+    words.push_back(static_cast<uint64_t>(point.kind));
+    words.push_back(point.value);
+    words.push_back(preBootState);
+    words.push_back(config);
+    return hash64(words.data(), words.size() * sizeof(uint64_t));
+}
+
+std::string BootCache::path(MachineType type, uint64_t key) const
+{
+    char name[64];
+    std::snprintf(name, sizeof(name), "%s-%016llx.boot", machineTypeName(type), static_cast<unsigned long long>(key));
+    return dir_ + "/" + name;
+}
+
+RomImage BootCache::find(MachineType type, uint64_t key)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = loaded_.find(key);
+        if (it != loaded_.end())
+            return it->second;
+    }
+    if (dir_.empty())
+        return nullptr;
+    RomImage state = Image::map(path(type, key));
+    if (!state)
+        return nullptr;
+    std::lock_guard<std::mutex> lock(mutex_);
+    return loaded_.emplace(key, state).first->second;
+}
+
+void BootCache::store(MachineType type, uint64_t key, std::vector<uint8_t> state)
+{
+    RomImage image = Image::fromBytes(std::move(state));
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        loaded_[key] = image; // replaces an entry that failed to load
+    }
+    if (dir_.empty())
+        return;
+    // Written aside and renamed into place, so a reader never sees half
+    // a state; runs that race write the same bytes
+    std::string final = path(type, key);
+    std::string temp = final + "." + std::to_string(std::random_device()()) + ".tmp";
+    std::FILE *out = std::fopen(temp.c_str(), "wb");
+    if (!out)
+        return;
+    bool written = std::fwrite(image->data(), 1, image->size(), out) == image->size();
+    written = std::fclose(out) == 0 && written;
+    if (!written || std::rename(temp.c_str(), final.c_str()) != 0)
+        std::remove(temp.c_str());
+}
@@ -0,0 +1,22 @@
+#include "bus.h"
+
+static const char *const MACHINE_TYPE_NAMES[MachineTypeCount] = {"generic", "2600", "vic20", "bbc", "pet", "plus4"};
+
+const char *machineTypeName(MachineType type)
+{
+    int i = static_cast<int>(type);
+    return i < MachineTypeCount ? MACHINE_TYPE_NAMES[i] : "unknown";
+}
+
+bool parseMachineType(const std::string &name, MachineType &type)
+{
+    for (int i = 0; i < MachineTypeCount; ++i)
+    {
+        if (name == MACHINE_TYPE_NAMES[i])
+        {
+            type = static_cast<MachineType>(i);
+            return true;
+        }
+    }
+    return false;
+}
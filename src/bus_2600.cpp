@@ -0,0 +1,68 @@
+#include "bus_2600.h"
+#include "state_archive.h"
+#include <algorithm>
+
+Bus<MachineType::Atari2600>::Bus() : Memory(RomSpace::ATARI_2600), tia(TIAColorSpace::Index)
+{
+    use6507addresspace = true;
+    RebindDevices();
+    Reset();
+}
+
+void Bus<MachineType::Atari2600>::Load(uint16_t addr, const uint8_t *bytes, std::size_t size)
+{
+    addr &= 0x1FFF;
+    Memory::Load(addr, bytes, std::min<std::size_t>(size, 0x2000 - addr));
+}
+
+bool Bus<MachineType::Atari2600>::InsertCartridge(RomImage image, CartScheme scheme)
+{
+    if (!cart.insert(std::move(image), scheme))
+        return false;
+    cart.attach(*this);
+    if (StateHashEnabled())
+        RecomputeStateHash();
+    return true;
+}
+
+void Bus<MachineType::Atari2600>::Reset()
+{
+    tia.reset(true); // NTSC
+    riot.reset();
+    cart.reset();
+    cart.attach(*this);
+    Memory::Reset(); // after the devices, so the state hash sees their cleared state
+}
+
+void Bus<MachineType::Atari2600>::BankRead(uint16_t addr)
+{
+    BankAccess(addr, Peek(addr));
+}
+
+void Bus<MachineType::Atari2600>::BankWrite(uint16_t addr, uint8_t value)
+{
+    BankAccess(addr, value);
+}
+
+void Bus<MachineType::Atari2600>::BankAccess(uint16_t addr, uint8_t data)
+{
+    uint8_t before[Cartridge2600::RegisterCount];
+    std::copy_n(cart.registers(), Cartridge2600::RegisterCount, before);
+    cart.access(addr, data, *this);
+    if (StateHashEnabled())
+        for (int i = 0; i < Cartridge2600::RegisterCount; ++i)
+            if (before[i] != cart.registers()[i])
+                UpdateStateHash(DeviceRamKey(1) | i, before[i], cart.registers()[i]);
+}
+
+void Bus<MachineType::Atari2600>::Serialize(StateArchive &ar)
+{
+    SerializeRam(ar);
+    tia.serialize(ar);
+    riot.serialize(ar);
+    cart.serialize(ar);
+    if (ar.loading())
+        cart.attach(*this);
+    if (ar.loading() && StateHashEnabled())
+        RecomputeStateHash();
+}
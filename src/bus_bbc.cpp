@@ -0,0 +1,49 @@
+#include "bus_bbc.h"
+#include "state_archive.h"
+
+Bus<MachineType::BBCMicro>::Bus() : Memory(RomSpace::BBC_MICRO)
+{
+    RebindDevices();
+    Reset();
+}
+
+bool Bus<MachineType::BBCMicro>::InsertSidewaysRom(int slot, RomImage image)
+{
+    if (!sideways.insert(slot, std::move(image)))
+        return false;
+    sideways.attach(*this);
+    return true;
+}
+
+void Bus<MachineType::BBCMicro>::SelectRom(uint8_t romsel)
+{
+    uint8_t before = *sideways.registers();
+    sideways.select(romsel, *this);
+    if (StateHashEnabled())
+        UpdateStateHash(DeviceRamKey(0), before, *sideways.registers());
+}
+
+void Bus<MachineType::BBCMicro>::Reset()
+{
+    systemVia = VIA6522();
+    userVia = VIA6522();
+    acia.reset();
+    disk.reset();
+    sideways.reset();
+    sideways.attach(*this);
+    Memory::Reset();
+}
+
+void Bus<MachineType::BBCMicro>::Serialize(StateArchive &ar)
+{
+    SerializeRam(ar);
+    systemVia.Serialize(ar);
+    userVia.Serialize(ar);
+    acia.serialize(ar);
+    disk.serialize(ar);
+    sideways.serialize(ar);
+    if (ar.loading())
+        sideways.attach(*this);
+    if (ar.loading() && StateHashEnabled())
+        RecomputeStateHash();
+}
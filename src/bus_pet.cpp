@@ -0,0 +1,23 @@
+#include "bus_pet.h"
+#include "state_archive.h"
+
+Bus<MachineType::PET>::Bus() : Memory(RomSpace::PET)
+{
+    Reset();
+}
+
+void Bus<MachineType::PET>::Reset()
+{
+    pia.reset();
+    via = VIA6522();
+    Memory::Reset();
+}
+
+void Bus<MachineType::PET>::Serialize(StateArchive &ar)
+{
+    SerializeRam(ar);
+    pia.serialize(ar);
+    via.Serialize(ar);
+    if (ar.loading() && StateHashEnabled())
+        RecomputeStateHash();
+}
@@ -0,0 +1,21 @@
+#include "bus_plus4.h"
+#include "state_archive.h"
+
+Bus<MachineType::Plus4>::Bus() : Memory(RomSpace::PLUS4)
+{
+    Reset();
+}
+
+void Bus<MachineType::Plus4>::Reset()
+{
+    io.reset();
+    Memory::Reset();
+}
+
+void Bus<MachineType::Plus4>::Serialize(StateArchive &ar)
+{
+    SerializeRam(ar);
+    io.serialize(ar);
+    if (ar.loading() && StateHashEnabled())
+        RecomputeStateHash();
+}
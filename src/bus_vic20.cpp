@@ -0,0 +1,33 @@
+#include "bus_vic20.h"
+#include "state_archive.h"
+
+Bus<MachineType::VIC20>::Bus() : Memory(RomSpace::VIC20), vic(VICColorSpace::Index)
+{
+    RebindDevices();
+    Reset();
+}
+
+void Bus<MachineType::VIC20>::Load(uint16_t addr, const uint8_t *bytes, std::size_t size)
+{
+    Memory::Load(addr, bytes, size);
+    for (std::size_t i = 0; i < size && addr + i < MAX_MEM; ++i)
+        vic.noteWrite(static_cast<uint16_t>(addr + i));
+}
+
+void Bus<MachineType::VIC20>::Reset()
+{
+    vic.reset();
+    via1 = VIA6522();
+    via2 = VIA6522();
+    Memory::Reset();
+}
+
+void Bus<MachineType::VIC20>::Serialize(StateArchive &ar)
+{
+    SerializeRam(ar);
+    vic.serialize(ar);
+    via1.Serialize(ar);
+    via2.Serialize(ar);
+    if (ar.loading() && StateHashEnabled())
+        RecomputeStateHash();
+}
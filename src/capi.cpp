@@ -0,0 +1,521 @@
+#include "emu6502.h"
+#include "arena.h"
+#include "boot_cache.h"
+#include "dfs.h"
+#include "disk_overlay.h"
+#include "loader.h"
+#include "machine.h"
+#include "os_traps.h"
+#include "palette.h"
+#include "rom_store.h"
+#include "suspend_file.h"
+#include "thread_pool.h"
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <new>
+#include <variant>
+
+static_assert(EMU6502_MACHINE_PLUS4 == static_cast<int>(MachineType::Plus4), "MachineType numbering changed");
+static_assert(EMU6502_MACHINE_PLUS4 + 1 == MachineTypeCount, "MachineType added without a C constant");
+static_assert(EMU6502_PIXEL_LUMA8 == static_cast<int>(PixelFormat::Luma8), "PixelFormat numbering changed");
+static_assert(EMU6502_DISK_JOURNAL == static_cast<int>(DiskWrites::Journal), "DiskWrites numbering changed");
+static_assert(EMU6502_OUTPUT_REPLACE == static_cast<int>(OutputTrap::Replace), "OutputTrap numbering changed");
+
+// Every call dispatches on the profile once, then runs on the concrete
+// Machine<> type. Handles come from the pooled allocator, so a fleet that
+// keeps creating and destroying machines recycles the same blocks.
+struct emu6502_machine
+{
+    AnyMachine m;
+    std::vector<RomImage> images; // inserted files, for boot cache keys
+    std::shared_ptr<OsTraps> traps; // shared with forks, whose buses point at it
+    std::shared_ptr<HostDirectory> files;
+    std::shared_ptr<DfsCatalogue> disk;
+    std::shared_ptr<DiskJournal> journal; // a fork's overlay doesn't use it
+
+    explicit emu6502_machine(MachineType type) : m(makeMachine(type)) {}
+    emu6502_machine(const emu6502_machine &other); // a fork reads its own disk writes
+
+    static void *operator new(std::size_t size, const std::nothrow_t &) noexcept
+    {
+        try
+        {
+            return arenaAllocate(size);
+        }
+        catch (...)
+        {
+            return nullptr;
+        }
+    }
+    static void operator delete(void *p, std::size_t size) { arenaFree(p, size); }
+    static void operator delete(void *p, const std::nothrow_t &) noexcept { arenaFree(p, sizeof(emu6502_machine)); }
+};
+
+static_assert(alignof(emu6502_machine) <= ArenaAlign, "machine alignment exceeds the arena's");
+
+template <class F>
+static auto with(emu6502_machine *m, F &&fn)
+{
+    return std::visit(fn, m->m);
+}
+
+template <class F>
+static auto with(const emu6502_machine *m, F &&fn)
+{
+    return std::visit(fn, m->m);
+}
+
+// Fast load from disk, reading m's own disk writes over the image. The
+// traps are a copy, so forks keep the ones they were made with.
+static void useDisk(emu6502_machine *m, std::shared_ptr<DfsCatalogue> disk)
+{
+    auto &bbc = std::get<Machine<MachineType::BBCMicro>>(m->m);
+    disk->setOverlay(&bbc.mem.disk.overlay);
+    auto traps = m->traps ? std::make_shared<OsTraps>(*m->traps) : std::make_shared<OsTraps>(MachineType::BBCMicro);
+    enableDfsFastLoad(*traps, *disk);
+    m->disk = std::move(disk);
+    m->traps = traps;
+    bbc.mem.SetTraps(traps.get());
+}
+
+emu6502_machine::emu6502_machine(const emu6502_machine &other)
+    : m(other.m), images(other.images), traps(other.traps), files(other.files), journal(other.journal)
+{
+    if (other.disk)
+        useDisk(this, std::make_shared<DfsCatalogue>(*other.disk));
+}
+
+// Cycles clocked plus those the devices are still owed
+template <class MachineT>
+static uint64_t elapsed(const MachineT &m)
+{
+    return m.cpu.total_cycles + m.cpu.cycles;
+}
+
+template <class MachineT>
+static bool stopped(const MachineT &m)
+{
+    return m.cpu.halted || !m.cpu.running;
+}
+
+template <class MachineT>
+static int runCycles(MachineT &m, uint64_t cycles)
+{
+    const uint64_t target = elapsed(m) + cycles;
+    while (elapsed(m) < target)
+    {
+        if (stopped(m))
+            return EMU6502_STOP_HALTED;
+        m.Step();
+    }
+    return EMU6502_STOP_DONE;
+}
+
+template <class MachineT>
+static int runFrames(MachineT &m, uint32_t frames, uint64_t maxCycles)
+{
+    const uint64_t target = m.mem.FrameSequence() + frames;
+    const uint64_t limit = elapsed(m) + maxCycles;
+    while (m.mem.FrameSequence() < target)
+    {
+        if (stopped(m))
+            return EMU6502_STOP_HALTED;
+        if (elapsed(m) >= limit)
+            return EMU6502_STOP_BUDGET;
+        m.Step();
+    }
+    return EMU6502_STOP_DONE;
+}
+
+template <class MachineT>
+static int runUntilPc(MachineT &m, uint16_t pc, uint64_t maxCycles)
+{
+    const uint64_t limit = elapsed(m) + maxCycles;
+    while (m.cpu.PC != pc)
+    {
+        if (stopped(m))
+            return EMU6502_STOP_HALTED;
+        if (elapsed(m) >= limit)
+            return EMU6502_STOP_BUDGET;
+        m.Step();
+    }
+    return EMU6502_STOP_DONE;
+}
+
+// No C++ exception may unwind into a C or FFI caller. Each entry point
+// runs inside one of these, and a throw (out of memory, mostly: a page
+// copied on write, a vector grown) becomes the call's failure value.
+template <class R, class F>
+static R guarded(R failure, F &&fn) noexcept
+{
+    try
+    {
+        return fn();
+    }
+    catch (...)
+    {
+        return failure;
+    }
+}
+
+template <class F>
+static void guarded(F &&fn) noexcept
+{
+    try
+    {
+        fn();
+    }
+    catch (...)
+    {
+    }
+}
+
+extern "C" {
+
+int emu6502_abi_version(void) { return EMU6502_ABI_VERSION; }
+
+void emu6502_use_huge_pages(int enable) { setArenaHugePages(enable != 0); }
+
+emu6502_machine *emu6502_create(int machine_type)
+{
+    if (machine_type < 0 || machine_type >= MachineTypeCount)
+        return nullptr;
+    return guarded<emu6502_machine *>(nullptr, [&]
+                                      { return new (std::nothrow) emu6502_machine(static_cast<MachineType>(machine_type)); });
+}
+
+emu6502_machine *emu6502_fork(const emu6502_machine *m)
+{
+    return guarded<emu6502_machine *>(nullptr, [&] { return new (std::nothrow) emu6502_machine(*m); });
+}
+
+void emu6502_destroy(emu6502_machine *m)
+{
+    guarded([&] { delete m; });
+}
+
+int emu6502_machine_type(const emu6502_machine *m) { return static_cast<int>(m->m.index()); }
+
+void emu6502_load_image(emu6502_machine *m, uint16_t addr, const uint8_t *data, size_t size)
+{
+    guarded([&] { with(m, [&](auto &mc) { mc.mem.Load(addr, data, size); }); });
+}
+
+int emu6502_insert_file(emu6502_machine *m, const char *path, uint16_t addr)
+{
+    return guarded(0, [&]
+                   {
+                       RomImage image = Image::map(path);
+                       if (!image)
+                           return 0;
+                       // From the file named: the interned image may carry another's path
+                       ImageInfo info = detectImage(*image);
+                       image = internImage(image);
+                       if (!with(m, [&](auto &mc) { return insertImage(mc, image, info, addr); }))
+                           return 0;
+                       m->images.push_back(image);
+                       return 1;
+                   });
+}
+
+void emu6502_reset(emu6502_machine *m)
+{
+    guarded([&] { with(m, [](auto &mc) { mc.Reset(); }); });
+}
+
+int emu6502_run_cycles(emu6502_machine *m, uint64_t cycles)
+{
+    return guarded<int>(EMU6502_STOP_ERROR, [&] { return with(m, [&](auto &mc) { return runCycles(mc, cycles); }); });
+}
+
+int emu6502_run_frames(emu6502_machine *m, uint32_t frames, uint64_t max_cycles)
+{
+    return guarded<int>(EMU6502_STOP_ERROR,
+                        [&] { return with(m, [&](auto &mc) { return runFrames(mc, frames, max_cycles); }); });
+}
+
+int emu6502_run_until_pc(emu6502_machine *m, uint16_t pc, uint64_t max_cycles)
+{
+    return guarded<int>(EMU6502_STOP_ERROR,
+                        [&] { return with(m, [&](auto &mc) { return runUntilPc(mc, pc, max_cycles); }); });
+}
+
+void emu6502_run_frames_batch(emu6502_machine *const *machines, int *results, size_t count, uint32_t frames,
+                              uint64_t max_cycles)
+{
+    if (results)
+        for (size_t i = 0; i < count; ++i)
+            results[i] = EMU6502_STOP_ERROR; // until run
+    guarded([&]
+            {
+                // One pool for the process; parallelFor serialises concurrent callers
+                static ThreadPool pool;
+                auto runOne = [&](std::size_t i)
+                {
+                    int r = emu6502_run_frames(machines[i], frames, max_cycles);
+                    if (results)
+                        results[i] = r;
+                };
+                pool.parallelFor(count, runOne);
+            });
+}
+
+uint8_t emu6502_peek(const emu6502_machine *m, uint16_t addr)
+{
+    return guarded<uint8_t>(0xFF, [&] { return with(m, [&](const auto &mc) { return mc.mem.Peek(addr); }); });
+}
+
+void emu6502_poke(emu6502_machine *m, uint16_t addr, uint8_t value)
+{
+    guarded([&] { with(m, [&](auto &mc) { mc.mem.Write(addr, value); }); });
+}
+
+void emu6502_peek_block(const emu6502_machine *m, uint16_t addr, uint8_t *dst, size_t size)
+{
+    guarded([&]
+            {
+                with(m, [&](const auto &mc)
+                     {
+                         for (size_t i = 0; i < size; ++i)
+                             dst[i] = mc.mem.Peek(static_cast<uint16_t>(addr + i));
+                     });
+            });
+}
+
+void emu6502_poke_block(emu6502_machine *m, uint16_t addr, const uint8_t *src, size_t size)
+{
+    guarded([&]
+            {
+                with(m, [&](auto &mc)
+                     {
+                         for (size_t i = 0; i < size; ++i)
+                             mc.mem.Write(static_cast<uint16_t>(addr + i), src[i]);
+                     });
+            });
+}
+
+void emu6502_get_registers(const emu6502_machine *m, emu6502_registers *regs)
+{
+    guarded([&]
+            {
+                with(m, [&](const auto &mc)
+                     {
+                         regs->a = mc.cpu.A;
+                         regs->x = mc.cpu.X;
+                         regs->y = mc.cpu.Y;
+                         regs->sp = mc.cpu.SP;
+                         regs->p = mc.cpu.P.reg;
+                         regs->pc = mc.cpu.PC;
+                         regs->cycles = elapsed(mc);
+                         regs->instructions = mc.cpu.instructions;
+                     });
+            });
+}
+
+void emu6502_set_registers(emu6502_machine *m, const emu6502_registers *regs)
+{
+    guarded([&]
+            {
+                with(m, [&](auto &mc)
+                     {
+                         mc.cpu.A = regs->a;
+                         mc.cpu.X = regs->x;
+                         mc.cpu.Y = regs->y;
+                         mc.cpu.SP = regs->sp;
+                         mc.cpu.P.reg = regs->p;
+                         mc.cpu.PC = regs->pc;
+                     });
+            });
+}
+
+size_t emu6502_save_state(const emu6502_machine *m, uint8_t *buf, size_t capacity)
+{
+    return guarded<size_t>(0, [&]
+                           {
+                               std::vector<uint8_t> state = with(m, [](const auto &mc) { return mc.SaveState(); });
+                               if (buf && state.size() <= capacity)
+                                   std::memcpy(buf, state.data(), state.size());
+                               return state.size();
+                           });
+}
+
+int emu6502_load_state(emu6502_machine *m, const uint8_t *buf, size_t size)
+{
+    return guarded(0, [&] { return with(m, [&](auto &mc) { return mc.LoadState(buf, size); }) ? 1 : 0; });
+}
+
+int emu6502_enable_traps(emu6502_machine *m, const char *file_dir, void (*output)(void *ctx, uint8_t ch),
+                         void *ctx)
+{
+    return guarded(0, [&]
+                   {
+                       auto traps = std::make_shared<OsTraps>(static_cast<MachineType>(m->m.index()));
+                       if (traps->empty())
+                           return 0; // no OS to trap
+                       if (output)
+                           traps->host.output = Port<void(uint8_t)>(output, ctx);
+                       if (file_dir)
+                       {
+                           m->files = std::make_shared<HostDirectory>(file_dir);
+                           traps->host.open = Port<bool(const std::string &, OsFile &)>::bind<&HostDirectory::open>(m->files.get());
+                       }
+                       m->traps = traps;
+                       with(m, [&](auto &mc) { mc.mem.SetTraps(traps.get()); });
+                       return 1;
+                   });
+}
+
+int emu6502_set_trap_output(emu6502_machine *m, int mode)
+{
+    if (!m->traps || mode < EMU6502_OUTPUT_MIRROR || mode > EMU6502_OUTPUT_REPLACE)
+        return 0;
+    return guarded(0, [&]
+                   {
+                       // A copy, so forks keep the traps they were made with
+                       auto traps = std::make_shared<OsTraps>(*m->traps);
+                       traps->output = static_cast<OutputTrap>(mode);
+                       m->traps = traps;
+                       with(m, [&](auto &mc) { mc.mem.SetTraps(traps.get()); });
+                       return 1;
+                   });
+}
+
+int emu6502_enable_dfs_fast_load(emu6502_machine *m)
+{
+    return guarded<int>(0, [&]
+                        {
+                            if (static_cast<MachineType>(m->m.index()) != MachineType::BBCMicro)
+                                return 0;
+                            auto disk = std::make_shared<DfsCatalogue>();
+                            for (auto it = m->images.rbegin(); it != m->images.rend(); ++it)
+                            {
+                                ImageFormat format = detectImage(**it).format;
+                                if (format == ImageFormat::DfsSsd || format == ImageFormat::DfsDsd)
+                                {
+                                    if (!disk->read(*it, format == ImageFormat::DfsDsd))
+                                        return 0;
+                                    useDisk(m, disk);
+                                    return 1;
+                                }
+                            }
+                            return 0;
+                        });
+}
+
+int emu6502_set_disk_turbo(emu6502_machine *m, uint32_t factor)
+{
+    auto *bbc = std::get_if<Machine<MachineType::BBCMicro>>(&m->m);
+    if (!bbc)
+        return 0;
+    bbc->mem.disk.setTurbo(factor);
+    return 1;
+}
+
+int emu6502_set_disk_writes(emu6502_machine *m, int mode, const char *journal_path)
+{
+    return guarded<int>(0, [&]
+                        {
+                            auto *bbc = std::get_if<Machine<MachineType::BBCMicro>>(&m->m);
+                            if (!bbc || mode < EMU6502_DISK_PROTECT || mode > EMU6502_DISK_JOURNAL)
+                                return 0;
+                            DiskOverlay &overlay = bbc->mem.disk.overlay;
+                            overlay.setJournal(nullptr);
+                            m->journal.reset();
+                            if (mode == EMU6502_DISK_JOURNAL && journal_path)
+                            {
+                                auto journal = std::make_shared<DiskJournal>();
+                                DiskJournal::replay(journal_path, overlay);
+                                if (!journal->open(journal_path))
+                                    return 0;
+                                overlay.setJournal(journal.get());
+                                m->journal = journal;
+                            }
+                            overlay.setMode(static_cast<DiskWrites>(mode));
+                            return 1;
+                        });
+}
+
+int emu6502_boot(emu6502_machine *m, const char *cache_dir, const char *boot_point, uint64_t max_cycles)
+{
+    return guarded<int>(EMU6502_BOOT_FAILED, [&]
+                        {
+                            BootPoint point;
+                            if (!parseBootPoint(boot_point, point))
+                                return EMU6502_BOOT_FAILED;
+                            // One cache per directory and budget, kept for the process, so
+                            // machines booted in the same run share states in memory
+                            static std::mutex cachesMutex;
+                            static std::map<std::pair<std::string, uint64_t>, std::unique_ptr<BootCache>> caches;
+                            BootCache *cache;
+                            {
+                                std::lock_guard<std::mutex> lock(cachesMutex);
+                                auto &slot = caches[{cache_dir, max_cycles}];
+                                if (!slot)
+                                    slot.reset(new BootCache(cache_dir, max_cycles));
+                                cache = slot.get();
+                            }
+                            switch (with(m, [&](auto &mc) { return cache->boot(mc, m->images, point); }))
+                            {
+                            case BootCache::Outcome::Cached:
+                                return EMU6502_BOOT_CACHED;
+                            case BootCache::Outcome::Booted:
+                                return EMU6502_BOOT_RAN;
+                            default:
+                                return EMU6502_BOOT_FAILED;
+                            }
+                        });
+}
+
+int emu6502_suspend(const emu6502_machine *m, const char *path)
+{
+    return guarded<int>(0, [&]
+                        {
+                            SuspendFile file;
+                            if (!file.open(path))
+                                return 0;
+                            return with(m, [&](const auto &mc) { return file.suspend(mc); }) ? 1 : 0;
+                        });
+}
+
+int emu6502_resume(emu6502_machine *m, const char *path)
+{
+    return guarded<int>(0, [&]
+                        {
+                            SuspendFile file;
+                            if (!file.open(path))
+                                return 0;
+                            return with(m, [&](auto &mc) { return file.resume(mc); }) ? 1 : 0;
+                        });
+}
+
+void emu6502_get_frame(const emu6502_machine *m, emu6502_frame *frame)
+{
+    FrameView view = guarded(FrameView{}, [&] { return with(m, [](const auto &mc) { return mc.mem.Frame(); }); });
+    frame->pixels = view.pixels;
+    frame->width = view.width;
+    frame->height = view.height;
+    frame->stride = view.stride;
+    frame->sequence = view.sequence;
+}
+
+int emu6502_convert_frame(const emu6502_machine *m, int format, void *dst, size_t stride)
+{
+    if (format < EMU6502_PIXEL_INDEX8 || format > EMU6502_PIXEL_LUMA8)
+        return 0;
+    return guarded(0, [&]
+                   {
+                       return with(m, [&](const auto &mc)
+                                   {
+                                       FrameView view = mc.mem.Frame();
+                                       if (!view.pixels)
+                                           return 0;
+                                       mc.mem.FramePalette().convertFrame(view, static_cast<PixelFormat>(format), dst, stride);
+                                       return 1;
+                                   });
+                   });
+}
+
+} // extern "C"
@@ -0,0 +1,176 @@
+#include "dfs.h"
+#include "disk_overlay.h"
+#include <cctype>
+#include <cstring>
+
+static constexpr uint32_t SECTOR_SIZE = 256;
+static constexpr uint32_t SECTORS_PER_TRACK = 10;
+
+// 18-bit address from its low 16 bits and two high bits; &3xxxx is the
+// I/O processor, as &FFFFxxxx
+static uint32_t Address18(const uint8_t *low, uint8_t high)
+{
+    uint32_t a = static_cast<uint32_t>(low[0] | (low[1] << 8));
+    return high == 3 ? 0xFFFF0000u | a : (static_cast<uint32_t>(high) << 16) | a;
+}
+
+static std::string Trimmed(const uint8_t *text, std::size_t size)
+{
+    std::string s;
+    for (std::size_t i = 0; i < size; ++i)
+        s += static_cast<char>(text[i] & 0x7F);
+    std::size_t end = s.find_last_not_of(std::string(" \0", 2));
+    return end == std::string::npos ? std::string() : s.substr(0, end + 1);
+}
+
+const uint8_t *DfsCatalogue::sector(int side, uint32_t logical) const
+{
+    // DSD interleaves tracks: side 0 track 0, side 1 track 0, ...
+    uint32_t track = logical / SECTORS_PER_TRACK;
+    uint32_t index = doubleSided_ ? (track * 2 + side) * SECTORS_PER_TRACK + logical % SECTORS_PER_TRACK : logical;
+    if (overlay_)
+        if (const uint8_t *written = overlay_->find(index))
+            return written;
+    std::size_t offset = static_cast<std::size_t>(index) * SECTOR_SIZE;
+    return offset + SECTOR_SIZE <= image_->size() ? image_->data() + offset : nullptr;
+}
+
+bool DfsCatalogue::read(RomImage image, bool doubleSided)
+{
+    image_ = std::move(image);
+    doubleSided_ = doubleSided;
+    return parse();
+}
+
+bool DfsCatalogue::parse()
+{
+    for (int side = 0; side < 2; ++side)
+    {
+        sides_[side].clear();
+        titles_[side].clear();
+    }
+    std::memset(parsed_, 0, sizeof(parsed_));
+    if (!image_)
+        return false;
+
+    bool valid = true;
+    for (int side = 0; side < (doubleSided_ ? 2 : 1); ++side)
+    {
+        const uint8_t *names = sector(side, 0);
+        const uint8_t *info = sector(side, 1);
+        if (!names || !info)
+        {
+            valid = false;
+            continue;
+        }
+        std::memcpy(parsed_[side], names, SECTOR_SIZE);
+        std::memcpy(parsed_[side] + SECTOR_SIZE, info, SECTOR_SIZE);
+        if ((info[5] & 0x07) || info[5] > 31 * 8)
+            valid = false;
+    }
+    // The copies stay, so a catalogue the guest writes valid again is seen
+    if (!valid)
+        return false;
+
+    for (int side = 0; side < (doubleSided_ ? 2 : 1); ++side)
+    {
+        const uint8_t *names = parsed_[side];
+        const uint8_t *info = parsed_[side] + SECTOR_SIZE;
+        titles_[side] = Trimmed(names, 8) + Trimmed(info, 4);
+        for (int e = 8; e <= info[5]; e += 8)
+        {
+            const uint8_t *n = names + e, *a = info + e;
+            uint8_t high = a[6];
+            DfsEntry entry;
+            entry.name = Trimmed(n, 7);
+            entry.dir = static_cast<char>(n[7] & 0x7F);
+            entry.locked = (n[7] & 0x80) != 0;
+            entry.load = Address18(a, (high >> 2) & 3);
+            entry.exec = Address18(a + 2, (high >> 6) & 3);
+            entry.length = static_cast<uint32_t>(a[4] | (a[5] << 8) | (((high >> 4) & 3) << 16));
+            entry.startSector = static_cast<uint16_t>(a[7] | ((high & 3) << 8));
+            sides_[side].push_back(entry);
+        }
+    }
+    return true;
+}
+
+bool DfsCatalogue::catalogueChanged() const
+{
+    if (!overlay_ || !overlay_->sectors())
+        return false;
+    for (int side = 0; side < (doubleSided_ ? 2 : 1); ++side)
+    {
+        const uint8_t *names = sector(side, 0);
+        const uint8_t *info = sector(side, 1);
+        if (names && info &&
+            (std::memcmp(parsed_[side], names, SECTOR_SIZE) ||
+             std::memcmp(parsed_[side] + SECTOR_SIZE, info, SECTOR_SIZE)))
+            return true;
+    }
+    return false;
+}
+
+static bool SameName(const std::string &a, const std::string &b)
+{
+    if (a.size() != b.size())
+        return false;
+    for (std::size_t i = 0; i < a.size(); ++i)
+        if (std::toupper(static_cast<uint8_t>(a[i])) != std::toupper(static_cast<uint8_t>(b[i])))
+            return false;
+    return true;
+}
+
+bool DfsCatalogue::open(const std::string &name, OsFile &file)
+{
+    // A save, delete or *COMPACT since the last call rewrote it
+    if (catalogueChanged())
+        parse();
+
+    std::string rest = name;
+    int side = 0;
+    if (rest.size() > 2 && rest[0] == ':' && rest[2] == '.')
+    {
+        if (rest[1] != '0' && rest[1] != '2')
+            return false; // drives 1 and 3 are a second disk
+        side = rest[1] == '2';
+        rest = rest.substr(3);
+    }
+    char dir = '$';
+    if (rest.size() > 2 && rest[1] == '.')
+    {
+        dir = rest[0];
+        rest = rest.substr(2);
+    }
+
+    for (const DfsEntry &e : sides_[side])
+    {
+        if (std::toupper(static_cast<uint8_t>(e.dir)) != std::toupper(static_cast<uint8_t>(dir)) ||
+            !SameName(e.name, rest))
+            continue;
+        // Files are contiguous from their start sector
+        file = OsFile();
+        for (uint32_t done = 0; done < e.length; done += SECTOR_SIZE)
+        {
+            const uint8_t *s = sector(side, e.startSector + done / SECTOR_SIZE);
+            if (!s)
+                return false; // runs off a truncated image
+            uint32_t n = e.length - done < SECTOR_SIZE ? e.length - done : SECTOR_SIZE;
+            file.data.insert(file.data.end(), s, s + n);
+        }
+        file.load = e.load;
+        file.exec = e.exec;
+        file.hasAddresses = true;
+        return true;
+    }
+    return false;
+}
+
+void enableDfsFastLoad(OsTraps &traps, DfsCatalogue &disk, uint32_t cycles)
+{
+    traps.host.open = Port<bool(const std::string &, OsFile &)>::bind<&DfsCatalogue::open>(&disk);
+    // The DFS points FILEV at its own code, so OSFILE skips the vector
+    // test; CLIV stays the MOS's and keeps it
+    traps.add(0xFFDD, OsCall::Osfile, cycles);
+    traps.add(0xFFF7, OsCall::Oscli, cycles, 0x0208);
+}
@@ -0,0 +1,256 @@
+#include "disk_overlay.h"
+#include "state_archive.h"
+#include <chrono>
+#include <cstring>
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+static constexpr int DISK_WRITES_COUNT = 4;
+static const char *const DISK_WRITES_NAMES[DISK_WRITES_COUNT] = {"protect", "discard", "memory", "journal"};
+
+const char *diskWritesName(DiskWrites mode)
+{
+    int i = static_cast<int>(mode);
+    return i < DISK_WRITES_COUNT ? DISK_WRITES_NAMES[i] : "unknown";
+}
+
+bool parseDiskWrites(const std::string &name, DiskWrites &mode)
+{
+    for (int i = 0; i < DISK_WRITES_COUNT; ++i)
+    {
+        if (name == DISK_WRITES_NAMES[i])
+        {
+            mode = static_cast<DiskWrites>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+// DiskOverlay
+// ------------------------------------------------------------
+
+DiskOverlay &DiskOverlay::operator=(const DiskOverlay &other)
+{
+    mode_ = other.mode_;
+    sectors_ = other.sectors_; // keeps its own journal
+    return *this;
+}
+
+const uint8_t *DiskOverlay::find(uint32_t sector) const
+{
+    if (sectors_.empty())
+        return nullptr;
+    auto it = sectors_.find(sector);
+    return it == sectors_.end() ? nullptr : it->second->bytes;
+}
+
+void DiskOverlay::write(uint32_t sector, const uint8_t *bytes)
+{
+    if (mode_ == DiskWrites::Protect || mode_ == DiskWrites::Discard)
+        return;
+    put(sector, bytes);
+    if (mode_ == DiskWrites::Journal && journal_)
+    {
+        journal_->append(sector, bytes);
+        journalBacklog_ = journal_->backlog() != 0;
+    }
+}
+
+void DiskOverlay::flushJournal()
+{
+    if (journal_)
+        journal_->flushBacklog();
+    journalBacklog_ = journal_ && journal_->backlog() != 0;
+}
+
+void DiskOverlay::put(uint32_t sector, const uint8_t *bytes)
+{
+    // A new block: a fork holding the old one keeps it
+    auto block = std::make_shared<DiskSector>();
+    std::memcpy(block->bytes, bytes, sizeof(block->bytes));
+    sectors_[sector] = std::move(block);
+}
+
+void DiskOverlay::serialize(StateArchive &ar)
+{
+    uint32_t count = static_cast<uint32_t>(sectors_.size());
+    ar.io(count);
+    if (ar.saving())
+    {
+        for (auto &entry : sectors_)
+        {
+            uint32_t sector = entry.first;
+            ar.io(sector);
+            ar.bytes(const_cast<uint8_t *>(entry.second->bytes), sizeof(DiskSector));
+        }
+        return;
+    }
+    sectors_.clear();
+    for (uint32_t i = 0; i < count && ar.ok(); ++i)
+    {
+        uint32_t sector = 0;
+        DiskSector data;
+        ar.io(sector);
+        ar.bytes(data.bytes, sizeof(data.bytes));
+        if (ar.ok())
+            put(sector, data.bytes);
+    }
+}
+
+// DiskJournal
+// ------------------------------------------------------------
+
+// File layout: the magic, then records of a little-endian sector number
+// and the sector's 256 bytes, in the order they were written
+static const char JOURNAL_MAGIC[8] = {'6', '5', '0', '2', 'J', 'R', 'N', 'L'};
+static constexpr std::size_t RECORD_BYTES = 4 + sizeof(DiskSector);
+
+// The writer re-checks for records at least this often
+static constexpr auto IDLE_POLL = std::chrono::milliseconds(10);
+
+DiskJournal::~DiskJournal()
+{
+    close();
+}
+
+bool DiskJournal::open(const std::string &path)
+{
+    close();
+    std::FILE *f = std::fopen(path.c_str(), "ab+");
+    if (!f)
+        return false;
+    std::fseek(f, 0, SEEK_END);
+    long size = std::ftell(f);
+    char magic[sizeof(JOURNAL_MAGIC)];
+    if (size == 0)
+    {
+        std::fwrite(JOURNAL_MAGIC, 1, sizeof(JOURNAL_MAGIC), f);
+    }
+    else
+    {
+        std::fseek(f, 0, SEEK_SET);
+        if (std::fread(magic, 1, sizeof(magic), f) != sizeof(magic) ||
+            std::memcmp(magic, JOURNAL_MAGIC, sizeof(magic)) != 0)
+        {
+            std::fclose(f);
+            return false; // something else: leave it alone
+        }
+        // Cut a record torn by a crash, or the records appended after it
+        // would be read out of step
+        long whole = static_cast<long>(sizeof(JOURNAL_MAGIC) +
+                                       (size - sizeof(JOURNAL_MAGIC)) / RECORD_BYTES * RECORD_BYTES);
+        std::fflush(f);
+#if defined(_WIN32)
+        bool cut = whole == size || _chsize_s(_fileno(f), whole) == 0;
+#else
+        bool cut = whole == size || ftruncate(fileno(f), static_cast<off_t>(whole)) == 0;
+#endif
+        if (!cut)
+        {
+            std::fclose(f);
+            return false;
+        }
+        std::fseek(f, 0, SEEK_END);
+    }
+    std::fflush(f);
+    file_ = f;
+    backlog_.clear();
+    stopping_.store(false);
+    writer_ = std::thread(&DiskJournal::writerLoop, this);
+    return true;
+}
+
+void DiskJournal::close()
+{
+    if (!file_)
+        return;
+    stopping_.store(true, std::memory_order_release);
+    writer_.join();
+    // The ring is empty and the writer gone: the backlog follows directly
+    for (const auto &pending : backlog_)
+        writeRecord(Record{pending.first, pending.second});
+    backlog_.clear();
+    std::fclose(file_);
+    file_ = nullptr;
+}
+
+bool DiskJournal::append(uint32_t sector, const uint8_t *bytes)
+{
+    if (!file_)
+        return false;
+    // Backlogged sectors go first, so a newer write never lands in the
+    // file before an older one
+    flushBacklog();
+    if (backlog_.empty())
+    {
+        Record record;
+        record.sector = sector;
+        std::memcpy(record.data.bytes, bytes, sizeof(record.data.bytes));
+        if (ring_.write(&record, 1) == 1)
+            return true;
+    }
+    std::memcpy(backlog_[sector].bytes, bytes, sizeof(DiskSector));
+    return true;
+}
+
+void DiskJournal::flushBacklog()
+{
+    while (!backlog_.empty())
+    {
+        auto it = backlog_.begin();
+        Record record{it->first, it->second};
+        if (ring_.write(&record, 1) != 1)
+            return;
+        backlog_.erase(it);
+    }
+}
+
+void DiskJournal::writeRecord(const Record &record)
+{
+    uint8_t out[RECORD_BYTES];
+    for (int b = 0; b < 4; ++b)
+        out[b] = static_cast<uint8_t>(record.sector >> (8 * b));
+    std::memcpy(out + 4, record.data.bytes, sizeof(DiskSector));
+    std::fwrite(out, 1, sizeof(out), file_);
+}
+
+void DiskJournal::writerLoop()
+{
+    Record batch[16];
+    for (;;)
+    {
+        bool stopping = stopping_.load(std::memory_order_acquire);
+        std::size_t n = ring_.read(batch, 16);
+        for (std::size_t i = 0; i < n; ++i)
+            writeRecord(batch[i]);
+        if (n > 0)
+            std::fflush(file_);
+        else if (stopping)
+            return; // stopping was seen before the ring came up empty
+        else
+            std::this_thread::sleep_for(IDLE_POLL);
+    }
+}
+
+bool DiskJournal::replay(const std::string &path, DiskOverlay &overlay)
+{
+    std::FILE *f = std::fopen(path.c_str(), "rb");
+    if (!f)
+        return false;
+    char magic[sizeof(JOURNAL_MAGIC)];
+    bool ok = std::fread(magic, 1, sizeof(magic), f) == sizeof(magic) &&
+              std::memcmp(magic, JOURNAL_MAGIC, sizeof(magic)) == 0;
+    uint8_t record[RECORD_BYTES];
+    while (ok && std::fread(record, 1, sizeof(record), f) == sizeof(record)) // a torn last record is skipped
+    {
+        uint32_t sector = static_cast<uint32_t>(record[0] | (record[1] << 8) | (record[2] << 16)) |
+                          (static_cast<uint32_t>(record[3]) << 24);
+        overlay.put(sector, record + 4);
+    }
+    std::fclose(f);
+    return ok;
+}
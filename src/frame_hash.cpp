@@ -0,0 +1,75 @@
+#include "frame_hash.h"
+#include "hash64.h"
+#include "memory.h"
+#include <cstring>
+
+static constexpr char LOG_MAGIC[8] = {'6', '5', '0', '2', 'F', 'H', 'L', '1'};
+
+uint64_t hashFrame(const FrameView &frame)
+{
+    return frame.pixels ? hash64(frame.pixels, frame.bytes()) : 0;
+}
+
+FrameHashLog::~FrameHashLog()
+{
+    close();
+}
+
+bool FrameHashLog::openOutput(const std::string &path)
+{
+    close();
+    out_ = std::fopen(path.c_str(), "wb");
+    if (!out_)
+        return false;
+    std::fwrite(LOG_MAGIC, 1, sizeof(LOG_MAGIC), out_);
+    return true;
+}
+
+bool FrameHashLog::loadGolden(const std::string &path)
+{
+    golden_.clear();
+    std::FILE *in = std::fopen(path.c_str(), "rb");
+    if (!in)
+        return false;
+
+    char magic[sizeof(LOG_MAGIC)];
+    bool ok = std::fread(magic, 1, sizeof(magic), in) == sizeof(magic) &&
+              std::memcmp(magic, LOG_MAGIC, sizeof(magic)) == 0;
+    FrameHashRecord rec;
+    while (ok && std::fread(&rec, sizeof(rec), 1, in) == 1)
+        golden_.push_back(rec);
+    std::fclose(in);
+
+    checked_ = 0;
+    diverged_ = false;
+    return ok;
+}
+
+void FrameHashLog::close()
+{
+    if (out_)
+    {
+        std::fclose(out_);
+        out_ = nullptr;
+    }
+}
+
+bool FrameHashLog::record(const FrameHashRecord &rec)
+{
+    if (out_)
+        std::fwrite(&rec, sizeof(rec), 1, out_);
+
+    if (golden_.empty() || diverged_)
+        return !diverged_;
+
+    // Golden logs are compared in order, frame by frame
+    const FrameHashRecord *want = checked_ < golden_.size() ? &golden_[checked_] : nullptr;
+    checked_++;
+    if (want && want->frameHash == rec.frameHash && want->ramHash == rec.ramHash)
+        return true;
+
+    diverged_ = true;
+    mismatch_ = rec;
+    expected_ = want ? *want : FrameHashRecord{};
+    return false;
+}
@@ -0,0 +1,92 @@
+#include "framebuffer.h"
+#include "state_archive.h"
+#include <algorithm>
+
+FrameBuffer::FrameBuffer(int width, int height)
+    : width_(width),
+      height_(height),
+      stride_((width + RowAlign - 1) / RowAlign * RowAlign),
+      frameBytes_(static_cast<std::size_t>(stride_) * height)
+{
+    storage_ = std::allocate_shared<Storage>(PoolAllocator<Storage>(), frameBytes_ * 2, 0);
+    backOffset_ = frameBytes_;
+}
+
+FrameBuffer::FrameBuffer(const FrameBuffer &other)
+    : width_(other.width_),
+      height_(other.height_),
+      stride_(other.stride_),
+      frameBytes_(other.frameBytes_),
+      storage_(other.storage_),
+      frontOffset_(other.frontOffset_.load(std::memory_order_relaxed)),
+      backOffset_(other.backOffset_),
+      sequence_(other.sequence_.load(std::memory_order_relaxed))
+{
+}
+
+FrameBuffer &FrameBuffer::operator=(const FrameBuffer &other)
+{
+    width_ = other.width_;
+    height_ = other.height_;
+    stride_ = other.stride_;
+    frameBytes_ = other.frameBytes_;
+    storage_ = other.storage_;
+    frontOffset_.store(other.frontOffset_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    backOffset_ = other.backOffset_;
+    sequence_.store(other.sequence_.load(std::memory_order_relaxed), std::memory_order_release);
+    return *this;
+}
+
+void FrameBuffer::clear()
+{
+    if (storage_.use_count() != 1)
+        storage_ = std::allocate_shared<Storage>(PoolAllocator<Storage>(), frameBytes_ * 2, 0);
+    else
+        std::fill(storage_->begin(), storage_->end(), 0);
+    sequence_.store(0, std::memory_order_release);
+}
+
+void FrameBuffer::swap()
+{
+    std::size_t front = backOffset_;
+    backOffset_ = frontOffset_.load(std::memory_order_relaxed);
+    frontOffset_.store(front, std::memory_order_relaxed);
+    sequence_.fetch_add(1, std::memory_order_release);
+    // Pairs with the acquire fence in unchangedSince: a reader that saw
+    // any pixel drawn after this swap sees the new sequence
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+void FrameBuffer::unshare()
+{
+    storage_ = std::allocate_shared<Storage>(PoolAllocator<Storage>(), *storage_);
+}
+
+FrameView FrameBuffer::front() const
+{
+    FrameView v;
+    v.sequence = sequence_.load(std::memory_order_acquire);
+    v.pixels = storage_->data() + frontOffset_.load(std::memory_order_relaxed);
+    v.width = width_;
+    v.height = height_;
+    v.stride = stride_;
+    return v;
+}
+
+void FrameBuffer::serialize(StateArchive &ar)
+{
+    // Geometry is fixed at construction; only the pixels and which half
+    // is in front are state
+    if (ar.frames())
+        ar.bytes(ar.loading() ? writable() : storage_->data(), storage_->size());
+    std::size_t front = frontOffset_.load(std::memory_order_relaxed);
+    uint64_t sequence = sequence_.load(std::memory_order_relaxed);
+    ar.io(front);
+    ar.io(backOffset_);
+    ar.io(sequence);
+    if (ar.loading())
+    {
+        frontOffset_.store(front, std::memory_order_relaxed);
+        sequence_.store(sequence, std::memory_order_release);
+    }
+}
@@ -0,0 +1,117 @@
+#include "image.h"
+#include <cstdio>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Maps the whole file read-only; nullptr (and size 0) on any failure
+static void *MapFile(const std::string &path, std::size_t &size, FileId &id)
+{
+    size = 0;
+#if defined(_WIN32)
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return nullptr;
+    LARGE_INTEGER length;
+    BY_HANDLE_FILE_INFORMATION info;
+    void *base = nullptr;
+    if (GetFileSizeEx(file, &length) && length.QuadPart > 0 && GetFileInformationByHandle(file, &info))
+    {
+        id.device = info.dwVolumeSerialNumber;
+        id.inode = static_cast<uint64_t>(info.nFileIndexHigh) << 32 | info.nFileIndexLow;
+        id.size = static_cast<uint64_t>(length.QuadPart);
+        id.mtime = static_cast<uint64_t>(info.ftLastWriteTime.dwHighDateTime) << 32 | info.ftLastWriteTime.dwLowDateTime;
+        HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping)
+        {
+            base = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            CloseHandle(mapping); // the view keeps it alive
+        }
+        if (base)
+            size = static_cast<std::size_t>(length.QuadPart);
+    }
+    CloseHandle(file);
+    return base;
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return nullptr;
+    struct stat st;
+    void *base = nullptr;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+    {
+        id.device = static_cast<uint64_t>(st.st_dev);
+        id.inode = static_cast<uint64_t>(st.st_ino);
+        id.size = static_cast<uint64_t>(st.st_size);
+#if defined(__APPLE__)
+        id.mtime = static_cast<uint64_t>(st.st_mtimespec.tv_sec) * 1000000000u + st.st_mtimespec.tv_nsec;
+#else
+        id.mtime = static_cast<uint64_t>(st.st_mtim.tv_sec) * 1000000000u + st.st_mtim.tv_nsec;
+#endif
+        base = mmap(nullptr, static_cast<std::size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+        if (base == MAP_FAILED)
+            base = nullptr;
+        else
+            size = static_cast<std::size_t>(st.st_size);
+    }
+    close(fd); // the mapping keeps the file
+    return base;
+#endif
+}
+
+static void UnmapFile(void *base, std::size_t size)
+{
+#if defined(_WIN32)
+    (void)size;
+    UnmapViewOfFile(base);
+#else
+    munmap(base, size);
+#endif
+}
+
+std::shared_ptr<const Image> Image::map(const std::string &path)
+{
+    std::shared_ptr<Image> image(new Image());
+    image->path_ = path;
+    image->mapping_ = MapFile(path, image->size_, image->fileId_);
+    if (image->mapping_)
+    {
+        image->data_ = static_cast<const uint8_t *>(image->mapping_);
+        return image;
+    }
+
+    std::FILE *in = std::fopen(path.c_str(), "rb");
+    if (!in)
+        return nullptr;
+    uint8_t chunk[4096];
+    std::size_t n;
+    while ((n = std::fread(chunk, 1, sizeof(chunk), in)) > 0)
+        image->bytes_.insert(image->bytes_.end(), chunk, chunk + n);
+    std::fclose(in);
+    image->data_ = image->bytes_.data();
+    image->size_ = image->bytes_.size();
+    return image;
+}
+
+std::shared_ptr<const Image> Image::fromBytes(std::vector<uint8_t> bytes)
+{
+    std::shared_ptr<Image> image(new Image());
+    image->bytes_ = std::move(bytes);
+    image->data_ = image->bytes_.data();
+    image->size_ = image->bytes_.size();
+    return image;
+}
+
+Image::~Image()
+{
+    if (mapping_)
+        UnmapFile(mapping_, size_);
+}
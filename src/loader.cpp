@@ -0,0 +1,213 @@
+#include "loader.h"
+#include "hash64.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+static constexpr int IMAGE_FORMAT_COUNT = 7;
+static const char *const IMAGE_FORMAT_NAMES[IMAGE_FORMAT_COUNT] = {"unknown", "raw", "prg", "a26", "rom", "ssd", "dsd"};
+
+const char *imageFormatName(ImageFormat format)
+{
+    int i = static_cast<int>(format);
+    return i < IMAGE_FORMAT_COUNT ? IMAGE_FORMAT_NAMES[i] : "unknown";
+}
+
+bool parseImageFormat(const std::string &name, ImageFormat &format)
+{
+    for (int i = 0; i < IMAGE_FORMAT_COUNT; ++i)
+    {
+        if (name == IMAGE_FORMAT_NAMES[i])
+        {
+            format = static_cast<ImageFormat>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Database
+// ------------------------------------------------------------
+
+static std::mutex databaseMutex;
+static std::vector<KnownImage> database;
+
+void addKnownImage(const KnownImage &entry)
+{
+    std::lock_guard<std::mutex> lock(databaseMutex);
+    database.push_back(entry);
+}
+
+int loadImageDatabase(const std::string &path)
+{
+    std::FILE *in = std::fopen(path.c_str(), "r");
+    if (!in)
+        return -1;
+    int added = 0;
+    char line[512];
+    while (std::fgets(line, sizeof(line), in))
+    {
+        char formatName[16], schemeName[16];
+        unsigned long long hash, size;
+        int consumed = 0;
+        if (line[0] == '#' ||
+            std::sscanf(line, "%llx %llu %15s %15s %n", &hash, &size, formatName, schemeName, &consumed) < 4)
+            continue;
+        KnownImage entry{hash, size, ImageFormat::Unknown, CartScheme::Auto, std::string(line + consumed)};
+        if (!parseImageFormat(formatName, entry.format) || !parseCartScheme(schemeName, entry.scheme))
+            continue;
+        while (!entry.name.empty() && std::isspace(static_cast<unsigned char>(entry.name.back())))
+            entry.name.pop_back();
+        addKnownImage(entry);
+        ++added;
+    }
+    std::fclose(in);
+    return added;
+}
+
+// The image is hashed only if some entry has its size
+static bool lookUp(const Image &image, KnownImage &found)
+{
+    std::lock_guard<std::mutex> lock(databaseMutex);
+    bool hashed = false;
+    uint64_t hash = 0;
+    for (const KnownImage &entry : database)
+    {
+        if (entry.size != image.size())
+            continue;
+        if (!hashed)
+        {
+            hash = hash64(image.data(), image.size());
+            hashed = true;
+        }
+        if (entry.hash == hash)
+        {
+            found = entry;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Detection
+// ------------------------------------------------------------
+
+static std::string extension(const std::string &path)
+{
+    std::size_t dot = path.find_last_of('.');
+    if (dot == std::string::npos || path.find_first_of("/\\", dot) != std::string::npos)
+        return {};
+    std::string ext = path.substr(dot + 1);
+    for (char &c : ext)
+        c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    return ext;
+}
+
+static int countPattern(const Image &image, const uint8_t *pattern, std::size_t length, int enough)
+{
+    int count = 0;
+    const uint8_t *end = image.data() + image.size();
+    for (const uint8_t *p = image.data(); count < enough; ++p)
+    {
+        p = std::search(p, end, pattern, pattern + length);
+        if (p == end)
+            break;
+        ++count;
+    }
+    return count;
+}
+
+CartScheme detectCartScheme(const Image &image)
+{
+    if (image.size() == 0x2000)
+    {
+        // JSR into the other bank's $D000/$F000 copy: FE
+        static const uint8_t fe[][5] = {{0x20, 0x00, 0xD0, 0xC6, 0xC5},
+                                        {0x20, 0xC3, 0xF8, 0xA5, 0x82},
+                                        {0xD0, 0xFB, 0x20, 0x73, 0xFE},
+                                        {0x20, 0x00, 0xF0, 0x84, 0xD6}};
+        for (const auto &p : fe)
+            if (countPattern(image, p, sizeof(p), 1))
+                return CartScheme::ActivisionFE;
+        // Accesses to a $1FE0-$1FF7 segment hotspot: E0
+        static const uint8_t e0[][3] = {{0x8D, 0xE0, 0x1F}, {0x8D, 0xE0, 0x5F}, {0x8D, 0xE9, 0xFF},
+                                        {0x0C, 0xE0, 0x1F}, {0xAD, 0xE0, 0x1F}, {0xAD, 0xE9, 0xFF},
+                                        {0xAD, 0xED, 0xFF}, {0xAD, 0xF3, 0xBF}};
+        for (const auto &p : e0)
+            if (countPattern(image, p, sizeof(p), 1))
+                return CartScheme::E0;
+    }
+    // STA $3F, more than once: 3F
+    static const uint8_t sta3f[] = {0x85, 0x3F};
+    if (image.size() >= 0x2000 && image.size() % 0x800 == 0 && countPattern(image, sta3f, sizeof(sta3f), 2) == 2)
+        return CartScheme::Tigervision3F;
+    return guessCartScheme(image.size());
+}
+
+// A DFS catalogue in sectors 0-1: file count * 8 at $105, sector count
+// in $106 (bits 0-1) and $107, 400 or 800 for 40 or 80 tracks
+static bool hasDfsCatalogue(const Image &image, uint32_t &sectors)
+{
+    if (image.size() < 0x200 || image.size() % 0x100 != 0)
+        return false;
+    const uint8_t *b = image.data();
+    sectors = ((b[0x106] & 0x03) << 8) | b[0x107];
+    return (b[0x105] & 0x07) == 0 && b[0x105] <= 31 * 8 && (sectors == 400 || sectors == 800);
+}
+
+// Acorn paged ROM: byte 7 points at "\0(C)"
+static bool hasSidewaysHeader(const Image &image)
+{
+    if (image.size() < 0x100 || image.size() > SidewaysRoms::SlotSize)
+        return false;
+    const uint8_t *b = image.data();
+    std::size_t c = b[7];
+    return c + 4 <= image.size() && std::memcmp(b + c, "\0(C)", 4) == 0;
+}
+
+static bool isCartridgeSize(std::size_t size)
+{
+    return size == 0x800 || (size >= 0x1000 && size <= 256 * 0x800 && size % 0x800 == 0);
+}
+
+ImageInfo detectImage(const Image &image)
+{
+    ImageInfo info;
+    KnownImage known;
+    if (lookUp(image, known))
+    {
+        info.format = known.format;
+        info.scheme = known.scheme;
+        info.name = known.name;
+        if (info.format == ImageFormat::Prg && image.size() >= 2)
+            info.loadAddr = static_cast<uint16_t>(image.data()[0] | (image.data()[1] << 8));
+        return info;
+    }
+
+    std::string ext = extension(image.path());
+    uint32_t sectors = 0;
+    if (ext == "prg" && image.size() >= 2)
+    {
+        info.format = ImageFormat::Prg;
+        info.loadAddr = static_cast<uint16_t>(image.data()[0] | (image.data()[1] << 8));
+    }
+    else if (hasDfsCatalogue(image, sectors))
+    {
+        bool twoSided = ext == "dsd" || (ext != "ssd" && image.size() > sectors * 0x100);
+        info.format = twoSided ? ImageFormat::DfsDsd : ImageFormat::DfsSsd;
+    }
+    else if (hasSidewaysHeader(image))
+    {
+        info.format = ImageFormat::SidewaysRom;
+    }
+    else if (ext == "a26" || (ext == "bin" && isCartridgeSize(image.size())))
+    {
+        info.format = ImageFormat::Cart2600;
+        info.scheme = detectCartScheme(image);
+    }
+    return info;
+}
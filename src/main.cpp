@@ -0,0 +1,285 @@
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <variant>
+#include "../include/boot_cache.h"
+#include "../include/dfs.h"
+#include "../include/disk_overlay.h"
+#include "../include/frame_hash.h"
+#include "../include/loader.h"
+#include "../include/machine.h"
+#include "../include/os_traps.h"
+#include "../include/rom_store.h"
+#include "../include/suspend_file.h"
+
+// Hashes every completed frame; stops the run at the first frame that
+// differs from the golden log. Suspends to the state file every
+// suspendEvery frames.
+template <class MachineT>
+struct FrameHook
+{
+    MachineT *machine;
+    FrameHashLog *log;
+    bool hashing;
+    SuspendFile *suspend;
+    uint32_t suspendEvery;
+    uint32_t frames = 0;
+
+    void OnFrame()
+    {
+        if (hashing && !log->capture(machine->mem))
+            machine->cpu.running = false;
+        if (suspendEvery && ++frames % suspendEvery == 0)
+            suspend->suspend(*machine);
+    }
+};
+
+// Trapped OS output on stdout: BBC lines end LF CR, Commodore ones CR
+struct ConsoleOutput
+{
+    uint8_t last = 0;
+
+    void Put(uint8_t c)
+    {
+        if (c == '\r' && last != '\n')
+            std::cout << '\n';
+        else if (c == '\n' || (c >= 0x20 && c < 0x7F))
+            std::cout << static_cast<char>(c);
+        last = c;
+    }
+};
+
+// Everything the command line sets
+struct Options
+{
+    MachineType type = MachineType::Generic;
+    FrameHashLog hashLog;
+    bool hashing = false;
+    RomImage image;
+    ImageInfo imageInfo; // detected from the file named, before interning
+    uint16_t imageAddr = 0x8000;
+    SuspendFile stateFile;
+    uint32_t suspendEvery = 0;
+    std::unique_ptr<BootCache> bootCache;
+    BootPoint bootPoint;
+    bool hle = false;
+    std::string hleDir;
+    OutputTrap hleOutput = OutputTrap::Mirror;
+    bool fastLoad = false;
+    uint32_t diskTurbo = 1;
+    DiskWrites diskWrites = DiskWrites::Protect;
+    std::string diskJournal;
+};
+
+template <class MachineT>
+static bool Run(MachineT &m, Options &opt)
+{
+    OsTraps traps(MachineT::type);
+    HostDirectory files(opt.hleDir);
+    DfsCatalogue disk;
+    ConsoleOutput console;
+    if (opt.hle)
+    {
+        traps.host.output = Port<void(uint8_t)>::bind<&ConsoleOutput::Put>(&console);
+        traps.host.open = Port<bool(const std::string &, OsFile &)>::bind<&HostDirectory::open>(&files);
+        traps.output = opt.hleOutput;
+        m.mem.SetTraps(&traps);
+    }
+
+    if constexpr (MachineT::type == MachineType::BBCMicro)
+        m.mem.disk.setTurbo(opt.diskTurbo);
+
+    if (opt.image)
+    {
+        const ImageInfo &info = opt.imageInfo;
+        if (!insertImage(m, opt.image, info, opt.imageAddr))
+        {
+            std::cerr << "No place for a " << imageFormatName(info.format) << " image on "
+                      << machineTypeName(MachineT::type) << "\n";
+            return false;
+        }
+        if (opt.fastLoad && MachineT::type == MachineType::BBCMicro &&
+            (info.format == ImageFormat::DfsSsd || info.format == ImageFormat::DfsDsd) &&
+            disk.read(opt.image, info.format == ImageFormat::DfsDsd))
+        {
+            enableDfsFastLoad(traps, disk);
+            m.mem.SetTraps(&traps);
+        }
+    }
+    else
+    {
+        uint16_t startAddr = 0x8000;
+        // Simple test program: LDA #$42; STA $0200; BRK
+        const uint8_t program[] = {0xA9, 0x42, 0x8D, 0x00, 0x02, 0x00};
+        m.mem.Load(startAddr, program, sizeof(program));
+    }
+
+    // Disk writes; a journal carries on from the sectors already in it
+    DiskJournal journal;
+    if constexpr (MachineT::type == MachineType::BBCMicro)
+    {
+        m.mem.disk.overlay.setMode(opt.diskWrites);
+        disk.setOverlay(&m.mem.disk.overlay);
+        if (!opt.diskJournal.empty())
+        {
+            DiskJournal::replay(opt.diskJournal, m.mem.disk.overlay);
+            if (!journal.open(opt.diskJournal))
+            {
+                std::cerr << "Cannot open " << opt.diskJournal << "\n";
+                return false;
+            }
+            m.mem.disk.overlay.setJournal(&journal);
+        }
+    }
+
+    // Images are in place: carry on from the last suspend, else boot,
+    // from the boot cache if it has this boot
+    if (!opt.stateFile.resume(m))
+    {
+        if (!opt.bootCache)
+            m.Reset();
+        else if (opt.bootCache->boot(m, {opt.image}, opt.bootPoint) == BootCache::Outcome::NotReached)
+            std::cerr << "Boot point " << bootPointName(opt.bootPoint) << " not reached\n";
+    }
+
+    // Frames are hashed from here on, so a cached boot hashes the same
+    // frames as a full one
+    FrameHook<MachineT> hook{&m, &opt.hashLog, opt.hashing, &opt.stateFile,
+                             opt.stateFile.isOpen() ? opt.suspendEvery : 0};
+    if (hook.hashing || hook.suspendEvery)
+        m.cpu.onFrame = Port<void()>::bind<&FrameHook<MachineT>::OnFrame>(&hook);
+
+    m.cpu.Run();
+    if (opt.stateFile.isOpen() && !opt.stateFile.suspend(m))
+        std::cerr << "Cannot suspend to the state file\n";
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    // --machine <profile>: generic (default), 2600, vic20, bbc, pet, plus4
+    // --hash-log <file>:   write per-frame hashes
+    // --golden <file>:     compare against a previous hash log
+    // --image <file>:      ROM, cartridge, program or disk image to run,
+    //                      in place of the built-in test program
+    // --load <hex addr>:   where a raw image is mapped (default $8000)
+    // --image-db <file>:   extra image database entries
+    // --state-file <file>: resume from the last suspend in this file
+    //                      instead of booting, and suspend to it on exit
+    // --suspend-every <n>: also suspend every n frames
+    // --boot-cache <dir>:  start from the cached state of this boot if
+    //                      there is one, else boot and cache it
+    // --boot-point <spec>: where the boot ends: frames:<n> (default
+    //                      frames:1), pc:<hex> or cycles:<n>
+    // --hle <dir>:         run OS character output and file loads
+    //                      natively, printing to stdout and loading
+    //                      files from dir (see os_traps.h)
+    // --hle-output <mode>: mirror (default: the ROM still draws every
+    //                      character) or replace (printable characters
+    //                      skip the ROM and the screen)
+    // --fast-load:         load files from a BBC disk image straight
+    //                      into RAM instead of through the 1770 (dfs.h)
+    // --disk-turbo <n>:    run the BBC disk drive n times faster than
+    //                      real time (see wd1770.h)
+    // --disk-writes <mode>: protect (default), discard, memory or journal
+    //                      (see disk_overlay.h)
+    // --disk-journal <file>: keep BBC disk writes in this journal,
+    //                      loading the ones already there
+    Options opt;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--fast-load")
+        {
+            opt.fastLoad = true;
+            continue;
+        }
+        if (i + 1 == argc)
+            break; // every other option takes a value
+        if (arg == "--machine" && !parseMachineType(argv[++i], opt.type))
+        {
+            std::cerr << "Unknown machine: " << argv[i] << "\n";
+            return 2;
+        }
+        else if (arg == "--hash-log" && !(opt.hashing = opt.hashLog.openOutput(argv[++i])))
+        {
+            std::cerr << "Cannot open " << argv[i] << "\n";
+            return 2;
+        }
+        else if (arg == "--golden" && !(opt.hashing = opt.hashLog.loadGolden(argv[++i])))
+        {
+            std::cerr << "Cannot open " << argv[i] << "\n";
+            return 2;
+        }
+        else if (arg == "--image")
+        {
+            RomImage image = Image::map(argv[++i]);
+            if (!image)
+            {
+                std::cerr << "Cannot open " << argv[i] << "\n";
+                return 2;
+            }
+            opt.imageInfo = detectImage(*image);
+            opt.image = internImage(image);
+        }
+        else if (arg == "--load")
+            opt.imageAddr = static_cast<uint16_t>(std::strtoul(argv[++i], nullptr, 16));
+        else if (arg == "--image-db" && loadImageDatabase(argv[++i]) < 0)
+        {
+            std::cerr << "Cannot open " << argv[i] << "\n";
+            return 2;
+        }
+        else if (arg == "--state-file" && !opt.stateFile.open(argv[++i]))
+        {
+            std::cerr << "Cannot open " << argv[i] << " as a state file\n";
+            return 2;
+        }
+        else if (arg == "--suspend-every")
+            opt.suspendEvery = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--boot-cache")
+            opt.bootCache.reset(new BootCache(argv[++i]));
+        else if (arg == "--hle")
+        {
+            opt.hle = true;
+            opt.hleDir = argv[++i];
+        }
+        else if (arg == "--hle-output" && !parseOutputTrap(argv[++i], opt.hleOutput))
+        {
+            std::cerr << "Unknown output trap mode: " << argv[i] << "\n";
+            return 2;
+        }
+        else if (arg == "--disk-turbo")
+            opt.diskTurbo = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--disk-writes" && !parseDiskWrites(argv[++i], opt.diskWrites))
+        {
+            std::cerr << "Unknown disk write mode: " << argv[i] << "\n";
+            return 2;
+        }
+        else if (arg == "--disk-journal")
+        {
+            opt.diskWrites = DiskWrites::Journal;
+            opt.diskJournal = argv[++i];
+        }
+        else if (arg == "--boot-point" && !parseBootPoint(argv[++i], opt.bootPoint))
+        {
+            std::cerr << "Unknown boot point: " << argv[i] << "\n";
+            return 2;
+        }
+    }
+
+    AnyMachine machine = makeMachine(opt.type);
+    if (!std::visit([&](auto &m) { return Run(m, opt); }, machine))
+        return 2;
+
+    if (opt.hashLog.diverged())
+    {
+        std::cerr << "Frame " << std::dec << opt.hashLog.mismatch().sequence
+                  << " differs from golden log: frame " << std::hex << opt.hashLog.mismatch().frameHash
+                  << " (expected " << opt.hashLog.expected().frameHash << "), ram "
+                  << opt.hashLog.mismatch().ramHash << " (expected " << opt.hashLog.expected().ramHash << ")\n";
+        return 1;
+    }
+
+    return 0;
+}
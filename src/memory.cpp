@@ -1,462 +1,380 @@
 #include "../include/memory.h"
+#include "../include/arena.h"
+#include "../include/hash64.h"
+#include "../include/os_traps.h"
+#include "../include/palette.h"
+#include "../include/rom_store.h"
+#include "../include/state_archive.h"
+#include <algorithm>
 #include <cstring>
 
-constexpr bool DEFAULT_NTSC = true;
-
-Memory::Memory(RomSpace romSpaceType)
-#if defined(USE_TIA) || defined(USE_VIC) || defined(USE_VIA)
-    :
-#endif
-#ifdef USE_TIA
-      tia(TIAColorSpace::Index)
-#endif
-#if defined(USE_TIA) && (defined(USE_VIC) || defined(USE_VIA))
-      ,
-#endif
-#ifdef USE_VIC
-      vic(VICColorSpace::Index)
-#endif
-#if defined(USE_VIC) && defined(USE_VIA)
-      ,
-#endif
-#ifdef USE_VIA
-      via(),
-#ifdef USE_MICRO
-
-      via2(),
-      disk()
-#endif
-#endif
-#ifdef USE_PIA
-      ,
-      pia()
-#endif
-#ifdef USE_ACIA
-      ,
-      acia()
-#endif
-
-{
-    this->romSpace = romSpaceType;
-    Reset();
-}
-
-void Memory::Reset()
-{
-    std::memset(data, 0, sizeof(data));
-#ifdef USE_TIA
-    tia.reset(DEFAULT_NTSC);
-#endif
-#ifdef USE_RIOT
-    riot.reset();
-#endif
-#ifdef USE_VIC
-    vic.reset(DEFAULT_NTSC)
-#endif
-#ifdef USE_PIA
-        pia.reset();
-#endif
-#ifdef USE_ACIA
-    acia.reset();
-#endif
-#ifdef USE_VIA
-    via.reset();
-#ifdef USE_MICRO
-    via2.reset();
-    disk.reset();
-#endif
-#endif
-}
-
-uint8_t Memory::Read(uint16_t addr) const
+// Contribution of one RAM byte to the state hash (splitmix64 finaliser)
+static inline uint64_t MixByte(uint32_t key, uint8_t value)
 {
-    if (this->use6507addresspace == true)
-    {
-        addr &= 0x1FFF; // 8KB wrap , hard eltircal limit
-    }
-#ifdef USE_TIA
-    if ((addr & 0x1080) == 0x0000)
-        return tia.read(addr & 0x3F);
-#endif
-#ifdef USE_RIOT
-    // RAM and I/O in one go
-    if (addr >= 0x0080 && addr <= 0x00FF)
-        return riot.read(addr & 0x7F);
-    if (addr >= 0x0280 && addr <= 0x0297)
-        return riot.read(addr & 0x1F);
-
-#endif
-#ifdef USE_VIA
-#ifdef USE_MICRO
-    // BBC Micro System VIA
-    if (addr >= 0xFE40 && addr <= 0xFE4F)
-        return via.read(addr & 0x0F);
-    if (addr >= 0xFE50 && addr <= 0xFE5F)
-        return via.read(addr & 0x0F); // mirror
-    // BBC Micro User VIA
-    if (addr >= 0xFE60 && addr <= 0xFE6F)
-        return via2.read(addr & 0x0F);
-    // Disk
-    if (addr >= 0x1C00 && addr <= 0xFE83)
-    {
-        return disk.read(addr - 0x1C00);
-    }
-#else
-    if (addr >= 0xFE40 && addr <= 0xFE5F)
-        return via.read(addr & 0x0F);
-#endif
-#endif
-
-#ifdef USE_VIC
-    if ((addr & 0xFFF0) == 0x9000)
-        return vic.read(addr & 0x0F);
-#endif
-#ifdef USE_PIA
-    if (addr >= 0xE840 && addr <= 0xE843)
-        return pia.read(addr & 0x03);
-#endif
-#ifdef USE_ACIA
-    if (addr >= 0xD000 && addr <= 0xD001)
-        return acia.read(addr & 0x01);
-#endif
-#ifdef USE_6529
-    if (addr == 0x1C00)
-        return io.read();
-#endif
-    return data[addr];
+    uint64_t z = ((static_cast<uint64_t>(key) << 8) | value) + 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
 }
 
-void Memory::Write(uint16_t addr, uint8_t value)
+#ifdef USE_ROM_PROTECT
+// Pages of the layout's ROM ranges; ranges are page aligned
+static void MarkRomPages(RomSpace romSpace, uint8_t *pageFlags, uint8_t flag)
 {
-    if (this->use6507addresspace == true)
+    auto protect = [pageFlags, flag](uint32_t lo, uint32_t hi)
     {
-        addr &= 0x1FFF; // 8KB wrap , hard eltircal limit
-    }
-#ifdef USE_ROM_PROTECT
+        for (uint32_t page = lo >> 8; page <= hi >> 8; ++page)
+            pageFlags[page] |= flag;
+    };
     switch (romSpace)
     {
     case RomSpace::C64:
         // BASIC ROM $A000–$BFFF, KERNAL ROM $E000–$FFFF
-        if ((addr >= 0xA000 && addr <= 0xBFFF) ||
-            (addr >= 0xE000 && addr <= 0xFFFF))
-            return;
+        protect(0xA000, 0xBFFF);
+        protect(0xE000, 0xFFFF);
         break;
 
     case RomSpace::C128:
         // BASIC ROM $4000–$7FFF, KERNAL ROM $E000–$FFFF (banked)
-        if ((addr >= 0x4000 && addr <= 0x7FFF) ||
-            (addr >= 0xE000 && addr <= 0xFFFF))
-            return;
+        protect(0x4000, 0x7FFF);
+        protect(0xE000, 0xFFFF);
         break;
 
     case RomSpace::VIC20:
-        // BASIC ROM $1000–$1FFF, Char ROM $8000–$8FFF, Kernal ROM $E000–$FFFF
-        if ((addr >= 0x1000 && addr <= 0x1FFF) ||
-            (addr >= 0x8000 && addr <= 0x8FFF) ||
-            (addr >= 0xE000 && addr <= 0xFFFF))
-            return;
+        // Char ROM $8000–$8FFF, BASIC ROM $C000–$DFFF, Kernal ROM $E000–$FFFF
+        protect(0xC000, 0xDFFF);
+        protect(0x8000, 0x8FFF);
+        protect(0xE000, 0xFFFF);
         break;
 
     case RomSpace::PET:
         // BASIC ROM $C000–$FFFF (varies by model)
-        if (addr >= 0xC000 && addr <= 0xFFFF)
-            return;
+        protect(0xC000, 0xFFFF);
         break;
 
     case RomSpace::PLUS4:
         // BASIC ROM $8000–$BFFF, Kernal ROM $FC00–$FFFF
-        if ((addr >= 0x8000 && addr <= 0xBFFF) ||
-            (addr >= 0xFC00 && addr <= 0xFFFF))
-            return;
+        protect(0x8000, 0xBFFF);
+        protect(0xFC00, 0xFFFF);
         break;
 
     case RomSpace::BBC_MICRO:
         // Sideways ROM $8000–$BFFF, OS ROM $C000–$FFFF
-        if ((addr >= 0x8000 && addr <= 0xBFFF) ||
-            (addr >= 0xC000 && addr <= 0xFFFF))
-            return;
-        // Example: disk controller registers
-        if (addr >= 0x1C00 && addr <= 0xFE83)
-        {
-            disk.write(addr - 0x1C00, value);
-            return;
-        }
+        protect(0x8000, 0xBFFF);
+        protect(0xC000, 0xFFFF);
         break;
 
     case RomSpace::BBC_MASTER:
         // Similar to BBC Micro but with more sideways banks
-        if ((addr >= 0x8000 && addr <= 0xBFFF) ||
-            (addr >= 0xC000 && addr <= 0xFFFF))
-            return;
+        protect(0x8000, 0xBFFF);
+        protect(0xC000, 0xFFFF);
         break;
 
     case RomSpace::APPLE_II:
         // Monitor/BASIC ROM $D000–$FFFF
-        if (addr >= 0xD000 && addr <= 0xFFFF)
-            return;
+        protect(0xD000, 0xFFFF);
         break;
 
     case RomSpace::APPLE_II_C:
         // Similar to Apple IIe/c
-        if (addr >= 0xC000 && addr <= 0xFFFF)
-            return;
+        protect(0xC000, 0xFFFF);
         break;
 
     case RomSpace::APPLE_II_GS:
         // 65C816, ROM $E00000–$E1FFFF (banked) — simplified here
-        if (addr >= 0xE000 && addr <= 0xFFFF)
-            return;
+        protect(0xE000, 0xFFFF);
         break;
 
     case RomSpace::ATARI_2600:
-        // Cartridge ROM $F000–$FFFF (varies with cart size)
-        if (addr >= 0xF000 && addr <= 0xFFFF)
-            return;
+        // Cartridge ROM $1000–$1FFF of the 6507's 8K, seen at $F000–$FFFF unmasked
+        protect(0x1000, 0x1FFF);
+        protect(0xF000, 0xFFFF);
         break;
 
     case RomSpace::ATARI_5200:
         // OS ROM $D800–$FFFF
-        if (addr >= 0xD800 && addr <= 0xFFFF)
-            return;
+        protect(0xD800, 0xFFFF);
         break;
 
     case RomSpace::ATARI_7800:
         // BIOS ROM $F000–$FFFF
-        if (addr >= 0xF000 && addr <= 0xFFFF)
-            return;
+        protect(0xF000, 0xFFFF);
         break;
 
     case RomSpace::ATARI_8BIT:
         // OS ROM $C000–$FFFF
-        if (addr >= 0xC000 && addr <= 0xFFFF)
-            return;
+        protect(0xC000, 0xFFFF);
         break;
 
     case RomSpace::ATARI_LYNX:
         // Boot ROM $FE00–$FFFF
-        if (addr >= 0xFE00 && addr <= 0xFFFF)
-            return;
+        protect(0xFE00, 0xFFFF);
         break;
 
     case RomSpace::NES:
         // PRG ROM $8000–$FFFF
-        if (addr >= 0x8000 && addr <= 0xFFFF)
-            return;
+        protect(0x8000, 0xFFFF);
         break;
 
     case RomSpace::FAMICOM_DISK:
         // BIOS ROM $E000–$FFFF
-        if (addr >= 0xE000 && addr <= 0xFFFF)
-            return;
+        protect(0xE000, 0xFFFF);
         break;
 
     case RomSpace::ORIC:
         // ROM $C000–$FFFF
-        if (addr >= 0xC000 && addr <= 0xFFFF)
-            return;
+        protect(0xC000, 0xFFFF);
         break;
 
     case RomSpace::KIM1:
         // Monitor ROM $0000–$03FF
-        if (addr <= 0x03FF)
-            return;
+        protect(0x0000, 0x03FF);
         break;
 
     case RomSpace::SYM1:
         // Monitor ROM $0000–$0FFF
-        if (addr <= 0x0FFF)
-            return;
+        protect(0x0000, 0x0FFF);
         break;
 
     case RomSpace::AIM65:
         // Monitor ROM $E000–$FFFF
-        if (addr >= 0xE000 && addr <= 0xFFFF)
-            return;
+        protect(0xE000, 0xFFFF);
         break;
 
     case RomSpace::COMMODORE_DISK_DRIVE_1541:
         // Drive ROM $C000–$FFFF
-        if (addr >= 0xC000 && addr <= 0xFFFF)
-            return;
+        protect(0xC000, 0xFFFF);
         break;
 
     case RomSpace::COMMODORE_DISK_DRIVE_1571:
         // Drive ROM $8000–$FFFF
-        if (addr >= 0x8000 && addr <= 0xFFFF)
-            return;
+        protect(0x8000, 0xFFFF);
         break;
 
     case RomSpace::ATARI_1050_DRIVE:
         // Drive ROM $C000–$FFFF
-        if (addr >= 0xC000 && addr <= 0xFFFF)
-            return;
+        protect(0xC000, 0xFFFF);
         break;
 
     default:
         break; // No ROM protection
     }
+}
 #endif
 
-#ifdef USE_TIA
-    // TIA registers are mirrored every 64 bytes in their range
-    if ((addr & 0x1080) == 0x0000)
-    {
-        tia.write(addr & 0x3F, value);
-        return;
-    }
+Memory::Memory(RomSpace romSpaceType) : romSpace(romSpaceType)
+{
+#ifdef USE_ROM_PROTECT
+    MarkRomPages(romSpace, pageFlags, PAGE_ROM);
 #endif
+    Reset();
+}
 
-#ifdef USE_6529
-    if (addr == 0x1C00)
-        io.write(data);
-        return;
-#endif
+namespace
+{
+struct alignas(ArenaAlign) PageBlock
+{
+    uint8_t bytes[Memory::PAGE_SIZE];
+};
+} // namespace
+
+std::shared_ptr<uint8_t> Memory::NewPage()
+{
+    // Page and reference count in one pooled block
+    std::shared_ptr<PageBlock> block = std::allocate_shared<PageBlock>(PoolAllocator<PageBlock>());
+    return std::shared_ptr<uint8_t>(block, block->bytes);
+}
+
+// One zero page shared by every Memory after reset: RAM nobody has
+// written costs nothing per machine
+static const std::shared_ptr<uint8_t> &ZeroPage()
+{
+    static const std::shared_ptr<uint8_t> zero = Memory::NewPage();
+    return zero;
+}
 
-#ifdef USE_RIOT
-    // RIOT RAM
-    if (addr >= 0x0080 && addr <= 0x00FF)
+void Memory::CopyPage(uint32_t page)
+{
+    std::shared_ptr<uint8_t> copy = NewPage();
+    std::memcpy(copy.get(), pageOwners[page].get(), PAGE_SIZE);
+    pageOwners[page] = std::move(copy);
+    if (!(pageFlags[page] & PAGE_MAPPED))
+        readPages[page] = pageOwners[page].get();
+}
+
+int Memory::PrivatePages() const
+{
+    int n = 0;
+    for (uint32_t page = 0; page < PAGE_COUNT; ++page)
+        n += pageOwners[page].use_count() == 1;
+    return n;
+}
+
+void Memory::Load(uint16_t addr, const uint8_t *bytes, std::size_t size)
+{
+    std::size_t i = 0;
+    while (i < size && addr + i < MAX_MEM)
     {
-        riot.write(addr & 0x7F, value);
-        return;
+        uint32_t a = static_cast<uint32_t>(addr + i);
+        if ((a & 0xFF) == 0 && size - i >= PAGE_SIZE)
+        {
+            SharePage(a >> 8, bytes + i);
+            i += PAGE_SIZE;
+            continue;
+        }
+        if (stateHashOn)
+            UpdateStateHash(a, RamByte(static_cast<uint16_t>(a)), bytes[i]);
+        WritablePage(a >> 8)[a & 0xFF] = bytes[i];
+        ++i;
     }
-    // RIOT I/O + timer
-    if (addr >= 0x0280 && addr <= 0x0297)
+}
+
+void Memory::SharePage(uint32_t page, const uint8_t *bytes)
+{
+    if (std::memcmp(pageOwners[page].get(), bytes, PAGE_SIZE) == 0)
+        return; // already this content, and perhaps already shared
+    pageOwners[page] = internPage(bytes);
+    if (!(pageFlags[page] & PAGE_MAPPED))
+        readPages[page] = pageOwners[page].get();
+    if (stateHashOn)
     {
-        riot.write(addr & 0x1F, value);
-        return;
+        uint64_t h = 0;
+        for (uint32_t i = 0; i < PAGE_SIZE; ++i)
+            h ^= MixByte((page << 8) | i, bytes[i]);
+        stateHash ^= pageHash[page] ^ h;
+        pageHash[page] = h;
     }
-#endif
+}
 
-#ifdef USE_VIA
-#ifdef USE_MICRO
-    if (addr >= 0xFE40 && addr <= 0xFE4F)
+void Memory::SetTraps(const OsTraps *table)
+{
+    traps = table;
+    for (uint32_t page = 0; page < PAGE_COUNT; ++page)
     {
-        via.write(addr & 0x0F, value);
-        return;
+        if (traps && traps->hasPage(static_cast<uint8_t>(page)))
+            pageFlags[page] |= PAGE_TRAP;
+        else
+            pageFlags[page] &= ~PAGE_TRAP;
     }
-    if (addr >= 0xFE50 && addr <= 0xFE5F)
-    {
-        via.write(addr & 0x0F, value);
+}
+
+void Memory::MapImage(uint16_t addr, RomImage image)
+{
+    if (!image)
         return;
-    }
-    if (addr >= 0xFE60 && addr <= 0xFE6F)
+    if (addr & 0xFF) // can't be mapped in whole pages
     {
-        via2.write(addr & 0x0F, value);
+        Load(addr, image->data(), image->size());
         return;
     }
-    // WD1770 disk controller range: 0x1C00–0xFE83
-    if (addr >= 0x1C00 && addr <= 0xFE83)
-    {
-        disk.write(addr - 0x1C00, value);
-        return; // handled, don't fall through to RAM/ROM
-    }
-#else
-    if (addr >= 0xFE40 && addr <= 0xFE5F)
+    uint32_t first = addr >> 8;
+    std::size_t size = std::min<std::size_t>(image->size(), MAX_MEM - (first << 8));
+    uint32_t pages = static_cast<uint32_t>(size / PAGE_SIZE);
+    for (uint32_t i = 0; i < pages; ++i)
+        MapPage(static_cast<uint8_t>(first + i), image->data() + i * PAGE_SIZE);
+    if (size % PAGE_SIZE)
+        Load(static_cast<uint16_t>((first + pages) << 8), image->data() + pages * PAGE_SIZE, size % PAGE_SIZE);
+    if (pages)
+        images.push_back(std::move(image));
+}
+
+void Memory::Reset()
+{
+    for (uint32_t page = 0; page < PAGE_COUNT; ++page)
     {
-        via.write(addr & 0x0F, value);
-        return;
+        pageOwners[page] = ZeroPage();
+        if (!(pageFlags[page] & PAGE_MAPPED)) // banks stay mapped
+            readPages[page] = pageOwners[page].get();
     }
-#endif
-#endif
+    if (stateHashOn)
+        RecomputeStateHash();
+}
+
+const Palette &Memory::FramePalette() const
+{
+    return Palette::tiaNTSC();
+}
 
-#ifdef USE_VIC
-    if ((addr & 0xFFF0) == 0x9000)
+uint64_t Memory::HashRam() const
+{
+    // Hashed as one contiguous 64 KiB image, whatever the page sharing
+    thread_local uint8_t image[MAX_MEM];
+    for (uint32_t page = 0; page < PAGE_COUNT; ++page)
+        std::memcpy(image + page * PAGE_SIZE, pageOwners[page].get(), PAGE_SIZE);
+    uint64_t h = hash64(image, sizeof(image));
+    for (int slot = 0; slot < DEVICE_RAM_SLOTS; ++slot)
+        if (deviceRam[slot])
+            h = hash64(deviceRam[slot], deviceRamSize[slot], h);
+    return h;
+}
+
+void Memory::EnableStateHash(bool enable)
+{
+    stateHashOn = enable;
+    if (enable)
     {
-        vic.write(addr & 0x0F, value);
-        return;
+        RecomputeStateHash();
     }
-#endif
-#ifdef USE_PIA
-    if (addr >= 0xE840 && addr <= 0xE843)
+    else
     {
-        pia.write(addr & 0x03, value);
-        return;
+        stateHash = 0;
+        std::memset(pageHash, 0, sizeof(pageHash));
     }
-#endif
-#ifdef USE_ACIA
-    if (addr >= 0xD000 && addr <= 0xD001)
+}
+
+void Memory::RecomputeStateHash()
+{
+    stateHash = 0;
+    for (uint32_t page = 0; page < 256; ++page)
     {
-        acia.write(addr & 0x01, value);
-        return;
+        uint64_t h = 0;
+        for (uint32_t i = 0; i < 256; ++i)
+        {
+            uint32_t addr = (page << 8) | i;
+            h ^= MixByte(addr, pageOwners[page].get()[i]);
+        }
+        pageHash[page] = h;
+        stateHash ^= h;
     }
-#endif
-
-    // Default: write to RAM array
-    data[addr] = value;
+    for (int slot = 0; slot < DEVICE_RAM_SLOTS; ++slot)
+        for (uint32_t i = 0; i < deviceRamSize[slot]; ++i)
+            stateHash ^= MixByte(DeviceRamKey(slot) | i, deviceRam[slot][i]);
 }
 
-void Memory::Clock()
+void Memory::UpdateStateHash(uint32_t key, uint8_t oldValue, uint8_t newValue)
 {
-#ifdef USE_TIA
-    tia.tick(); // Advance TIA video/audio by one cycle
-#endif
-#ifdef USE_RIOT
-    riot.tick(); // Advance RIOT timer
-#endif
-#ifdef USE_VIC
-    vic.tick(); // Advance VIC raster beam
-#endif
-#ifdef USE_VIA
-    via.tick(); // Advance VIA timers/shift register
-#ifdef USE_MICRO
-    via2.tick();
-    disk.tick();
-#endif
-
-#endif
-#ifdef USE_PIA
-    pia.tick(); // Advance PIA handshake/IRQ logic
-#endif
-#ifdef USE_ACIA
-    acia.tick(); // Advance ACIA TX/RX timing
-#endif
-    return; // Nothing More to Do.
+    // XOR out the old term, XOR in the new one
+    uint64_t delta = MixByte(key, oldValue) ^ MixByte(key, newValue);
+    stateHash ^= delta;
+    if (key < DeviceRamKey(0))
+        pageHash[key >> 8] ^= delta;
 }
 
-bool Memory::CheckIRQLines()
+void Memory::SerializeRam(StateArchive &ar)
 {
-    bool irq_line = false;
-
-    // --- VIA ---
-#ifdef USE_VIA
-    static constexpr uint8_t VIA_REG_IFR = 0x0D;
-#ifdef USE_MICRO
-    if (via.read(VIA_REG_IFR) & 0x80)
-        irq_line = true; // System VIA
-    if (via2.read(VIA_REG_IFR) & 0x80)
-        irq_line = true; // User VIA
-#else
-    if (via.read(VIA_REG_IFR) & 0x80)
-        irq_line = true;
-#endif
-#endif
-
-    // --- PIA ---
-
-#ifdef USE_PIA
-    if (pia.read(0x01) & 0x80)
-        irq_line = true; // PIA CRA
-    if (pia.read(0x03) & 0x80)
-        irq_line = true; // PIA CRB
-#endif
-
-    // --- ACIA ---
-#ifdef USE_ACIA
-    if (acia.read(0x01) & 0x80)
-        irq_line = true; // ACIA status register, bit 7 = IRQ
-#endif
-
-    // --- TIA ---
-#ifdef USE_TIA
-    // TIA: IRQ handling is usually via RIOT, but if TIA has a status bit, check it here
-    // (Most 2600 IRQs come from RIOT timer)
-#endif
-
-    // --- RIOT ---
-#ifdef USE_RIOT
-    if (riot.read(0x7F) & 0x80)
-        irq_line = true; // RIOT IRQ register
-#endif
+    ar.io(romSpace);
+    ar.io(use6507addresspace);
+    for (uint32_t page = 0; page < PAGE_COUNT && ar.ram(); ++page)
+    {
+        if (ar.saving())
+        {
+            ar.bytes(pageOwners[page].get(), PAGE_SIZE);
+        }
+        else
+        {
+            // Through the store, so machines restored from one state share
+            // its pages as forks would
+            uint8_t bytes[PAGE_SIZE];
+            ar.bytes(bytes, PAGE_SIZE);
+            if (ar.ok())
+                SharePage(page, bytes);
+        }
+    }
+}
 
-    return irq_line;
+void Memory::Serialize(StateArchive &ar)
+{
+    SerializeRam(ar);
+    if (ar.loading() && stateHashOn)
+        RecomputeStateHash();
 }
@@ -1,4 +1,5 @@
 #include "mos6529.h"
+#include "state_archive.h"
 
 MOS6529::MOS6529()
 {
@@ -52,4 +53,11 @@ void MOS6529::setInputPins(uint8_t value)
 uint8_t MOS6529::getOutputLatch() const
 {
     return portLatch;
-}
\ No newline at end of file
+}
+
+void MOS6529::serialize(StateArchive &ar)
+{
+    ar.io(portLatch);
+    ar.io(inputPins);
+    ar.io(outputMode);
+}
@@ -0,0 +1,481 @@
+#include "os_traps.h"
+#include "flags.h"
+#include "hash64.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+
+static constexpr int OS_CALL_COUNT = 7;
+static const char *const OS_CALL_NAMES[OS_CALL_COUNT] = {"oswrch", "osrdch", "osbyte", "osfile",
+                                                         "chrout", "load",   "oscli"};
+
+const char *osCallName(OsCall call)
+{
+    int i = static_cast<int>(call);
+    return i < OS_CALL_COUNT ? OS_CALL_NAMES[i] : "unknown";
+}
+
+bool parseOsCall(const std::string &name, OsCall &call)
+{
+    for (int i = 0; i < OS_CALL_COUNT; ++i)
+    {
+        if (name == OS_CALL_NAMES[i])
+        {
+            call = static_cast<OsCall>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+static constexpr int OUTPUT_TRAP_COUNT = 2;
+static const char *const OUTPUT_TRAP_NAMES[OUTPUT_TRAP_COUNT] = {"mirror", "replace"};
+
+const char *outputTrapName(OutputTrap mode)
+{
+    int i = static_cast<int>(mode);
+    return i < OUTPUT_TRAP_COUNT ? OUTPUT_TRAP_NAMES[i] : "unknown";
+}
+
+bool parseOutputTrap(const std::string &name, OutputTrap &mode)
+{
+    for (int i = 0; i < OUTPUT_TRAP_COUNT; ++i)
+    {
+        if (name == OUTPUT_TRAP_NAMES[i])
+        {
+            mode = static_cast<OutputTrap>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+// HostDirectory
+// ------------------------------------------------------------
+
+bool HostDirectory::open(const std::string &name, OsFile &file)
+{
+    std::string base = name;
+    if (base.size() > 2 && base[1] == '.') // BBC directory letter
+        base = base.substr(2);
+    if (base.empty() || base.find_first_of("/\\:") != std::string::npos)
+        return false; // never outside the directory
+    std::string path = dir_ + "/" + base;
+    std::FILE *in = std::fopen(path.c_str(), "rb");
+    if (!in)
+        return false;
+    file = OsFile();
+    uint8_t buffer[4096];
+    std::size_t n;
+    while ((n = std::fread(buffer, 1, sizeof(buffer), in)) > 0)
+        file.data.insert(file.data.end(), buffer, buffer + n);
+    std::fclose(in);
+
+    if (std::FILE *inf = std::fopen((path + ".inf").c_str(), "r"))
+    {
+        char infName[64];
+        unsigned long load, exec;
+        if (std::fscanf(inf, "%63s %lx %lx", infName, &load, &exec) == 3)
+        {
+            file.load = static_cast<uint32_t>(load);
+            file.exec = static_cast<uint32_t>(exec);
+            file.hasAddresses = true;
+        }
+        std::fclose(inf);
+    }
+    return true;
+}
+
+// Tables
+// ------------------------------------------------------------
+
+OsTraps::OsTraps(MachineType type)
+{
+    switch (type)
+    {
+    case MachineType::BBCMicro:
+        // OS 1.20: each entry jumps through its vector in page 2, which
+        // points into the OS ROM until a ROM or program claims it
+        romStart_ = 0xC000;
+        romEnd_ = 0xFF00; // extended vectors (sideways ROM claims) start here
+        add(0xFFDD, OsCall::Osfile, 2000, 0x0212);
+        add(0xFFE0, OsCall::Osrdch, DefaultCycles, 0x0210);
+        add(0xFFEE, OsCall::Oswrch, DefaultCycles, 0x020E);
+        add(0xFFF4, OsCall::Osbyte, DefaultCycles, 0x020A);
+        add(0xFFF7, OsCall::Oscli, 2000, 0x0208);
+        break;
+    case MachineType::VIC20:
+        romStart_ = 0xE000;
+        romEnd_ = 0xFFFF;
+        kernal_ = KernalFiles{0xB7, 0xBB, 0xB9, 0x90, 0xAE};
+        add(0xFFD2, OsCall::Chrout, DefaultCycles, 0x0326);
+        add(0xFFD5, OsCall::Load, 2000, 0x0330);
+        break;
+    case MachineType::Plus4:
+        kernal_ = KernalFiles{0xAB, 0xAF, 0xAD, 0x90, 0x9D};
+        add(0xFFD2, OsCall::Chrout);
+        add(0xFFD5, OsCall::Load, 2000);
+        break;
+    case MachineType::PET:
+        // BASIC 4's $FFD5 parses a LOAD command line rather than taking
+        // registers, so only output is trapped
+        add(0xFFD2, OsCall::Chrout);
+        break;
+    default:
+        break;
+    }
+}
+
+void OsTraps::add(uint16_t pc, OsCall call, uint32_t cycles, uint16_t vector)
+{
+    remove(pc);
+    entries_.push_back(Entry{pc, call, cycles, vector});
+    pcs_[pc] = true;
+}
+
+void OsTraps::remove(uint16_t pc)
+{
+    for (auto it = entries_.begin(); it != entries_.end(); ++it)
+    {
+        if (it->pc == pc)
+        {
+            entries_.erase(it);
+            break;
+        }
+    }
+    pcs_[pc] = false;
+}
+
+void OsTraps::setCycles(OsCall call, uint32_t cycles)
+{
+    for (Entry &e : entries_)
+        if (e.call == call)
+            e.cycles = cycles;
+}
+
+bool OsTraps::hasPage(uint8_t page) const
+{
+    for (const Entry &e : entries_)
+        if (e.pc >> 8 == page)
+            return true;
+    return false;
+}
+
+bool OsTraps::vectorRedirected(const Entry &e, TrapCpu &cpu) const
+{
+    if (!e.vector)
+        return false;
+    uint16_t target = static_cast<uint16_t>(cpu.read(e.vector) | (cpu.read(e.vector + 1) << 8));
+    return target < romStart_ || target >= romEnd_;
+}
+
+uint64_t OsTraps::configHash() const
+{
+    std::vector<uint64_t> words;
+    for (const Entry &e : entries_)
+        words.push_back(static_cast<uint64_t>(e.pc) | static_cast<uint64_t>(e.call) << 16 |
+                        static_cast<uint64_t>(e.vector) << 24 | static_cast<uint64_t>(e.cycles) << 40);
+    std::sort(words.begin(), words.end()); // the order entries were added in doesn't matter
+    words.push_back(static_cast<uint64_t>(output) | static_cast<uint64_t>(static_cast<bool>(host.output)) << 8 |
+                    static_cast<uint64_t>(static_cast<bool>(host.input)) << 9 |
+                    static_cast<uint64_t>(static_cast<bool>(host.open)) << 10);
+    return hash64(words.data(), words.size() * sizeof(uint64_t));
+}
+
+bool OsTraps::run(uint16_t pc, TrapCpu &cpu, uint32_t &cycles) const
+{
+    const Entry *entry = nullptr;
+    for (const Entry &e : entries_)
+        if (e.pc == pc)
+            entry = &e;
+    if (!entry || vectorRedirected(*entry, cpu))
+        return false;
+
+    bool done = false;
+    switch (entry->call)
+    {
+    case OsCall::Oswrch:
+    case OsCall::Chrout:
+        done = writeCharacter(entry->call, cpu);
+        break;
+    case OsCall::Osrdch:
+        if (host.input)
+        {
+            int c = host.input();
+            if ((done = c >= 0))
+            {
+                cpu.A = static_cast<uint8_t>(c);
+                cpu.P &= ~Flags::C; // no escape
+            }
+        }
+        break;
+    case OsCall::Osbyte:
+        done = osbyte(cpu);
+        break;
+    case OsCall::Osfile:
+        done = osfile(cpu);
+        break;
+    case OsCall::Load:
+        done = load(cpu);
+        break;
+    case OsCall::Oscli:
+        done = oscli(cpu);
+        break;
+    }
+    cycles = entry->cycles;
+    return done;
+}
+
+// OS 1.20 workspace
+static constexpr uint16_t ESCAPE_FLAG = 0x00FF; // bit 7 set while escape is pending
+static constexpr uint16_t VDU_QUEUE = 0x026A;   // parameter bytes still wanted, 0 if none
+static constexpr uint16_t OSHWM_PAGE = 0x0244;  // default PAGE, high byte
+static constexpr uint16_t HIMEM_PAGE = 0x034E;  // HIMEM for the current mode, high byte
+
+bool OsTraps::writeCharacter(OsCall call, TrapCpu &cpu) const
+{
+    if (!host.output)
+        return false;
+    host.output(cpu.A);
+    if (output == OutputTrap::Mirror)
+        return false; // the ROM puts it on the screen
+    uint8_t c = cpu.A;
+    if (call == OsCall::Oswrch)
+    {
+        // VDU codes below 32 and 127 (delete) move the cursor or start
+        // a sequence, and parameter bytes belong to one
+        if (c < 0x20 || c == 0x7F || cpu.read(VDU_QUEUE) != 0)
+            return false;
+        return true; // preserves every register and flag
+    }
+    // PETSCII control codes: 0-31 and 128-159
+    if ((c & 0x7F) < 0x20)
+        return false;
+    cpu.P &= ~Flags::C; // no error
+    return true;
+}
+
+// BBC calls
+// ------------------------------------------------------------
+
+bool OsTraps::osbyte(TrapCpu &cpu) const
+{
+    switch (cpu.A)
+    {
+    case 0x7E: // acknowledge escape: X=&FF if one was pending
+    {
+        uint8_t flag = cpu.read(ESCAPE_FLAG);
+        cpu.write(ESCAPE_FLAG, flag & 0x7F);
+        cpu.X = (flag & 0x80) ? 0xFF : 0x00;
+        return true;
+    }
+    case 0x81: // INKEY with a time limit (negative INKEY scans keys: ROM)
+    {
+        if (cpu.Y >= 0x80 || !host.input)
+            return false;
+        int c = host.input();
+        if (c >= 0)
+        {
+            cpu.X = static_cast<uint8_t>(c);
+            cpu.Y = 0x00;
+            cpu.P &= ~Flags::C;
+        }
+        else
+        {
+            cpu.Y = 0xFF; // timed out
+            cpu.P |= Flags::C;
+        }
+        return true;
+    }
+    case 0x82: // high order address of this processor
+        cpu.X = 0xFF;
+        cpu.Y = 0xFF;
+        return true;
+    case 0x83: // OSHWM
+        cpu.X = 0x00;
+        cpu.Y = cpu.read(OSHWM_PAGE);
+        return true;
+    case 0x84: // HIMEM
+        cpu.X = 0x00;
+        cpu.Y = cpu.read(HIMEM_PAGE);
+        return true;
+    default:
+        return false;
+    }
+}
+
+static uint32_t ReadWord32(TrapCpu &cpu, uint16_t addr)
+{
+    uint32_t v = 0;
+    for (int i = 3; i >= 0; --i)
+        v = (v << 8) | cpu.read(static_cast<uint16_t>(addr + i));
+    return v;
+}
+
+static void WriteWord32(TrapCpu &cpu, uint16_t addr, uint32_t v)
+{
+    for (int i = 0; i < 4; ++i)
+        cpu.write(static_cast<uint16_t>(addr + i), static_cast<uint8_t>(v >> (8 * i)));
+}
+
+// A CR-terminated name, as OSFILE takes it, without leading spaces
+static std::string ReadName(TrapCpu &cpu, uint16_t addr, std::size_t limit)
+{
+    std::string name;
+    for (std::size_t i = 0; i < limit; ++i)
+    {
+        char c = static_cast<char>(cpu.read(static_cast<uint16_t>(addr + i)));
+        if (c == '\r' || (c == ' ' && !name.empty()))
+            break;
+        if (c != ' ')
+            name += c;
+    }
+    return name;
+}
+
+bool OsTraps::osfile(TrapCpu &cpu) const
+{
+    // Only A=&FF (load); the block at XY is: name address, load, exec,
+    // start, end, each 32-bit little-endian after the first
+    if (cpu.A != 0xFF || !host.open)
+        return false;
+    uint16_t block = static_cast<uint16_t>(cpu.X | (cpu.Y << 8));
+    uint16_t nameAddr = static_cast<uint16_t>(cpu.read(block) | (cpu.read(block + 1) << 8));
+    OsFile file;
+    if (!host.open(ReadName(cpu, nameAddr, 64), file))
+        return false; // the filing system reports the error
+
+    // Byte 6 zero: load where the block says; else at the file's address
+    bool useBlock = cpu.read(static_cast<uint16_t>(block + 6)) == 0;
+    if (!useBlock && !file.hasAddresses)
+        return false;
+    uint32_t load = useBlock ? ReadWord32(cpu, static_cast<uint16_t>(block + 2)) : file.load;
+    std::size_t size = std::min<std::size_t>(file.data.size(), 0x10000 - (load & 0xFFFF));
+    cpu.load(static_cast<uint16_t>(load), file.data.data(), size);
+
+    WriteWord32(cpu, static_cast<uint16_t>(block + 2), file.hasAddresses ? file.load : load);
+    WriteWord32(cpu, static_cast<uint16_t>(block + 6), file.hasAddresses ? file.exec : load);
+    WriteWord32(cpu, static_cast<uint16_t>(block + 10), static_cast<uint32_t>(file.data.size()));
+    WriteWord32(cpu, static_cast<uint16_t>(block + 14), 0); // attributes: unlocked
+    cpu.A = 1; // a file
+    return true;
+}
+
+static uint8_t Upper(uint8_t c)
+{
+    return c >= 'a' && c <= 'z' ? static_cast<uint8_t>(c - 'a' + 'A') : c;
+}
+
+// Whether the command line at i starts with command, whole or abbreviated
+// with a dot ("LOAD", "LO.", "L."); i moves past it
+static bool MatchCommand(const std::string &line, std::size_t &i, const char *command)
+{
+    std::size_t n = 0;
+    while (i + n < line.size() && command[n] && Upper(line[i + n]) == command[n])
+        ++n;
+    if (n == 0)
+        return false;
+    if (i + n < line.size() && line[i + n] == '.')
+    {
+        i += n + 1;
+        return true;
+    }
+    bool whole = !command[n] && (i + n == line.size() || !std::isalpha(static_cast<uint8_t>(line[i + n])));
+    if (whole)
+        i += n;
+    return whole;
+}
+
+bool OsTraps::oscli(TrapCpu &cpu) const
+{
+    // *LOAD name [address], *RUN name [parameters] and */name; anything
+    // else, including names the host lacks, goes to the MOS and its ROMs
+    if (!host.open)
+        return false;
+    uint16_t addr = static_cast<uint16_t>(cpu.X | (cpu.Y << 8));
+    std::string line;
+    for (int i = 0; i < 256; ++i)
+    {
+        char c = static_cast<char>(cpu.read(static_cast<uint16_t>(addr + i)));
+        if (c == '\r')
+            break;
+        line += c;
+    }
+    std::size_t i = line.find_first_not_of(" *");
+    if (i == std::string::npos)
+        return false;
+    bool run;
+    if (line[i] == '/')
+    {
+        run = true;
+        ++i;
+    }
+    else if (MatchCommand(line, i, "LOAD"))
+        run = false;
+    else if (MatchCommand(line, i, "RUN"))
+        run = true;
+    else
+        return false;
+
+    i = line.find_first_not_of(' ', i);
+    if (i == std::string::npos)
+        return false;
+    std::size_t end = line.find(' ', i);
+    std::string name = line.substr(i, end - i);
+    OsFile file;
+    if (!host.open(name, file))
+        return false;
+
+    uint32_t load = file.load;
+    bool hasLoad = file.hasAddresses;
+    if (!run && end != std::string::npos)
+    {
+        std::size_t a = line.find_first_not_of(' ', end);
+        if (a != std::string::npos && std::isxdigit(static_cast<uint8_t>(line[a])))
+        {
+            load = static_cast<uint32_t>(std::strtoul(line.c_str() + a, nullptr, 16));
+            hasLoad = true;
+        }
+    }
+    if (!hasLoad || (run && !file.hasAddresses))
+        return false;
+    std::size_t size = std::min<std::size_t>(file.data.size(), 0x10000 - (load & 0xFFFF));
+    cpu.load(static_cast<uint16_t>(load), file.data.data(), size);
+    if (run) // the program returns to OSCLI's caller
+        cpu.jump = static_cast<int32_t>(file.exec & 0xFFFF);
+    return true;
+}
+
+// Commodore calls
+// ------------------------------------------------------------
+
+bool OsTraps::load(TrapCpu &cpu) const
+{
+    // A=0 loads; verify is left to the ROM
+    if (cpu.A != 0 || !host.open || !kernal_.fnAddr)
+        return false;
+    uint8_t length = cpu.read(kernal_.fnLen);
+    uint16_t nameAddr = static_cast<uint16_t>(cpu.read(kernal_.fnAddr) | (cpu.read(kernal_.fnAddr + 1) << 8));
+    std::string name;
+    for (uint8_t i = 0; i < length; ++i)
+        name += static_cast<char>(cpu.read(static_cast<uint16_t>(nameAddr + i)));
+    OsFile file;
+    if (name.empty() || !host.open(name, file) || file.data.size() < 2)
+        return false;
+
+    // Secondary address 0: load at XY, else where the file says
+    uint16_t addr = cpu.read(kernal_.secondary) == 0 ? static_cast<uint16_t>(cpu.X | (cpu.Y << 8))
+                                                      : static_cast<uint16_t>(file.data[0] | (file.data[1] << 8));
+    std::size_t size = std::min<std::size_t>(file.data.size() - 2, 0x10000 - addr);
+    cpu.load(addr, file.data.data() + 2, size);
+
+    uint16_t end = static_cast<uint16_t>(addr + size);
+    cpu.write(kernal_.endAddr, static_cast<uint8_t>(end));
+    cpu.write(static_cast<uint16_t>(kernal_.endAddr + 1), static_cast<uint8_t>(end >> 8));
+    cpu.write(kernal_.status, 0x40); // end of file
+    cpu.X = static_cast<uint8_t>(end);
+    cpu.Y = static_cast<uint8_t>(end >> 8);
+    cpu.P &= ~Flags::C;
+    return true;
+}
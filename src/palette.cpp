@@ -0,0 +1,300 @@
+#include "palette.h"
+#include <cstring>
+
+#if defined(__AVX2__) || defined(__SSSE3__)
+#include <immintrin.h>
+#endif
+
+// ------------------------------------------------------------
+// Built-in palettes (0xRRGGBB)
+// ------------------------------------------------------------
+
+// TIA: index = hue (bits 6..3) and luminance (bits 2..0), i.e. COLUxx >> 1
+static constexpr uint32_t TIA_NTSC_RGB[128] = {
+    0x000000, 0x4a4a4a, 0x6f6f6f, 0x8e8e8e, 0xaaaaaa, 0xc0c0c0, 0xd6d6d6, 0xececec,
+    0x484800, 0x69690f, 0x86861d, 0xa2a22a, 0xbbbb35, 0xd2d240, 0xe8e84a, 0xfcfc54,
+    0x7c2c00, 0x904811, 0xa26221, 0xb47a30, 0xc3903d, 0xd2a44a, 0xdfb755, 0xecc860,
+    0x901c00, 0xa33915, 0xb55328, 0xc66c3a, 0xd5824a, 0xe39759, 0xf0aa67, 0xfcbc74,
+    0x940000, 0xa71a1a, 0xb83232, 0xc84848, 0xd65c5c, 0xe46f6f, 0xf08080, 0xfc9090,
+    0x840064, 0x97197a, 0xa8308f, 0xb846a2, 0xc659b3, 0xd46cc3, 0xe07cd2, 0xec8ce0,
+    0x500084, 0x68199a, 0x7d30ad, 0x9246c0, 0xa459d0, 0xb56ce0, 0xc57cee, 0xd48cfc,
+    0x140090, 0x331aa3, 0x4e32b5, 0x6848c6, 0x7f5cd5, 0x956fe3, 0xa980f0, 0xbc90fc,
+    0x000094, 0x181aa7, 0x2d32b8, 0x4248c8, 0x545cd6, 0x656fe4, 0x7580f0, 0x8490fc,
+    0x001c88, 0x183b9d, 0x2d57b0, 0x4272c2, 0x548ad2, 0x65a0e1, 0x75b5ef, 0x84c8fc,
+    0x003064, 0x185080, 0x2d6d98, 0x4288b0, 0x54a0c5, 0x65b7d9, 0x75cceb, 0x84e0fc,
+    0x004030, 0x18624e, 0x2d8169, 0x429e82, 0x54b899, 0x65d1ae, 0x75e7c2, 0x84fcd4,
+    0x004400, 0x1a661a, 0x328432, 0x48a048, 0x5cba5c, 0x6fd26f, 0x80e880, 0x90fc90,
+    0x143c00, 0x355f18, 0x527e2d, 0x6e9c42, 0x87b754, 0x9ed065, 0xb4e775, 0xc8fc84,
+    0x303800, 0x505916, 0x6d762b, 0x88923e, 0xa0ab4f, 0xb7c25f, 0xccd86e, 0xe0ec7c,
+    0x482c00, 0x694d14, 0x866a26, 0xa28638, 0xbb9f47, 0xd2b656, 0xe8cc63, 0xfce070};
+
+static constexpr uint32_t TIA_PAL_RGB[128] = {
+    0x000000, 0x282828, 0x505050, 0x747474, 0x949494, 0xb4b4b4, 0xd0d0d0, 0xececec,
+    0x000000, 0x282828, 0x505050, 0x747474, 0x949494, 0xb4b4b4, 0xd0d0d0, 0xececec,
+    0x805800, 0x947020, 0xa8843c, 0xbc9c58, 0xccac70, 0xdcc084, 0xecd09c, 0xfce0b0,
+    0x445c00, 0x5c7820, 0x74903c, 0x8cac58, 0xa0c070, 0xb0d484, 0xc4e89c, 0xd4fcb0,
+    0x703400, 0x885020, 0xa0683c, 0xb48458, 0xc89870, 0xdcac84, 0xecc09c, 0xfcd4b0,
+    0x006414, 0x208034, 0x3c9850, 0x58b06c, 0x70c484, 0x84d89c, 0x9ce8b4, 0xb0fcc8,
+    0x700014, 0x882034, 0xa03c50, 0xb4586c, 0xc87084, 0xdc849c, 0xec9cb4, 0xfcb0c8,
+    0x005c5c, 0x207474, 0x3c8c8c, 0x58a4a4, 0x70b8b8, 0x84c8c8, 0x9cdcdc, 0xb0ecec,
+    0x70005c, 0x842074, 0x943c88, 0xa8589c, 0xb470b0, 0xc484c0, 0xd09cd0, 0xe0b0e0,
+    0x003c70, 0x1c5888, 0x3874a0, 0x508cb4, 0x68a4c8, 0x7cb8dc, 0x90ccec, 0xa4e0fc,
+    0x580070, 0x6c2088, 0x803ca0, 0x9458b4, 0xa470c8, 0xb484dc, 0xc49cec, 0xd4b0fc,
+    0x002070, 0x1c3c88, 0x3858a0, 0x5074b4, 0x6888c8, 0x7ca0dc, 0x90b4ec, 0xa4c8fc,
+    0x3c0080, 0x542094, 0x6c3ca8, 0x8058bc, 0x9470cc, 0xa884dc, 0xb89cec, 0xc8b0fc,
+    0x000088, 0x20209c, 0x3c3cb0, 0x5858c0, 0x7070d0, 0x8484e0, 0x9c9cec, 0xb0b0fc,
+    0x000000, 0x282828, 0x505050, 0x747474, 0x949494, 0xb4b4b4, 0xd0d0d0, 0xececec,
+    0x000000, 0x282828, 0x505050, 0x747474, 0x949494, 0xb4b4b4, 0xd0d0d0, 0xececec};
+
+// VIC-20: black, white, red, cyan, purple, green, blue, yellow,
+// orange, light orange, pink, light cyan, light purple, light green,
+// light blue, light yellow
+static constexpr uint32_t VIC_NTSC_RGB[16] = {
+    0x000000, 0xffffff, 0xf00000, 0x00f0f0, 0x600060, 0x00a000, 0x0000f0, 0xd0d000,
+    0xc0a000, 0xffa000, 0xf08080, 0x00ffff, 0xff00ff, 0x00ff00, 0x00a0ff, 0xffff00};
+
+static constexpr uint32_t VIC_PAL_RGB[16] = {
+    0x000000, 0xffffff, 0xb61f21, 0x4df0ff, 0xb43fff, 0x44e237, 0x1a34ff, 0xdcd71b,
+    0xca5400, 0xe9b072, 0xe79293, 0x9af7fd, 0xe09fff, 0x8fe493, 0x8290ff, 0xe5de85};
+
+const Palette &Palette::tiaNTSC()
+{
+    static const Palette p(TIA_NTSC_RGB, 128);
+    return p;
+}
+
+const Palette &Palette::tiaPAL()
+{
+    static const Palette p(TIA_PAL_RGB, 128);
+    return p;
+}
+
+const Palette &Palette::vicNTSC()
+{
+    static const Palette p(VIC_NTSC_RGB, 16);
+    return p;
+}
+
+const Palette &Palette::vicPAL()
+{
+    static const Palette p(VIC_PAL_RGB, 16);
+    return p;
+}
+
+// Pack four bytes in memory order, independent of host endianness
+static inline uint32_t packBytes(uint8_t b0, uint8_t b1, uint8_t b2, uint8_t b3)
+{
+    const uint8_t bytes[4] = {b0, b1, b2, b3};
+    uint32_t v;
+    std::memcpy(&v, bytes, sizeof(v));
+    return v;
+}
+
+Palette::Palette(const uint32_t *rgb, int count) : count_(count)
+{
+    for (int i = 0; i < 256; ++i)
+    {
+        uint32_t c = rgb[i % count];
+        uint8_t r = static_cast<uint8_t>(c >> 16);
+        uint8_t g = static_cast<uint8_t>(c >> 8);
+        uint8_t b = static_cast<uint8_t>(c);
+
+        rgb_[i] = c;
+        rgba_[i] = packBytes(r, g, b, 0xFF);
+        bgra_[i] = packBytes(b, g, r, 0xFF);
+        rgb565_[i] = static_cast<uint32_t>(((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3));
+        luma_[i] = static_cast<uint32_t>((77 * r + 150 * g + 29 * b) >> 8);
+    }
+}
+
+// ------------------------------------------------------------
+// Conversion kernels
+// ------------------------------------------------------------
+// The vector paths are chosen at compile time to match the x86-64,
+// x86-64-v2 (SSSE3) and x86-64-v3 (AVX2) builds. AVX2 gathers work for
+// any palette; the SSSE3 shuffle path covers 16-colour palettes such as
+// the VIC's. Everything else falls through to the scalar tail loops.
+
+static void convert32(const uint8_t *src, int count, const uint32_t *lut, uint32_t *dst)
+{
+    int i = 0;
+#if defined(__AVX2__)
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256i idx = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(src + i)));
+        __m256i px = _mm256_i32gather_epi32(reinterpret_cast<const int *>(lut), idx, 4);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), px);
+    }
+#endif
+    for (; i < count; ++i)
+        dst[i] = lut[src[i]];
+}
+
+static void convert16(const uint8_t *src, int count, const uint32_t *lut, uint16_t *dst)
+{
+    int i = 0;
+#if defined(__AVX2__)
+    for (; i + 16 <= count; i += 16)
+    {
+        __m256i ia = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(src + i)));
+        __m256i ib = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(src + i + 8)));
+        __m256i a = _mm256_i32gather_epi32(reinterpret_cast<const int *>(lut), ia, 4);
+        __m256i b = _mm256_i32gather_epi32(reinterpret_cast<const int *>(lut), ib, 4);
+        // packus works per 128-bit lane; restore pixel order afterwards
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(a, b), 0xD8);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), packed);
+    }
+#endif
+    for (; i < count; ++i)
+        dst[i] = static_cast<uint16_t>(lut[src[i]]);
+}
+
+static void convert8(const uint8_t *src, int count, const uint32_t *lut, uint8_t *dst)
+{
+    int i = 0;
+#if defined(__AVX2__)
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    for (; i + 32 <= count; i += 32)
+    {
+        __m256i v[4];
+        for (int k = 0; k < 4; ++k)
+        {
+            __m256i idx = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(src + i + 8 * k)));
+            v[k] = _mm256_i32gather_epi32(reinterpret_cast<const int *>(lut), idx, 4);
+        }
+        __m256i ab = _mm256_packus_epi32(v[0], v[1]);
+        __m256i cd = _mm256_packus_epi32(v[2], v[3]);
+        __m256i packed = _mm256_permutevar8x32_epi32(_mm256_packus_epi16(ab, cd), order);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), packed);
+    }
+#endif
+    for (; i < count; ++i)
+        dst[i] = static_cast<uint8_t>(lut[src[i]]);
+}
+
+#if defined(__SSSE3__) && !defined(__AVX2__)
+// 16-entry palettes: one pshufb per output byte plane, then interleave
+static __m128i bytePlane(const uint32_t *lut, int shift)
+{
+    alignas(16) uint8_t plane[16];
+    for (int k = 0; k < 16; ++k)
+        plane[k] = static_cast<uint8_t>(lut[k] >> shift);
+    return _mm_load_si128(reinterpret_cast<const __m128i *>(plane));
+}
+
+static int convert32Small(const uint8_t *src, int count, const uint32_t *lut, uint32_t *dst)
+{
+    const __m128i p0 = bytePlane(lut, 0), p1 = bytePlane(lut, 8);
+    const __m128i p2 = bytePlane(lut, 16), p3 = bytePlane(lut, 24);
+    const __m128i nibble = _mm_set1_epi8(0x0F);
+    int i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        __m128i idx = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i)), nibble);
+        __m128i b0 = _mm_shuffle_epi8(p0, idx), b1 = _mm_shuffle_epi8(p1, idx);
+        __m128i b2 = _mm_shuffle_epi8(p2, idx), b3 = _mm_shuffle_epi8(p3, idx);
+        __m128i lo01 = _mm_unpacklo_epi8(b0, b1), hi01 = _mm_unpackhi_epi8(b0, b1);
+        __m128i lo23 = _mm_unpacklo_epi8(b2, b3), hi23 = _mm_unpackhi_epi8(b2, b3);
+        __m128i *out = reinterpret_cast<__m128i *>(dst + i);
+        _mm_storeu_si128(out + 0, _mm_unpacklo_epi16(lo01, lo23));
+        _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(lo01, lo23));
+        _mm_storeu_si128(out + 2, _mm_unpacklo_epi16(hi01, hi23));
+        _mm_storeu_si128(out + 3, _mm_unpackhi_epi16(hi01, hi23));
+    }
+    return i;
+}
+
+static int convert16Small(const uint8_t *src, int count, const uint32_t *lut, uint16_t *dst)
+{
+    const __m128i p0 = bytePlane(lut, 0), p1 = bytePlane(lut, 8);
+    const __m128i nibble = _mm_set1_epi8(0x0F);
+    int i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        __m128i idx = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i)), nibble);
+        __m128i b0 = _mm_shuffle_epi8(p0, idx), b1 = _mm_shuffle_epi8(p1, idx);
+        __m128i *out = reinterpret_cast<__m128i *>(dst + i);
+        _mm_storeu_si128(out + 0, _mm_unpacklo_epi8(b0, b1));
+        _mm_storeu_si128(out + 1, _mm_unpackhi_epi8(b0, b1));
+    }
+    return i;
+}
+
+static int convert8Small(const uint8_t *src, int count, const uint32_t *lut, uint8_t *dst)
+{
+    const __m128i p0 = bytePlane(lut, 0);
+    const __m128i nibble = _mm_set1_epi8(0x0F);
+    int i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        __m128i idx = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i)), nibble);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_shuffle_epi8(p0, idx));
+    }
+    return i;
+}
+#endif
+
+void Palette::convertRow(const uint8_t *src, int count, PixelFormat fmt, void *dst) const
+{
+    int done = 0;
+#if defined(__SSSE3__) && !defined(__AVX2__)
+    // Indices of a 16-colour palette repeat every 16, so masking is exact
+    if (count_ == 16)
+    {
+        switch (fmt)
+        {
+        case PixelFormat::RGBA8888:
+            done = convert32Small(src, count, rgba_, static_cast<uint32_t *>(dst));
+            break;
+        case PixelFormat::BGRA8888:
+            done = convert32Small(src, count, bgra_, static_cast<uint32_t *>(dst));
+            break;
+        case PixelFormat::RGB565:
+            done = convert16Small(src, count, rgb565_, static_cast<uint16_t *>(dst));
+            break;
+        case PixelFormat::Luma8:
+            done = convert8Small(src, count, luma_, static_cast<uint8_t *>(dst));
+            break;
+        default:
+            break;
+        }
+    }
+#endif
+    const uint8_t *s = src + done;
+    int n = count - done;
+
+    switch (fmt)
+    {
+    case PixelFormat::Index8:
+        std::memcpy(dst, src, static_cast<std::size_t>(count));
+        break;
+    case PixelFormat::RGBA8888:
+        convert32(s, n, rgba_, static_cast<uint32_t *>(dst) + done);
+        break;
+    case PixelFormat::BGRA8888:
+        convert32(s, n, bgra_, static_cast<uint32_t *>(dst) + done);
+        break;
+    case PixelFormat::RGB565:
+        convert16(s, n, rgb565_, static_cast<uint16_t *>(dst) + done);
+        break;
+    case PixelFormat::Luma8:
+        convert8(s, n, luma_, static_cast<uint8_t *>(dst) + done);
+        break;
+    }
+}
+
+void Palette::convertFrame(const FrameView &src, PixelFormat fmt, void *dst, std::size_t dstStride) const
+{
+    uint8_t *out = static_cast<uint8_t *>(dst);
+    std::size_t rowBytes = static_cast<std::size_t>(src.width) * bytesPerPixel(fmt);
+
+    // Tightly packed destination: convert the frame as one long run per
+    // contiguous stretch instead of row by row
+    if (dstStride == rowBytes && src.stride == src.width)
+    {
+        convertRow(src.pixels, src.width * src.height, fmt, out);
+        return;
+    }
+    for (int y = 0; y < src.height; ++y)
+        convertRow(src.row(y), src.width, fmt, out + static_cast<std::size_t>(y) * dstStride);
+}
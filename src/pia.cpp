@@ -1,4 +1,5 @@
 #include "pia.h"
+#include "state_archive.h"
 
 PIA::PIA() {
     reset();
@@ -88,4 +89,15 @@ void PIA::setPortBInput(uint8_t val) {
     if (crb_ & CR_IRQ1_ENABLE) {
         crb_ |= CR_IRQ1_FLAG;
     }
-}
\ No newline at end of file
+}
+
+void PIA::serialize(StateArchive& ar) {
+    ar.io(ora_);
+    ar.io(orb_);
+    ar.io(ddra_);
+    ar.io(ddrb_);
+    ar.io(cra_);
+    ar.io(crb_);
+    ar.io(ira_);
+    ar.io(irb_);
+}
@@ -0,0 +1,234 @@
+#include "recorder.h"
+#include "rle.h"
+#include <cstring>
+
+Recorder::Recorder(const RecorderConfig &config) : config_(config)
+{
+    if (config_.encoderThreads < 1)
+        config_.encoderThreads = 1;
+    if (config_.keyframeInterval < 1)
+        config_.keyframeInterval = 1;
+    if (config_.queueDepth < 2)
+        config_.queueDepth = 2;
+}
+
+Recorder::~Recorder()
+{
+    close();
+}
+
+bool Recorder::open(const std::string &path, int width, int height)
+{
+    close();
+
+    file_ = std::fopen(path.c_str(), "wb");
+    if (!file_)
+        return false;
+
+    RecordingHeader header{};
+    std::memcpy(header.magic, "6502REC1", sizeof(header.magic));
+    header.width = static_cast<uint16_t>(width);
+    header.height = static_cast<uint16_t>(height);
+    header.paletteId = static_cast<uint8_t>(config_.palette);
+    header.audioRate = config_.audioRate;
+    std::fwrite(&header, sizeof(header), 1, file_);
+    bytesWritten_.store(sizeof(header), std::memory_order_relaxed);
+
+    width_ = width;
+    height_ = height;
+    std::size_t frameBytes = static_cast<std::size_t>(width) * height;
+
+    slots_.reset(new Slot[config_.queueDepth]);
+    for (std::size_t i = 0; i < config_.queueDepth; ++i)
+    {
+        slots_[i].pixels.resize(frameBytes);
+        slots_[i].audio.resize(config_.audioFrameSamples);
+    }
+    previous_.assign(frameBytes, 0);
+    forceKeyframe_ = true;
+
+    nextSequence_ = submitted_ = dropped_ = 0;
+    published_.store(0);
+    claimed_.store(0);
+    stopping_.store(false);
+
+    for (int i = 0; i < config_.encoderThreads; ++i)
+        encoders_.emplace_back(&Recorder::encoderLoop, this);
+    writer_ = std::thread(&Recorder::writerLoop, this);
+    return true;
+}
+
+void Recorder::close()
+{
+    if (!file_)
+        return;
+
+    stopping_.store(true, std::memory_order_release);
+    {
+        std::lock_guard<std::mutex> work(workMutex_);
+        std::lock_guard<std::mutex> done(doneMutex_);
+    }
+    workCv_.notify_all();
+    doneCv_.notify_all();
+    for (auto &t : encoders_)
+        t.join();
+    encoders_.clear();
+    writer_.join();
+
+    std::fclose(file_);
+    file_ = nullptr;
+}
+
+bool Recorder::submitFrame(const FrameView &frame, const int16_t *audio, std::size_t audioSamples)
+{
+    if (!file_ || frame.width != width_ || frame.height != height_)
+        return false;
+
+    uint64_t sequence = nextSequence_++;
+    submitted_++;
+
+    // Slots are used in ticket order; if the next one hasn't been written
+    // out yet the pipeline is saturated and this frame is skipped
+    uint64_t ticket = published_.load(std::memory_order_relaxed);
+    Slot &slot = slots_[ticket % config_.queueDepth];
+    if (slot.state.load(std::memory_order_acquire) != Free)
+    {
+        dropped_++;
+        forceKeyframe_ = true; // the delta chain is broken
+        return false;
+    }
+
+    bool key = forceKeyframe_ || sequence % static_cast<uint64_t>(config_.keyframeInterval) == 0;
+    forceKeyframe_ = false;
+
+    // Copy (or XOR against the previous frame) in one pass over each row
+    for (int y = 0; y < height_; ++y)
+    {
+        const uint8_t *src = frame.row(y);
+        uint8_t *prev = previous_.data() + static_cast<std::size_t>(y) * width_;
+        uint8_t *dst = slot.pixels.data() + static_cast<std::size_t>(y) * width_;
+        if (key)
+        {
+            std::memcpy(dst, src, width_);
+        }
+        else
+        {
+            for (int x = 0; x < width_; ++x)
+                dst[x] = src[x] ^ prev[x];
+        }
+        std::memcpy(prev, src, width_);
+    }
+
+    slot.sequence = sequence;
+    slot.keyframe = key;
+    slot.audioSamples = audio ? audioSamples : 0;
+    if (slot.audio.size() < slot.audioSamples)
+        slot.audio.resize(slot.audioSamples);
+    if (slot.audioSamples)
+        std::memcpy(slot.audio.data(), audio, slot.audioSamples * sizeof(int16_t));
+    slot.state.store(Filled, std::memory_order_release);
+    published_.store(ticket + 1, std::memory_order_release);
+    {
+        // Held only while an encoder checks for work, never across encoding
+        std::lock_guard<std::mutex> lock(workMutex_);
+    }
+    workCv_.notify_one();
+    return true;
+}
+
+bool Recorder::claim(uint64_t &ticket)
+{
+    uint64_t c = claimed_.load(std::memory_order_acquire);
+    while (c < published_.load(std::memory_order_acquire))
+    {
+        if (claimed_.compare_exchange_weak(c, c + 1, std::memory_order_acq_rel))
+        {
+            ticket = c;
+            return true;
+        }
+    }
+    return false;
+}
+
+void Recorder::encode(Slot &slot)
+{
+    const std::size_t frameBytes = slot.pixels.size();
+    const std::size_t audioBytes = slot.audioSamples * sizeof(int16_t);
+    slot.encoded.resize(sizeof(ChunkHeader) + rleBound(frameBytes) +
+                        (audioBytes ? sizeof(ChunkHeader) + audioBytes : 0));
+
+    uint8_t *out = slot.encoded.data();
+    std::size_t packed = rleEncode(slot.pixels.data(), frameBytes, out + sizeof(ChunkHeader));
+
+    ChunkHeader video{};
+    video.type = static_cast<uint8_t>(slot.keyframe ? ChunkType::KeyFrame : ChunkType::DeltaFrame);
+    video.size = static_cast<uint32_t>(packed);
+    video.sequence = slot.sequence;
+    std::memcpy(out, &video, sizeof(video));
+    std::size_t used = sizeof(ChunkHeader) + packed;
+
+    if (audioBytes)
+    {
+        ChunkHeader sound{};
+        sound.type = static_cast<uint8_t>(ChunkType::Audio);
+        sound.size = static_cast<uint32_t>(audioBytes);
+        sound.sequence = slot.sequence;
+        std::memcpy(out + used, &sound, sizeof(sound));
+        std::memcpy(out + used + sizeof(sound), slot.audio.data(), audioBytes);
+        used += sizeof(sound) + audioBytes;
+    }
+    slot.encoded.resize(used);
+}
+
+void Recorder::encoderLoop()
+{
+    for (;;)
+    {
+        uint64_t ticket;
+        if (claim(ticket))
+        {
+            Slot &slot = slots_[ticket % config_.queueDepth];
+            encode(slot);
+            slot.state.store(Encoded, std::memory_order_release);
+            {
+                std::lock_guard<std::mutex> lock(doneMutex_);
+            }
+            doneCv_.notify_one();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(workMutex_);
+        workCv_.wait(lock, [this] {
+            return stopping_.load(std::memory_order_acquire) ||
+                   claimed_.load(std::memory_order_acquire) < published_.load(std::memory_order_acquire);
+        });
+        if (stopping_.load(std::memory_order_acquire) &&
+            claimed_.load(std::memory_order_acquire) >= published_.load(std::memory_order_acquire))
+            return;
+    }
+}
+
+void Recorder::writerLoop()
+{
+    uint64_t next = 0;
+    for (;;)
+    {
+        Slot &slot = slots_[next % config_.queueDepth];
+        {
+            // The next slot in order is encoded, or everything is out
+            std::unique_lock<std::mutex> lock(doneMutex_);
+            doneCv_.wait(lock, [&] {
+                if (next < published_.load(std::memory_order_acquire))
+                    return slot.state.load(std::memory_order_acquire) == Encoded;
+                return stopping_.load(std::memory_order_acquire);
+            });
+        }
+        if (slot.state.load(std::memory_order_acquire) != Encoded)
+            return;
+
+        std::fwrite(slot.encoded.data(), 1, slot.encoded.size(), file_);
+        bytesWritten_.fetch_add(slot.encoded.size(), std::memory_order_relaxed);
+        slot.state.store(Free, std::memory_order_release);
+        next++;
+    }
+}
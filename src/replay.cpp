@@ -0,0 +1,198 @@
+#include "replay.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+static constexpr char RECORDING_MAGIC[8] = {'6', '5', '0', '2', 'I', 'N', 'P', '1'};
+
+void InputRecording::start(Checkpoint first)
+{
+    events_.clear();
+    checkpoints_.clear();
+    current_ = InputValues{};
+    length_ = first.instruction;
+    checkpoints_.push_back(std::move(first));
+}
+
+void InputRecording::record(uint64_t instruction, InputLine line, uint8_t value)
+{
+    uint8_t &cur = current_.lines[static_cast<int>(line)];
+    if (cur == value)
+        return;
+    cur = value;
+    events_.push_back({instruction, static_cast<uint8_t>(line), value});
+}
+
+bool InputRecording::save(const std::string &path) const
+{
+    std::FILE *out = std::fopen(path.c_str(), "wb");
+    if (!out)
+        return false;
+
+    auto put64 = [&](uint64_t v) { std::fwrite(&v, sizeof(v), 1, out); };
+    std::fwrite(RECORDING_MAGIC, 1, sizeof(RECORDING_MAGIC), out);
+    put64(events_.size());
+    std::fwrite(events_.data(), sizeof(InputEvent), events_.size(), out);
+    put64(length_);
+    put64(checkpoints_.size());
+    for (const Checkpoint &cp : checkpoints_)
+    {
+        put64(cp.instruction);
+        put64(cp.stateHash);
+        std::fwrite(cp.inputs.lines, 1, sizeof(cp.inputs.lines), out);
+        put64(cp.state.size());
+        std::fwrite(cp.state.data(), 1, cp.state.size(), out);
+    }
+    bool ok = std::ferror(out) == 0;
+    return std::fclose(out) == 0 && ok;
+}
+
+bool InputRecording::load(const std::string &path)
+{
+    events_.clear();
+    checkpoints_.clear();
+    std::FILE *in = std::fopen(path.c_str(), "rb");
+    if (!in)
+        return false;
+
+    // Counts come from the file: check them against what is left of it
+    // before sizing anything, so a truncated or corrupt one just fails
+    std::fseek(in, 0, SEEK_END);
+    long fileSize = std::ftell(in);
+    std::fseek(in, 0, SEEK_SET);
+    auto remaining = [&]() -> uint64_t {
+        long pos = std::ftell(in);
+        return fileSize > pos && pos >= 0 ? static_cast<uint64_t>(fileSize - pos) : 0;
+    };
+
+    auto get64 = [&](uint64_t &v) { return std::fread(&v, sizeof(v), 1, in) == 1; };
+    char magic[sizeof(RECORDING_MAGIC)];
+    uint64_t count = 0;
+    bool ok = std::fread(magic, 1, sizeof(magic), in) == sizeof(magic) &&
+              std::memcmp(magic, RECORDING_MAGIC, sizeof(magic)) == 0 && get64(count);
+    if (ok && count > remaining() / sizeof(InputEvent))
+        ok = false;
+    if (ok)
+    {
+        events_.resize(count);
+        ok = std::fread(events_.data(), sizeof(InputEvent), count, in) == count &&
+             get64(length_) && get64(count);
+    }
+    for (uint64_t i = 0; ok && i < count; ++i)
+    {
+        Checkpoint cp;
+        uint64_t size = 0;
+        ok = get64(cp.instruction) && get64(cp.stateHash) &&
+             std::fread(cp.inputs.lines, 1, sizeof(cp.inputs.lines), in) == sizeof(cp.inputs.lines) &&
+             get64(size);
+        if (ok && size > remaining())
+            ok = false;
+        if (ok)
+        {
+            cp.state.resize(size);
+            ok = std::fread(cp.state.data(), 1, size, in) == size;
+            checkpoints_.push_back(std::move(cp));
+        }
+    }
+    std::fclose(in);
+    if (!ok)
+    {
+        events_.clear();
+        checkpoints_.clear();
+    }
+    return ok;
+}
+
+void ReplayInput::seek(uint64_t instruction, const InputValues &values)
+{
+    values_ = values;
+    // Earlier events are already reflected in the checkpoint's values;
+    // re-applying one due exactly at it is harmless
+    auto it = std::lower_bound(events_.begin(), events_.end(), instruction,
+                               [](const InputEvent &e, uint64_t n) { return e.instruction < n; });
+    next_ = static_cast<std::size_t>(it - events_.begin());
+}
+
+bool ReplayInput::readTiaInput(int pin)
+{
+    int line = static_cast<int>(InputLine::TiaInput0) + pin;
+    return line < InputLineCount && values_.lines[line] != 0;
+}
+
+// Restore a checkpoint into `m` (a copy of the configured prototype) and
+// replay inputs until `until`
+template <class MachineT>
+static bool replaySegment(const Checkpoint &from, uint64_t until, MachineT &m, ReplayInput &input)
+{
+    if (!m.LoadState(from.state.data(), from.state.size()))
+        return false;
+    input.attach(m);
+    input.seek(from.instruction, from.inputs);
+    while (m.cpu.instructions < until && !m.cpu.halted && m.cpu.running)
+    {
+        input.advance(m.cpu.instructions);
+        m.Step();
+    }
+    return true;
+}
+
+template <class MachineT>
+void captureCheckpoints(const MachineT &prototype, InputRecording &rec, uint64_t interval)
+{
+    std::vector<Checkpoint> &cps = rec.checkpoints();
+    if (cps.empty())
+        return;
+    if (interval == 0)
+        interval = rec.length();
+
+    Checkpoint first = cps.front();
+    cps.clear();
+    cps.push_back(first);
+
+    MachineT m = prototype;
+    ReplayInput input(rec.events());
+    if (!replaySegment(first, first.instruction, m, input))
+        return;
+    while (m.cpu.instructions < rec.length() && !m.cpu.halted && m.cpu.running)
+    {
+        uint64_t until = std::min(rec.length(), m.cpu.instructions + interval);
+        while (m.cpu.instructions < until && !m.cpu.halted && m.cpu.running)
+        {
+            input.advance(m.cpu.instructions);
+            m.Step();
+        }
+        cps.push_back(makeCheckpoint(m, input.values()));
+    }
+}
+
+template <class MachineT>
+std::vector<SegmentResult> verifyReplay(const MachineT &prototype, const InputRecording &rec, unsigned threads)
+{
+    const std::vector<Checkpoint> &cps = rec.checkpoints();
+    std::vector<SegmentResult> results(cps.size() > 1 ? cps.size() - 1 : 0);
+
+    ThreadPool pool(threads);
+    auto segment = [&](std::size_t i)
+    {
+        const Checkpoint &from = cps[i];
+        const Checkpoint &to = cps[i + 1];
+        SegmentResult &r = results[i];
+        r.start = from.instruction;
+        r.end = to.instruction;
+        r.expected = to.stateHash;
+
+        MachineT m = prototype;
+        ReplayInput input(rec.events());
+        bool reached = replaySegment(from, to.instruction, m, input) && m.cpu.instructions == to.instruction;
+        r.actual = m.StateHash();
+        r.ok = reached && r.actual == r.expected;
+    };
+    pool.parallelFor(results.size(), segment);
+    return results;
+}
+
+#define INSTANTIATE_REPLAY(T)                                                          \
+    template void captureCheckpoints(const Machine<T> &, InputRecording &, uint64_t); \
+    template std::vector<SegmentResult> verifyReplay(const Machine<T> &, const InputRecording &, unsigned);
+FOR_EACH_MACHINE_TYPE(INSTANTIATE_REPLAY)
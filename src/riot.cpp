@@ -1,4 +1,5 @@
 #include "riot.h"
+#include "state_archive.h"
 
 RIOT6532::RIOT6532() {
     reset();
@@ -10,36 +11,35 @@ void RIOT6532::reset() {
     ddra_ = ddrb_ = 0;
     timer_ = 0;
     timerShift_ = 0;
+    prescale_ = 0;
     timerRunning_ = false;
     timerIRQ_ = false;
 }
 
 void RIOT6532::setPortA(ReadPort in, WritePort out) {
-    readA_ = std::move(in);
-    writeA_ = std::move(out);
+    readA_ = in;
+    writeA_ = out;
 }
 
 void RIOT6532::setPortB(ReadPort in, WritePort out) {
-    readB_ = std::move(in);
-    writeB_ = std::move(out);
+    readB_ = in;
+    writeB_ = out;
 }
 
-uint8_t RIOT6532::portRead(uint8_t out, uint8_t ddr, ReadPort in) {
+uint8_t RIOT6532::portRead(uint8_t out, uint8_t ddr, const ReadPort& in) const {
     uint8_t inVal = in ? in() : 0xFF;
     return (out & ddr) | (inVal & ~ddr);
 }
 
-void RIOT6532::portWrite(uint8_t& out, uint8_t ddr, WritePort outFn, uint8_t data) {
+void RIOT6532::portWrite(uint8_t& out, uint8_t ddr, const WritePort& outFn, uint8_t data) {
     out = data;
     if (outFn) outFn(out & ddr);
 }
 
 uint8_t RIOT6532::read(uint16_t addr) {
-    addr &= 0x7F; // RIOT has 128-byte register space
-
-    if (addr < 0x80) {
-        // RAM: $00–$7F
-        return ram_[addr];
+    if ((addr & 0x0200) == 0) {
+        // RAM: $80–$FF
+        return ram_[addr & 0x7F];
     }
 
     uint8_t reg = addr & 0x1F;
@@ -66,10 +66,8 @@ uint8_t RIOT6532::read(uint16_t addr) {
 }
 
 void RIOT6532::write(uint16_t addr, uint8_t data) {
-    addr &= 0x7F;
-
-    if (addr < 0x80) {
-        ram_[addr] = data;
+    if ((addr & 0x0200) == 0) {
+        ram_[addr & 0x7F] = data;
         return;
     }
 
@@ -90,24 +88,28 @@ void RIOT6532::write(uint16_t addr, uint8_t data) {
         case 0x14: // Timer write, prescale 1
             timerShift_ = 0;
             timer_ = data;
+            prescale_ = 0;
             timerRunning_ = true;
             timerIRQ_ = false;
             break;
         case 0x15: // Timer write, prescale 8
             timerShift_ = 3;
             timer_ = data;
+            prescale_ = 0;
             timerRunning_ = true;
             timerIRQ_ = false;
             break;
         case 0x16: // Timer write, prescale 64
             timerShift_ = 6;
             timer_ = data;
+            prescale_ = 0;
             timerRunning_ = true;
             timerIRQ_ = false;
             break;
         case 0x17: // Timer write, prescale 1024
             timerShift_ = 10;
             timer_ = data;
+            prescale_ = 0;
             timerRunning_ = true;
             timerIRQ_ = false;
             break;
@@ -119,10 +121,9 @@ void RIOT6532::write(uint16_t addr, uint8_t data) {
 void RIOT6532::tick() {
     if (!timerRunning_) return;
 
-    static uint16_t prescaleCounter = 0;
-    prescaleCounter++;
-    if (prescaleCounter >= (1u << timerShift_)) {
-        prescaleCounter = 0;
+    prescale_++;
+    if (prescale_ >= (1u << timerShift_)) {
+        prescale_ = 0;
         if (timer_ == 0) {
             timerIRQ_ = true;
             // Underflow: timer continues counting down from 0xFF
@@ -131,4 +132,17 @@ void RIOT6532::tick() {
             timer_--;
         }
     }
-}
\ No newline at end of file
+}
+
+void RIOT6532::serialize(StateArchive& ar) {
+    ar.io(ram_);
+    ar.io(ora_);
+    ar.io(orb_);
+    ar.io(ddra_);
+    ar.io(ddrb_);
+    ar.io(timer_);
+    ar.io(timerShift_);
+    ar.io(prescale_);
+    ar.io(timerRunning_);
+    ar.io(timerIRQ_);
+}
@@ -0,0 +1,78 @@
+#include "rle.h"
+#include <cstring>
+
+static constexpr std::size_t MIN_RUN = 3;
+static constexpr std::size_t MAX_RUN = 0x7F + MIN_RUN;
+static constexpr std::size_t MAX_LITERAL = 0x80;
+
+std::size_t rleEncode(const uint8_t *src, std::size_t n, uint8_t *dst)
+{
+    uint8_t *out = dst;
+    std::size_t i = 0;
+    std::size_t litStart = 0;
+
+    auto flushLiteral = [&](std::size_t end)
+    {
+        while (litStart < end)
+        {
+            std::size_t len = end - litStart;
+            if (len > MAX_LITERAL)
+                len = MAX_LITERAL;
+            *out++ = static_cast<uint8_t>(len - 1);
+            std::memcpy(out, src + litStart, len);
+            out += len;
+            litStart += len;
+        }
+    };
+
+    while (i < n)
+    {
+        // Measure the run starting here
+        uint8_t v = src[i];
+        std::size_t run = 1;
+        while (i + run < n && run < MAX_RUN && src[i + run] == v)
+            run++;
+
+        if (run >= MIN_RUN)
+        {
+            flushLiteral(i);
+            *out++ = static_cast<uint8_t>(0x80 + (run - MIN_RUN));
+            *out++ = v;
+            i += run;
+            litStart = i;
+        }
+        else
+        {
+            i += run;
+        }
+    }
+    flushLiteral(n);
+    return static_cast<std::size_t>(out - dst);
+}
+
+bool rleDecode(const uint8_t *src, std::size_t n, uint8_t *dst, std::size_t outSize)
+{
+    std::size_t in = 0, out = 0;
+    while (in < n)
+    {
+        uint8_t c = src[in++];
+        if (c < 0x80)
+        {
+            std::size_t len = c + 1u;
+            if (in + len > n || out + len > outSize)
+                return false;
+            std::memcpy(dst + out, src + in, len);
+            in += len;
+            out += len;
+        }
+        else
+        {
+            std::size_t len = (c - 0x80u) + MIN_RUN;
+            if (in >= n || out + len > outSize)
+                return false;
+            std::memset(dst + out, src[in++], len);
+            out += len;
+        }
+    }
+    return out == outSize;
+}
@@ -0,0 +1,117 @@
+#include "rom_store.h"
+#include "hash64.h"
+#include "memory.h"
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+static constexpr std::size_t PAGE_BYTES = Memory::PAGE_SIZE;
+
+namespace
+{
+struct Store
+{
+    std::mutex mutex;
+    std::unordered_multimap<uint64_t, std::shared_ptr<uint8_t>> pages;
+    std::unordered_multimap<uint64_t, RomImage> images; // by content
+    std::unordered_multimap<uint64_t, RomImage> files;  // mapped, by FileId
+    std::size_t pruneAt = 1024; // entries, doubled after each prune
+
+    void pruneLocked()
+    {
+        // use_count 1: only the store holds it, and only the store (under
+        // this lock) could hand it out again
+        for (auto it = pages.begin(); it != pages.end();)
+            it = it->second.use_count() == 1 ? pages.erase(it) : std::next(it);
+        for (auto it = images.begin(); it != images.end();)
+            it = it->second.use_count() == 1 ? images.erase(it) : std::next(it);
+        for (auto it = files.begin(); it != files.end();)
+            it = it->second.use_count() == 1 ? files.erase(it) : std::next(it);
+        pruneAt = std::max<std::size_t>(1024, 2 * (pages.size() + images.size() + files.size()));
+    }
+
+    void maybePruneLocked()
+    {
+        if (pages.size() + images.size() + files.size() >= pruneAt)
+            pruneLocked();
+    }
+};
+} // namespace
+
+static Store &store()
+{
+    static Store s;
+    return s;
+}
+
+std::shared_ptr<uint8_t> internPage(const uint8_t *bytes)
+{
+    uint64_t hash = hash64(bytes, PAGE_BYTES);
+    Store &s = store();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    auto range = s.pages.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it)
+        if (std::memcmp(it->second.get(), bytes, PAGE_BYTES) == 0)
+            return it->second;
+
+    s.maybePruneLocked();
+    std::shared_ptr<uint8_t> page = Memory::NewPage();
+    std::memcpy(page.get(), bytes, PAGE_BYTES);
+    s.pages.emplace(hash, page);
+    return page;
+}
+
+RomImage internImage(RomImage image)
+{
+    if (!image)
+        return image;
+    if (const FileId *id = image->fileId())
+    {
+        uint64_t key = hash64(id, sizeof(*id));
+        Store &s = store();
+        std::lock_guard<std::mutex> lock(s.mutex);
+        auto range = s.files.equal_range(key);
+        for (auto it = range.first; it != range.second; ++it)
+            if (*it->second->fileId() == *id)
+                return it->second;
+        s.maybePruneLocked();
+        s.files.emplace(key, image);
+        return image;
+    }
+
+    uint64_t hash = hash64(image->data(), image->size(), image->size());
+    Store &s = store();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    auto range = s.images.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it)
+    {
+        const Image &held = *it->second;
+        if (held.size() == image->size() && std::memcmp(held.data(), image->data(), held.size()) == 0)
+            return it->second;
+    }
+
+    s.maybePruneLocked();
+    s.images.emplace(hash, image);
+    return image;
+}
+
+RomStoreStats romStoreStats()
+{
+    Store &s = store();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    std::size_t bytes = s.pages.size() * PAGE_BYTES;
+    for (const auto &entry : s.images)
+        if (!entry.second->mapped())
+            bytes += entry.second->size();
+    return RomStoreStats{s.pages.size(), s.images.size() + s.files.size(), bytes};
+}
+
+void pruneRomStore()
+{
+    Store &s = store();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    s.pruneLocked();
+}
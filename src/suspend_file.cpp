@@ -0,0 +1,221 @@
+#include "suspend_file.h"
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const char SUSPEND_MAGIC[8] = {'6', '5', '0', '2', 'S', 'U', 'S', 'P'};
+static constexpr uint32_t SUSPEND_VERSION = 2;
+static constexpr std::size_t HEADER_BYTES = 4096; // slots start page aligned
+static constexpr std::size_t SLOT_ALIGN = 4096;
+
+namespace
+{
+struct SlotRecord
+{
+    uint64_t deviceBytes;
+    uint8_t machineType;
+    uint8_t pad[7];
+};
+
+struct SuspendHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t pad;
+    uint64_t deviceCapacity;
+    uint64_t generation; // completed suspends; the newest is in slot (generation - 1) & 1
+    SlotRecord slots[2];
+};
+} // namespace
+
+static_assert(sizeof(SuspendHeader) <= HEADER_BYTES, "suspend header outgrew its page");
+
+static std::size_t SlotBytes(std::size_t deviceCapacity)
+{
+    return (Memory::MAX_MEM + deviceCapacity + SLOT_ALIGN - 1) / SLOT_ALIGN * SLOT_ALIGN;
+}
+
+static bool ValidHeader(const SuspendHeader &h, std::size_t fileSize)
+{
+    return std::memcmp(h.magic, SUSPEND_MAGIC, sizeof(SUSPEND_MAGIC)) == 0 && h.version == SUSPEND_VERSION &&
+           h.deviceCapacity > 0 && h.deviceCapacity < fileSize &&
+           fileSize == HEADER_BYTES + 2 * SlotBytes(static_cast<std::size_t>(h.deviceCapacity));
+}
+
+// A file that may be (re)initialized: empty (just created), or one of
+// ours in another layout. Anything else, e.g. a ROM named by mistake, is
+// left alone.
+static bool Reinitializable(const SuspendHeader &h, std::size_t fileSize, std::size_t got)
+{
+    return fileSize == 0 ||
+           (got >= sizeof(SUSPEND_MAGIC) && std::memcmp(h.magic, SUSPEND_MAGIC, sizeof(SUSPEND_MAGIC)) == 0);
+}
+
+bool SuspendFile::open(const std::string &path, std::size_t deviceCapacity)
+{
+    close();
+    SuspendHeader header{};
+    std::size_t size = 0;
+#if defined(_WIN32)
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_ALWAYS,
+                              FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+    LARGE_INTEGER length;
+    DWORD got = 0;
+    if (!GetFileSizeEx(file, &length) || !ReadFile(file, &header, sizeof(header), &got, nullptr))
+    {
+        CloseHandle(file);
+        return false;
+    }
+    bool keep = got == sizeof(header) && ValidHeader(header, static_cast<std::size_t>(length.QuadPart));
+    if (!keep && !Reinitializable(header, static_cast<std::size_t>(length.QuadPart), got))
+    {
+        CloseHandle(file);
+        return false;
+    }
+    if (keep)
+        deviceCapacity = static_cast<std::size_t>(header.deviceCapacity);
+    size = HEADER_BYTES + 2 * SlotBytes(deviceCapacity);
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READWRITE, static_cast<DWORD>(uint64_t(size) >> 32),
+                                        static_cast<DWORD>(size), nullptr);
+    if (mapping)
+    {
+        base_ = static_cast<uint8_t *>(MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size));
+        CloseHandle(mapping); // the view keeps it alive
+    }
+    if (!base_)
+    {
+        CloseHandle(file);
+        return false;
+    }
+    file_ = file;
+#else
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    ssize_t got = fstat(fd, &st) == 0 ? pread(fd, &header, sizeof(header), 0) : -1;
+    if (got < 0)
+    {
+        ::close(fd);
+        return false;
+    }
+    bool keep = got == static_cast<ssize_t>(sizeof(header)) && ValidHeader(header, static_cast<std::size_t>(st.st_size));
+    if (!keep && !Reinitializable(header, static_cast<std::size_t>(st.st_size), static_cast<std::size_t>(got)))
+    {
+        ::close(fd);
+        return false;
+    }
+    if (keep)
+        deviceCapacity = static_cast<std::size_t>(header.deviceCapacity);
+    size = HEADER_BYTES + 2 * SlotBytes(deviceCapacity);
+    if (!keep && ftruncate(fd, static_cast<off_t>(size)) != 0)
+    {
+        ::close(fd);
+        return false;
+    }
+    void *base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd); // the mapping keeps the file
+    if (base == MAP_FAILED)
+        return false;
+    base_ = static_cast<uint8_t *>(base);
+#endif
+    size_ = size;
+    deviceCapacity_ = deviceCapacity;
+    slotBytes_ = SlotBytes(deviceCapacity);
+
+    if (!keep)
+    {
+        // Start empty: nothing is resumable until the first suspend
+        // has synced
+        SuspendHeader fresh{};
+        std::memcpy(fresh.magic, SUSPEND_MAGIC, sizeof(SUSPEND_MAGIC));
+        fresh.version = SUSPEND_VERSION;
+        fresh.deviceCapacity = deviceCapacity;
+        std::memcpy(base_, &fresh, sizeof(fresh));
+        if (!sync())
+        {
+            close();
+            return false;
+        }
+    }
+    return true;
+}
+
+void SuspendFile::close()
+{
+    if (!base_)
+        return;
+#if defined(_WIN32)
+    UnmapViewOfFile(base_);
+    CloseHandle(static_cast<HANDLE>(file_));
+    file_ = nullptr;
+#else
+    munmap(base_, size_);
+#endif
+    base_ = nullptr;
+    size_ = 0;
+}
+
+bool SuspendFile::savedType(MachineType &type) const
+{
+    if (!base_)
+        return false;
+    const SuspendHeader &h = *reinterpret_cast<const SuspendHeader *>(base_);
+    if (h.generation == 0 || h.slots[(h.generation - 1) & 1].machineType >= MachineTypeCount)
+        return false;
+    type = static_cast<MachineType>(h.slots[(h.generation - 1) & 1].machineType);
+    return true;
+}
+
+int SuspendFile::nextSlot() const
+{
+    return static_cast<int>(reinterpret_cast<const SuspendHeader *>(base_)->generation & 1);
+}
+
+int SuspendFile::lastSlot(MachineType type, std::size_t &deviceBytes) const
+{
+    MachineType saved;
+    if (!savedType(saved) || saved != type)
+        return -1;
+    const SuspendHeader &h = *reinterpret_cast<const SuspendHeader *>(base_);
+    int slot = static_cast<int>((h.generation - 1) & 1);
+    if (h.slots[slot].deviceBytes > deviceCapacity_)
+        return -1;
+    deviceBytes = static_cast<std::size_t>(h.slots[slot].deviceBytes);
+    return slot;
+}
+
+uint8_t *SuspendFile::slotRam(int slot) const
+{
+    return base_ + HEADER_BYTES + slot * slotBytes_;
+}
+
+bool SuspendFile::commit(int slot, MachineType type, std::size_t deviceBytes)
+{
+    // The slot reaches the disk before the header names it
+    if (!sync())
+        return false;
+    SuspendHeader &h = *reinterpret_cast<SuspendHeader *>(base_);
+    h.slots[slot].deviceBytes = deviceBytes;
+    h.slots[slot].machineType = static_cast<uint8_t>(type);
+    h.generation++;
+    return sync();
+}
+
+bool SuspendFile::sync()
+{
+#if defined(_WIN32)
+    return FlushViewOfFile(base_, 0) && FlushFileBuffers(static_cast<HANDLE>(file_));
+#else
+    return msync(base_, size_, MS_SYNC) == 0; // writes back only the dirty pages
+#endif
+}
@@ -1,10 +1,9 @@
 #include "tia.h"
+#include "state_archive.h"
 #include <algorithm>
 
-TIA::TIA(TIAColorSpace)
+TIA::TIA(TIAColorSpace cs) : colorSpace_(cs)
 {
-    // Allocate full-frame buffer (color clocks × scanlines)
-    framebuffer_.assign(ScanlinesPerFrame, std::vector<uint8_t>(ColorClocksPerScanline, 0));
     reset(true);
 }
 
@@ -15,17 +14,19 @@ void TIA::reset(bool ntsc)
     dot_ = 0;
     frame_ = 0;
 
-    for (auto &row : framebuffer_)
-        std::fill(row.begin(), row.end(), 0);
+    framebuffer_.clear();
 
     vsync_ = false;
+    vsyncDriven_ = false;
     vblank_ = false;
 
     colubk_ = 0x00;
-    colupf_ = 0x0E;
+    colupf_ = 0x07;
 
     pf0_ = pf1_ = pf2_ = 0;
     ctrlpf_ = 0;
+
+    audio_.reset(ntsc);
 }
 
 void TIA::write(uint16_t addr, uint8_t v)
@@ -50,12 +51,17 @@ int TIA::tick(int colorClocks)
     return produced;
 }
 
+void TIA::convertFrame(void *dst, std::size_t dstStride) const
+{
+    palette().convertFrame(framebuffer_.front(), static_cast<PixelFormat>(colorSpace_), dst, dstStride);
+}
+
 uint8_t TIA::currentPixel() const
 {
     // Guard against eol/eof boundary
     int l = std::min(std::max(line_, 0), ScanlinesPerFrame - 1);
     int d = std::min(std::max(dot_, 0), ColorClocksPerScanline - 1);
-    return framebuffer_[l][d];
+    return framebuffer_.backRow(l)[d];
 }
 
 void TIA::incrementBeam()
@@ -65,16 +71,29 @@ void TIA::incrementBeam()
     {
         dot_ = 0;
         line_++;
+        audio_.advance(TIAAudio::TicksPerScanline);
         // Apply any latched HMOVE at line start (not implemented yet)
         hmoveLatchAndApply();
-        if (line_ >= ScanlinesPerFrame)
+        // VSYNC ends the frame while the game drives it, however many
+        // lines its kernel takes; without one for a whole frame the beam
+        // wraps on its own
+        if (line_ >= (vsyncDriven_ ? 2 * ScanlinesPerFrame : ScanlinesPerFrame))
         {
             line_ = 0;
-            frame_++;
+            vsyncDriven_ = false;
+            endFrame();
         }
     }
 }
 
+void TIA::endFrame()
+{
+    // Publish the finished frame; drawing continues into the other buffer
+    framebuffer_.swap();
+    frame_++;
+    audio_.endBlock();
+}
+
 // Horizontal clocks per scanline for NTSC
 static constexpr int HORIZ_CLOCKS_PER_LINE = 228;
 
@@ -218,8 +237,9 @@ void TIA::renderDot()
         color = colupf_;
     }
 
-    // Store pixel
-    framebuffer_[line_][dot_] = color;
+    // Store pixel; lines past the buffer (a long kernel) aren't shown
+    if (line_ < ScanlinesPerFrame)
+        framebuffer_.backRow(line_)[dot_] = color;
 }
 
 uint8_t TIA::tiaReadReg(uint8_t r)
@@ -264,9 +284,19 @@ void TIA::tiaWriteReg(uint8_t r, uint8_t v)
     switch (r)
     {
     case VSYNC:
+    {
         // Bit 1 set -> VSYNC active for 3 scanlines typically
-        vsync_ = (v & 0x02) != 0;
+        bool start = (v & 0x02) != 0;
+        // Rising edge ends the frame being drawn and restarts the beam at the top
+        if (start && !vsync_ && line_ > 0)
+        {
+            endFrame();
+            line_ = 0;
+            vsyncDriven_ = true;
+        }
+        vsync_ = start;
         break;
+    }
     case VBLANK:
         // Bit 1 set -> VBLANK (video off); bit 7 affects input latching
         vblank_ = (v & 0x02) != 0;
@@ -287,12 +317,12 @@ void TIA::tiaWriteReg(uint8_t r, uint8_t v)
         // Simplified: real RSYNC aligns horizontal sync; we can noop for now
         break;
 
-    // Colors
+    // Colors (bit 0 is unused; bits 7..1 select the palette entry)
     case COLUBK:
-        colubk_ = v & 0x7F;
+        colubk_ = v >> 1;
         break;
     case COLUPF:
-        colupf_ = v & 0x7F;
+        colupf_ = v >> 1;
         break;
 
     // Playfield
@@ -381,9 +411,63 @@ void TIA::tiaWriteReg(uint8_t r, uint8_t v)
         player1_.size = (nusiz1_ == 5) ? 2 : (nusiz1_ == 7 ? 4 : 1);
         break;
 
+    // === Audio (logged, synthesized at end of frame) ===
+    case AUDC0:
+    case AUDC1:
+    case AUDF0:
+    case AUDF1:
+    case AUDV0:
+    case AUDV1:
+        audio_.write(r - AUDC0, v, dot_ >= ColorClocksPerScanline / 2 ? 1 : 0);
+        break;
+
     default:
         // Mirrors and unused register slots
         (void)v;
         break;
     }
-}
\ No newline at end of file
+}
+
+// Field by field: the struct's padding is not state
+void TIA::Object::serialize(StateArchive &ar)
+{
+    ar.io(x);
+    ar.io(gfx);
+    ar.io(enabled);
+    ar.io(reflect);
+    ar.io(size);
+    ar.io(copySpacing);
+    ar.io(motion);
+}
+
+void TIA::serialize(StateArchive &ar)
+{
+    ar.io(ntsc_);
+    ar.io(line_);
+    ar.io(dot_);
+    ar.io(frame_);
+    framebuffer_.serialize(ar);
+    audio_.serialize(ar);
+
+    ar.io(vsync_);
+    ar.io(vsyncDriven_);
+    ar.io(vblank_);
+    ar.io(colubk_);
+    ar.io(colupf_);
+    ar.io(pf0_);
+    ar.io(pf1_);
+    ar.io(pf2_);
+    ar.io(ctrlpf_);
+
+    player0_.serialize(ar);
+    player1_.serialize(ar);
+    missile0_.serialize(ar);
+    missile1_.serialize(ar);
+    ball_.serialize(ar);
+    ar.io(nusiz0_);
+    ar.io(nusiz1_);
+    ar.io(enam0_);
+    ar.io(enam1_);
+    ar.io(enabl_);
+    ar.io(ballSize_);
+}
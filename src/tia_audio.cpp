@@ -0,0 +1,227 @@
+#include "tia_audio.h"
+#include "state_archive.h"
+#include <array>
+#include <cmath>
+
+// ------------------------------------------------------------
+// Waveform tables, generated at compile time
+// ------------------------------------------------------------
+
+// Output bit sequence of a maximal-length Fibonacci LFSR with taps at
+// Bits and Tap (x^Bits + x^Tap + 1)
+template <int Bits, int Tap>
+static constexpr std::array<uint8_t, (1 << Bits) - 1> makePoly()
+{
+    std::array<uint8_t, (1 << Bits) - 1> table{};
+    unsigned reg = (1u << Bits) - 1;
+    for (std::size_t i = 0; i < table.size(); ++i)
+    {
+        table[i] = static_cast<uint8_t>(reg & 1);
+        unsigned feedback = (reg ^ (reg >> (Bits - Tap))) & 1;
+        reg = (reg >> 1) | (feedback << (Bits - 1));
+    }
+    return table;
+}
+
+static constexpr auto POLY4 = makePoly<4, 3>(); // 15 steps
+static constexpr auto POLY5 = makePoly<5, 3>(); // 31 steps
+static constexpr auto POLY9 = makePoly<9, 5>(); // 511 steps
+
+// Divide-by-31 with the TIA's uneven 18:13 duty cycle: a clock edge at
+// steps 0 and 18 of the 31-step cycle
+static constexpr std::array<uint8_t, 31> makeDiv31()
+{
+    std::array<uint8_t, 31> table{};
+    table[0] = 1;
+    table[18] = 1;
+    return table;
+}
+static constexpr auto DIV31 = makeDiv31();
+
+// Mixed level of both channels (0..30) to a sample
+static constexpr std::array<int16_t, 31> makeVolume()
+{
+    std::array<int16_t, 31> table{};
+    for (int i = 0; i < 31; ++i)
+        table[i] = static_cast<int16_t>(i * 32767 / 30);
+    return table;
+}
+static constexpr auto VOLUME = makeVolume();
+
+TIAAudio::TIAAudio()
+{
+    log_.reserve(256);
+    native_.reserve(1024);
+    reset(true);
+}
+
+void TIAAudio::reset(bool ntsc)
+{
+    ch_[0] = Channel{};
+    ch_[1] = Channel{};
+    log_.clear();
+    blockTicks_ = 0;
+    nativeRate_ = ntsc ? NativeRateNTSC : NativeRatePAL;
+    phase_ = 0.0;
+    prev_ = 0;
+    native_.clear();
+}
+
+void TIAAudio::setOutput(AudioRing *ring, int hostRate)
+{
+    ring_ = ring;
+    hostRate_ = hostRate;
+    phase_ = 0.0;
+}
+
+void TIAAudio::write(uint8_t reg, uint8_t value, int tickOffset)
+{
+    log_.push_back(RegWrite{blockTicks_ + tickOffset, reg, value});
+}
+
+void TIAAudio::apply(const RegWrite &w)
+{
+    Channel &c = ch_[w.reg & 1];
+    switch (w.reg >> 1)
+    {
+    case 0:
+        c.audc = w.value & 0x0F;
+        break;
+    case 1:
+        c.audf = w.value & 0x1F;
+        break;
+    default:
+        c.audv = w.value & 0x0F;
+        break;
+    }
+}
+
+void TIAAudio::clockChannel(Channel &c)
+{
+    // Frequency divider: one output clock every AUDF+1 ticks
+    if (c.divCounter < c.audf)
+    {
+        c.divCounter++;
+        return;
+    }
+    c.divCounter = 0;
+
+    // Modes 12-15 divide by a further 3
+    if ((c.audc & 0x0C) == 0x0C)
+    {
+        if (++c.div3 < 3)
+            return;
+        c.div3 = 0;
+    }
+
+    if (++c.p5 == POLY5.size())
+        c.p5 = 0;
+
+    switch (c.audc)
+    {
+    case 0x0:
+    case 0xB:
+        c.out = 1; // constant level, volume only
+        break;
+    case 0x1: // 4-bit poly
+        if (++c.p4 == POLY4.size())
+            c.p4 = 0;
+        c.out = POLY4[c.p4];
+        break;
+    case 0x2: // div 15 -> 4-bit poly
+        if (DIV31[c.p5] && ++c.p4 == POLY4.size())
+            c.p4 = 0;
+        c.out = POLY4[c.p4];
+        break;
+    case 0x3: // 5-bit poly -> 4-bit poly
+        if (POLY5[c.p5] && ++c.p4 == POLY4.size())
+            c.p4 = 0;
+        c.out = POLY4[c.p4];
+        break;
+    case 0x4:
+    case 0x5:
+    case 0xC:
+    case 0xD:
+        c.out ^= 1; // pure tone (div 2, or div 6 with the extra div 3)
+        break;
+    case 0x6:
+    case 0xA:
+    case 0xE:
+        if (DIV31[c.p5])
+            c.out ^= 1; // div 31 tone (div 93 for mode 14)
+        break;
+    case 0x7:
+    case 0x9:
+    case 0xF:
+        c.out = POLY5[c.p5]; // 5-bit poly
+        break;
+    case 0x8: // 9-bit poly (white noise)
+        if (++c.p9 == POLY9.size())
+            c.p9 = 0;
+        c.out = POLY9[c.p9];
+        break;
+    }
+}
+
+void TIAAudio::endBlock()
+{
+    native_.resize(static_cast<std::size_t>(blockTicks_));
+
+    std::size_t next = 0;
+    for (int t = 0; t < blockTicks_; ++t)
+    {
+        while (next < log_.size() && log_[next].tick <= t)
+            apply(log_[next++]);
+
+        clockChannel(ch_[0]);
+        clockChannel(ch_[1]);
+        int level = (ch_[0].out ? ch_[0].audv : 0) + (ch_[1].out ? ch_[1].audv : 0);
+        native_[t] = VOLUME[level];
+    }
+    // Writes on the block's last half-line belong to the next block
+    for (; next < log_.size(); ++next)
+        apply(log_[next]);
+
+    log_.clear();
+    blockTicks_ = 0;
+
+    if (ring_ && hostRate_ > 0)
+        resampleToOutput();
+}
+
+void TIAAudio::resampleToOutput()
+{
+    const std::size_t n = native_.size();
+    if (n == 0)
+        return;
+
+    // Linear interpolation across the whole block; prev_ carries the last
+    // sample over so consecutive blocks join without a seam
+    const double step = nativeRate_ / (hostRate_ * rateAdjust_);
+    host_.clear();
+    while (phase_ < static_cast<double>(n))
+    {
+        std::size_t i = static_cast<std::size_t>(phase_);
+        double frac = phase_ - static_cast<double>(i);
+        int s0 = (i == 0) ? prev_ : native_[i - 1];
+        int s1 = native_[i];
+        host_.push_back(static_cast<int16_t>(s0 + (s1 - s0) * frac));
+        phase_ += step;
+    }
+    phase_ -= static_cast<double>(n);
+    prev_ = native_[n - 1];
+
+    std::size_t written = ring_->write(host_.data(), host_.size());
+    dropped_ += host_.size() - written;
+}
+
+void TIAAudio::serialize(StateArchive &ar)
+{
+    ar.io(ch_);
+    ar.io(log_);
+    ar.io(blockTicks_);
+    ar.io(nativeRate_);
+    ar.io(rateAdjust_);
+    ar.io(phase_);
+    ar.io(prev_);
+}
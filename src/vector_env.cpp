@@ -0,0 +1,223 @@
+#include "vector_env.h"
+#include "rom_store.h"
+#include <algorithm>
+#include <cstring>
+
+// A frame that hasn't completed after this many instructions (the CPU
+// stopped driving VSYNC) ends the episode
+static constexpr uint64_t MAX_INSTRUCTIONS_PER_FRAME = 100000;
+
+void VectorEnv::Joystick::set(uint8_t action)
+{
+    // SWCHA player 0: bit 7 right, 6 left, 5 down, 4 up, low = pressed
+    uint8_t p0 = 0xF0;
+    if (action & ActionRight)
+        p0 &= ~0x80;
+    if (action & ActionLeft)
+        p0 &= ~0x40;
+    if (action & ActionDown)
+        p0 &= ~0x20;
+    if (action & ActionUp)
+        p0 &= ~0x10;
+    swcha = p0 | 0x0F;
+    fire = (action & ActionFire) != 0;
+}
+
+VectorEnv::VectorEnv(const EnvConfig &config)
+    : config_(config), pool_(config.threads)
+{
+    config_.instances = std::max(1, config_.instances);
+    config_.frameSkip = std::max(1, config_.frameSkip);
+    config_.downsample = std::max(1, config_.downsample);
+
+    // Cartridge at $1000-$1FFF of the 6507's 8 KiB space, banked if its
+    // scheme takes it; otherwise loaded as RAM, images under 4K repeating
+    const std::vector<uint8_t> &rom = config_.rom;
+    if (!boot_.mem.InsertCartridge(internImage(Image::fromBytes(rom)), config_.scheme))
+    {
+        std::size_t size = std::min<std::size_t>(rom.size(), 0x1000);
+        for (std::size_t at = 0; size && at < 0x1000; at += size)
+            boot_.mem.Load(static_cast<uint16_t>(0x1000 + at), rom.data(), std::min(size, 0x1000 - at));
+    }
+    boot_.Reset();
+
+    Instance bootEnv;
+    bootEnv.machine = boot_;
+    attach(bootEnv);
+    for (int f = 0; f < config_.bootFrames && runFrame(bootEnv.machine); ++f)
+    {
+    }
+    boot_ = bootEnv.machine; // its ports still point at bootEnv; every fork re-attaches
+
+    palette_ = &boot_.mem.FramePalette();
+    uint8_t ramp[256];
+    for (int i = 0; i < 256; ++i)
+        ramp[i] = static_cast<uint8_t>(i);
+    palette_->convertRow(ramp, 256, PixelFormat::Luma8, luma_);
+
+    // Clamp the window to the frame
+    FrameView frame = boot_.mem.Frame();
+    int frameWidth = frame.pixels ? frame.width : config_.left + config_.width;
+    int frameHeight = frame.pixels ? frame.height : config_.top + config_.height;
+    config_.left = std::clamp(config_.left, 0, frameWidth);
+    config_.top = std::clamp(config_.top, 0, frameHeight);
+    config_.width = std::clamp(config_.width, 0, frameWidth - config_.left);
+    config_.height = std::clamp(config_.height, 0, frameHeight - config_.top);
+    obsWidth_ = config_.width / config_.downsample;
+    obsHeight_ = config_.height / config_.downsample;
+
+    envs_.reserve(config_.instances);
+    for (int i = 0; i < config_.instances; ++i)
+    {
+        envs_.push_back(MachinePool<Instance>::create());
+        restart(*envs_[i]);
+    }
+}
+
+void VectorEnv::attach(Instance &env)
+{
+    Joystick *joy = &env.joystick;
+    env.machine.mem.riot.setPortA(RIOT6532::ReadPort::bind<&Joystick::readPortA>(joy), {});
+    env.machine.mem.riot.setPortB(RIOT6532::ReadPort::bind<&Joystick::readPortB>(joy), {});
+    env.machine.mem.tia.setInputReader(TIA::InputReader::bind<&Joystick::readInput>(joy));
+}
+
+void VectorEnv::restart(Instance &env)
+{
+    env.machine = boot_.Fork();
+    env.joystick = Joystick{};
+    attach(env);
+    env.score = score(env.machine);
+    env.frames = 0;
+}
+
+bool VectorEnv::runFrame(EnvMachine &m) const
+{
+    uint64_t sequence = m.mem.FrameSequence();
+    uint64_t limit = m.cpu.instructions + MAX_INSTRUCTIONS_PER_FRAME;
+    while (m.mem.FrameSequence() == sequence)
+    {
+        if (m.cpu.halted || !m.cpu.running || m.cpu.instructions >= limit)
+            return false;
+        m.Step();
+    }
+    return true;
+}
+
+int64_t VectorEnv::score(const EnvMachine &m) const
+{
+    int64_t total = 0;
+    for (const RewardSource &src : config_.rewards)
+    {
+        int64_t value = 0;
+        for (int i = 0; i < src.bytes; ++i)
+        {
+            uint8_t b = m.mem.Peek(static_cast<uint16_t>(src.addr + i));
+            value = src.bcd ? value * 100 + (b >> 4) * 10 + (b & 0x0F) : value * 256 + b;
+        }
+        total += value * src.scale;
+    }
+    return total;
+}
+
+bool VectorEnv::finished(const Instance &env) const
+{
+    if (env.frames >= config_.maxEpisodeFrames)
+        return true;
+    for (const DoneCondition &d : config_.dones)
+    {
+        if ((env.machine.mem.Peek(d.addr) & d.mask) == d.value)
+            return true;
+    }
+    return false;
+}
+
+// Crop, box-filter and convert the last completed frame into `dst`
+void VectorEnv::observe(const EnvMachine &m, uint8_t *dst) const
+{
+    FrameView frame = m.mem.Frame();
+    if (!frame.pixels)
+    {
+        std::memset(dst, 0, observationBytes());
+        return;
+    }
+
+    const int n = config_.downsample;
+    const int area = n * n;
+    const bool rgb = config_.format == ObservationFormat::RGB;
+    for (int oy = 0; oy < obsHeight_; ++oy)
+    {
+        const uint8_t *src = frame.row(config_.top + oy * n) + config_.left;
+        if (n == 1 && !rgb)
+        {
+            // Straight palette conversion into the caller's buffer
+            palette_->convertRow(src, obsWidth_, PixelFormat::Luma8, dst);
+            dst += obsWidth_;
+            continue;
+        }
+
+        for (int ox = 0; ox < obsWidth_; ++ox)
+        {
+            uint32_t sum[3] = {0, 0, 0};
+            for (int dy = 0; dy < n; ++dy)
+            {
+                const uint8_t *p = src + static_cast<std::size_t>(dy) * frame.stride + ox * n;
+                for (int dx = 0; dx < n; ++dx)
+                {
+                    if (rgb)
+                    {
+                        uint32_t c = palette_->rgb(p[dx]);
+                        sum[0] += (c >> 16) & 0xFF;
+                        sum[1] += (c >> 8) & 0xFF;
+                        sum[2] += c & 0xFF;
+                    }
+                    else
+                    {
+                        sum[0] += luma_[p[dx]];
+                    }
+                }
+            }
+            for (int c = 0; c < (rgb ? 3 : 1); ++c)
+                *dst++ = static_cast<uint8_t>(sum[c] / area);
+        }
+    }
+}
+
+void VectorEnv::reset(uint8_t *observations)
+{
+    const std::size_t bytes = observationBytes();
+    auto resetOne = [&](std::size_t i)
+    {
+        restart(*envs_[i]);
+        observe(envs_[i]->machine, observations + i * bytes);
+    };
+    pool_.parallelFor(static_cast<std::size_t>(config_.instances), resetOne);
+}
+
+void VectorEnv::step(const uint8_t *actions, uint8_t *observations, float *rewards, uint8_t *dones)
+{
+    const std::size_t bytes = observationBytes();
+    auto stepOne = [&](std::size_t i)
+    {
+        Instance &env = *envs_[i];
+        env.joystick.set(actions[i]);
+
+        bool done = false;
+        for (int f = 0; f < config_.frameSkip && !done; ++f)
+        {
+            done = !runFrame(env.machine);
+            env.frames++;
+            done = done || finished(env);
+        }
+
+        int64_t s = score(env.machine);
+        rewards[i] = static_cast<float>(s - env.score);
+        env.score = s;
+        dones[i] = done;
+
+        if (done)
+            restart(env);
+        observe(env.machine, observations + i * bytes);
+    };
+    pool_.parallelFor(static_cast<std::size_t>(config_.instances), stepOne);
+}
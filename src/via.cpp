@@ -1,4 +1,5 @@
 #include "via.h"
+#include "state_archive.h"
 
 VIA6522::VIA6522() {
     ORA = ORB = 0;
@@ -105,4 +106,19 @@ void VIA6522::UpdateIRQ() {
 
 void VIA6522::SetIFR(uint8_t mask) {
     IFR |= mask;
-}
\ No newline at end of file
+}
+
+void VIA6522::Serialize(StateArchive& ar) {
+    ar.io(irq_line);
+    ar.io(portA_in);
+    ar.io(portB_in);
+    ar.io(portA_out);
+    ar.io(portB_out);
+    ar.io(ORB); ar.io(ORA);
+    ar.io(DDRB); ar.io(DDRA);
+    ar.io(T1C); ar.io(T1L);
+    ar.io(T2C);
+    ar.io(SR);
+    ar.io(ACR); ar.io(PCR);
+    ar.io(IFR); ar.io(IER);
+}
@@ -1,8 +1,25 @@
 #include "vic.h"
+#include "state_archive.h"
 #include <algorithm>
+#include <cstring>
 
-VIC::VIC(VICColorSpace) {
-    framebuffer_.assign(ScreenHeight, std::vector<uint8_t>(ScreenWidth, 0));
+// Pattern byte -> eight 0x00/0xFF pixel masks, leftmost pixel (bit 7) first
+static const uint64_t* glyphMasks() {
+    static const struct Table {
+        uint64_t masks[256];
+        Table() {
+            for (int p = 0; p < 256; ++p) {
+                uint8_t bytes[8];
+                for (int bit = 0; bit < 8; ++bit)
+                    bytes[bit] = (p & (0x80 >> bit)) ? 0xFF : 0x00;
+                std::memcpy(&masks[p], bytes, sizeof(bytes));
+            }
+        }
+    } table;
+    return table.masks;
+}
+
+VIC::VIC(VICColorSpace cs) : colorSpace_(cs) {
     reset(true);
 }
 
@@ -16,11 +33,20 @@ void VIC::reset(bool pal) {
     borderColor_ = 0;
     screenMemBase_ = 0x1E00;
     charMemBase_   = 0x1000;
-    for (auto& row : framebuffer_) std::fill(row.begin(), row.end(), 0);
+    framebuffer_.clear();
+    stamp_ = 1;
+    regStamp_ = 0;
+    std::fill(std::begin(blockStamp_), std::end(blockStamp_), 0);
+    std::fill(std::begin(lineStamp_), std::end(lineStamp_), 0);
+}
+
+void VIC::convertFrame(void* dst, std::size_t dstStride) const {
+    palette().convertFrame(framebuffer_.front(), static_cast<PixelFormat>(colorSpace_), dst, dstStride);
 }
 
 void VIC::write(uint16_t addr, uint8_t data) {
     uint8_t reg = addr & 0x0F;
+    regStamp_ = stamp_;
     switch (reg) {
         case 0x00: ctrlReg1_ = data; break;
         case 0x01: ctrlReg2_ = data; break;
@@ -33,7 +59,7 @@ void VIC::write(uint16_t addr, uint8_t data) {
     }
 }
 
-uint8_t VIC::read(uint16_t addr) {
+uint8_t VIC::read(uint16_t addr) const {
     uint8_t reg = addr & 0x0F;
     switch (reg) {
         case 0x00: return ctrlReg1_;
@@ -46,7 +72,8 @@ uint8_t VIC::read(uint16_t addr) {
 }
 
 void VIC::tick() {
-    renderPixel();
+    // The whole line is drawn when the beam enters it
+    if (rasterX_ == 0) renderLine();
     rasterX_++;
     if (rasterX_ >= ScreenWidth) {
         rasterX_ = 0;
@@ -54,41 +81,100 @@ void VIC::tick() {
     }
 }
 
-void VIC::renderPixel() {
-    // Border check
-    if (rasterX_ < BorderLeft || rasterX_ >= ScreenWidth - BorderRight ||
-        rasterY_ < BorderTop || rasterY_ >= ScreenHeight - BorderBottom) {
-        framebuffer_[rasterY_][rasterX_] = borderColor_;
+bool VIC::lineUnchanged(int y, uint16_t screenAddr) const {
+    uint32_t drawn = lineStamp_[y];
+    // Only trust the tracking when every RAM write goes through noteWrite()
+    if (!mem_ || drawn == 0 || regStamp_ >= drawn) return false;
+
+    uint16_t screenEnd = static_cast<uint16_t>(screenAddr + TextColumns - 1);
+    uint16_t charEnd = static_cast<uint16_t>(charMemBase_ + 256 * 8 - 1);
+    return blockStamp_[screenAddr >> 10] < drawn &&
+           blockStamp_[screenEnd >> 10] < drawn &&
+           blockStamp_[charMemBase_ >> 10] < drawn &&
+           blockStamp_[charEnd >> 10] < drawn;
+}
+
+void VIC::renderLine() {
+    uint8_t* row = framebuffer_.backRow(rasterY_);
+
+    // Border lines
+    if (rasterY_ < BorderTop || rasterY_ >= ScreenHeight - BorderBottom) {
+        std::memset(row, borderColor_, ScreenWidth);
         return;
     }
 
-    if (!memRead_) {
-        framebuffer_[rasterY_][rasterX_] = bgColor_;
+    if (!mem_ && !memRead_) {
+        std::memset(row, borderColor_, BorderLeft);
+        std::memset(row + BorderLeft, bgColor_, ScreenWidth - BorderLeft - BorderRight);
+        std::memset(row + ScreenWidth - BorderRight, borderColor_, BorderRight);
         return;
     }
 
-    // Character cell coordinates
-    int cellX = (rasterX_ - BorderLeft) / 8;
-    int cellY = (rasterY_ - BorderTop) / 8;
+    // Character row for this raster line
+    int textY = rasterY_ - BorderTop;
+    int rowInChar = textY % 8;
+    uint16_t screenAddr = static_cast<uint16_t>(screenMemBase_ + (textY / 8) * TextColumns);
 
-    uint16_t screenAddr = screenMemBase_ + cellY * 22 + cellX;
-    uint8_t charCode = memRead_(screenAddr);
+    // Nothing this line reads has changed: the previous frame already has it
+    if (lineUnchanged(rasterY_, screenAddr)) {
+        std::memcpy(row, framebuffer_.frontRow(rasterY_), ScreenWidth);
+        return;
+    }
+    lineStamp_[rasterY_] = stamp_;
+    if (++stamp_ == 0) {
+        // Wrapped: forget all history rather than compare across the wrap
+        std::fill(std::begin(blockStamp_), std::end(blockStamp_), 0);
+        std::fill(std::begin(lineStamp_), std::end(lineStamp_), 0);
+        regStamp_ = 0;
+        stamp_ = 1;
+    }
 
-    // Fetch bitmap row from character memory
-    int rowInChar = (rasterY_ - BorderTop) % 8;
-    uint16_t charAddr = charMemBase_ + charCode * 8 + rowInChar;
-    uint8_t pattern = memRead_(charAddr);
+    std::memset(row, borderColor_, BorderLeft);
+    std::memset(row + ScreenWidth - BorderRight, borderColor_, BorderRight);
 
-    int bit = 7 - ((rasterX_ - BorderLeft) % 8);
-    bool pixelOn = (pattern >> bit) & 1;
+    const uint64_t* masks = glyphMasks();
+    const uint64_t fg = ForegroundColor * 0x0101010101010101ULL;
+    const uint64_t bg = bgColor_ * 0x0101010101010101ULL;
+    const int cells = (ScreenWidth - BorderLeft - BorderRight) / 8;
+    uint8_t* out = row + BorderLeft;
 
-    framebuffer_[rasterY_][rasterX_] = pixelOn ? 1 : bgColor_;
+    for (int cellX = 0; cellX < cells; ++cellX) {
+        uint8_t charCode = fetch(static_cast<uint16_t>(screenAddr + cellX));
+        uint8_t pattern = fetch(static_cast<uint16_t>(charMemBase_ + charCode * 8 + rowInChar));
+        uint64_t mask = masks[pattern];
+        uint64_t pixels = (fg & mask) | (bg & ~mask);
+        std::memcpy(out + cellX * 8, &pixels, 8);
+    }
 }
 
 void VIC::nextRaster() {
     rasterY_++;
     if (rasterY_ >= ScreenHeight) {
         rasterY_ = 0;
+        framebuffer_.swap(); // publish the completed frame
         frameCount_++;
     }
-}
\ No newline at end of file
+}
+
+void VIC::serialize(StateArchive& ar)
+{
+    ar.io(pal_);
+    ar.io(rasterX_);
+    ar.io(rasterY_);
+    ar.io(frameCount_);
+    ar.io(ctrlReg1_);
+    ar.io(ctrlReg2_);
+    ar.io(rasterReg_);
+    ar.io(bgColor_);
+    ar.io(borderColor_);
+    ar.io(screenMemBase_);
+    ar.io(charMemBase_);
+    framebuffer_.serialize(ar);
+
+    // The change-tracking stamps decide whether lines are redrawn or
+    // reused from the front buffer, so they travel with it
+    ar.io(stamp_);
+    ar.io(regStamp_);
+    ar.io(blockStamp_);
+    ar.io(lineStamp_);
+}
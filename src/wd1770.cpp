@@ -1,7 +1,64 @@
 #include "wd1770.h"
+#include "state_archive.h"
 #include "../include/speed.h"
+#include <algorithm>
+
+// Single-density (FM) Acorn DFS geometry. Positions around a track are
+// in byte times from the index pulse: 3125 of them at 125 kbit/s and
+// 300 rpm, each sector a slot holding its ID field, gap, data field and
+// the gap before the next.
+constexpr uint32_t SECTORS_PER_TRACK = 10;
+constexpr uint32_t SECTOR_BYTES      = 256;
+constexpr uint32_t MAX_TRACKS        = 84;
+constexpr uint32_t TRACK_BYTES       = 3125;
+constexpr uint32_t FIRST_ID          = 16;   // gap 1
+constexpr uint32_t SLOT_BYTES        = 312;
+constexpr uint32_t ID_BYTES          = 7;    // mark, track, side, sector, size, CRC
+constexpr uint32_t DATA_START        = 25;   // ID, gap 2, sync, data mark
+constexpr uint32_t SYNC_BYTES        = 6;
+constexpr uint32_t INDEX_BYTES       = 62;   // index pulse, about 4 ms
+constexpr uint32_t NO_SECTOR         = 0xFFFFFFFF;
+
+constexpr uint8_t ID_MARK   = 0xFE;
+constexpr uint8_t DATA_MARK = 0xFB;
+
+// WD1770 timing constants (seconds, revolutions)
+constexpr double STEP_RATE_S[4]    = {0.006, 0.012, 0.020, 0.030}; // by r1r0
+constexpr double HEAD_SETTLE_S     = 0.015;  // 15 ms head settle (E flag)
+constexpr double REVOLUTION_S      = 0.200;  // 200 ms per full revolution
+constexpr uint32_t SPIN_UP_REVS    = 6;
+constexpr uint32_t RNF_REVS        = 5;      // index pulses before giving up a search
+constexpr uint32_t MOTOR_OFF_REVS  = 9;
+constexpr uint64_t JOURNAL_RETRY_CYCLES = 1024; // while idle with a journal backlog (a power of two)
+#define SEC_TO_CYCLES(sec) static_cast<uint32_t>((sec) * CPU_FREQ_BBC_MICRO)
+
+// CRC-CCITT (x^16 + x^12 + x^5 + 1, MSB first, preset to FFFF) over a
+// field's address mark and bytes, a table lookup per byte
+struct CrcTable {
+    uint16_t v[256];
+    constexpr CrcTable() : v() {
+        for (int i = 0; i < 256; ++i) {
+            uint16_t c = static_cast<uint16_t>(i << 8);
+            for (int b = 0; b < 8; ++b)
+                c = static_cast<uint16_t>((c & 0x8000) ? (c << 1) ^ 0x1021 : c << 1);
+            v[i] = c;
+        }
+    }
+};
+static constexpr CrcTable CRC_TABLE;
+
+static uint16_t crcUpdate(uint16_t crc, uint8_t byte) {
+    return static_cast<uint16_t>((crc << 8) ^ CRC_TABLE.v[(crc >> 8) ^ byte]);
+}
+
+uint16_t crcCcitt(const uint8_t* bytes, size_t size, uint16_t crc) {
+    for (size_t i = 0; i < size; ++i)
+        crc = crcUpdate(crc, bytes[i]);
+    return crc;
+}
 
 WD1770::WD1770() {
+    setTurbo(1);
     reset();
 }
 
@@ -10,26 +67,55 @@ void WD1770::reset() {
     track = 0;
     sector = 0;
     data = 0;
+    control = 0;
     irq = false;
     drq = false;
     busy = false;
     command = 0;
     dataPtr = 0;
-    diskInserted = false;
-    diskImage.clear();
+    commandCyclesRemaining = 0;
+    phase = PHASE_IDLE;
+    headTrack = 0;
+    stepIn = true;
+    fieldSector = 0;
+    motorOn = false;
+    motorOffAt = 0;
+    clock = 0;
+    std::fill(writeBuffer, writeBuffer + SECTOR_BYTES, 0);
+}
+
+void WD1770::setTurbo(uint32_t factor) {
+    turbo = factor ? factor : 1;
+    uint32_t accurate = SEC_TO_CYCLES(REVOLUTION_S / TRACK_BYTES);
+    byteCycles = accurate / turbo ? accurate / turbo : 1;
+    transferCycles = byteCycles > MIN_BYTE_CYCLES ? byteCycles : MIN_BYTE_CYCLES;
 }
 
 uint8_t WD1770::read(uint16_t reg) {
     switch (reg & 0x03) {
-        case REG_CMD_STATUS:
-            return status;
+        case REG_CMD_STATUS: {
+            irq = false;
+            uint8_t s = status;
+            if (motorOn)
+                s |= STATUS_MOTOR;
+            if (typeOne()) {
+                if (headTrack == 0)
+                    s |= STATUS_TRACK0;
+                if (motorOn && diskInserted && (clock / byteCycles) % TRACK_BYTES < INDEX_BYTES)
+                    s |= STATUS_INDEX;
+                if (diskInserted && !overlay.writable())
+                    s |= STATUS_WP;
+            } else if (drq) {
+                s |= STATUS_DRQ;
+            }
+            return s;
+        }
         case REG_TRACK:
             return track;
         case REG_SECTOR:
             return sector;
         case REG_DATA:
             drq = false;
-            status &= ~STATUS_DRQ;
             return data;
     }
     return 0xFF;
@@ -41,103 +127,426 @@ void WD1770::write(uint16_t reg, uint8_t value) {
             executeCommand(value);
             break;
         case REG_TRACK:
-            track = value;
+            if (!busy)
+                track = value;
             break;
         case REG_SECTOR:
-            sector = value;
+            if (!busy)
+                sector = value;
             break;
         case REG_DATA:
             data = value;
             drq = false;
-            status &= ~STATUS_DRQ;
             break;
     }
 }
 
-void WD1770::insertDisk(const std::vector<uint8_t>& image) {
-    diskImage = image;
-    diskInserted = true;
+void WD1770::insertDisk(RomImage image, bool doubleSided) {
+    diskImage = std::move(image);
+    diskInserted = diskImage != nullptr;
+    overlay.clear();
+    sectorIndex.clear();
+    sides = tracks = 0;
+    if (!diskInserted)
+        return;
+
+    // As many tracks as the catalogue formats, or the image holds;
+    // sectors past the end of a truncated image read as zeros
+    sides = doubleSided ? 2 : 1;
+    const size_t trackBytes = SECTORS_PER_TRACK * SECTOR_BYTES;
+    size_t held = (diskImage->size() + trackBytes * sides - 1) / (trackBytes * sides);
+    size_t formatted = 0;
+    if (diskImage->size() >= 2 * SECTOR_BYTES) {
+        const uint8_t *b = diskImage->data();
+        formatted = (((b[0x106] & 0x03) << 8) | b[0x107]) / SECTORS_PER_TRACK;
+    }
+    size_t n = formatted > held ? formatted : held;
+    tracks = static_cast<uint8_t>(n < MAX_TRACKS ? n : MAX_TRACKS);
+
+    // DSD interleaves the sides track by track
+    sectorIndex.resize(static_cast<size_t>(sides) * tracks * SECTORS_PER_TRACK);
+    for (uint32_t s = 0; s < sides; ++s)
+        for (uint32_t t = 0; t < tracks; ++t)
+            for (uint32_t k = 0; k < SECTORS_PER_TRACK; ++k)
+                sectorIndex[(s * tracks + t) * SECTORS_PER_TRACK + k] =
+                    ((t * sides + s) * SECTORS_PER_TRACK + k) * SECTOR_BYTES;
 }
 
 void WD1770::ejectDisk() {
-    diskImage.clear();
-    diskInserted = false;
+    insertDisk(nullptr);
 }
 
-// WD1770 timing constants (seconds)
-constexpr double STEP_TIME_S       = 0.006;  // 6 ms per track step
-constexpr double HEAD_SETTLE_S     = 0.015;  // 15 ms head settle
-constexpr double REVOLUTION_S      = 0.200;  // 200 ms per full revolution
-constexpr double QUICK_FAIL_S      = 0.001;  // 1 ms for immediate fail
-#define SEC_TO_CYCLES(sec) static_cast<uint32_t>((sec) * CPU_FREQ)
+// Geometry
+// ------------------------------------------------------------
+
+int WD1770::side() const {
+    return (control >> 2) & 1;
+}
+
+uint32_t WD1770::sectorOffset(uint8_t sec) const {
+    if (!diskInserted || (control & 0x02) || side() >= sides || headTrack >= tracks || sec >= SECTORS_PER_TRACK)
+        return NO_SECTOR;
+    return sectorIndex[(side() * tracks + headTrack) * SECTORS_PER_TRACK + sec];
+}
+
+uint8_t WD1770::sectorByte(uint8_t sec, size_t i) const {
+    uint32_t offset = sectorOffset(sec);
+    if (const uint8_t *written = overlay.find(offset / SECTOR_BYTES))
+        return written[i];
+    size_t at = static_cast<size_t>(offset) + i;
+    return at < diskImage->size() ? diskImage->data()[at] : 0x00;
+}
+
+// The ID field of a sector on the head's track: mark, track, side,
+// sector, size code (1: 256 bytes), CRC
+uint8_t WD1770::idByte(uint8_t sec, size_t i) const {
+    const uint8_t id[5] = {ID_MARK, headTrack, static_cast<uint8_t>(side()), sec, 1};
+    if (i < 5)
+        return id[i];
+    uint16_t crc = 0xFFFF;
+    for (uint8_t b : id)
+        crc = crcUpdate(crc, b);
+    return i == 5 ? static_cast<uint8_t>(crc >> 8) : static_cast<uint8_t>(crc);
+}
+
+// The head's track as the drive sees it, for Read Track
+uint8_t WD1770::trackByte(size_t pos) const {
+    if (pos < FIRST_ID)
+        return pos < FIRST_ID - SYNC_BYTES ? 0xFF : 0x00;
+    uint8_t k = static_cast<uint8_t>((pos - FIRST_ID) / SLOT_BYTES);
+    size_t at = (pos - FIRST_ID) % SLOT_BYTES;
+    if (k >= SECTORS_PER_TRACK || sectorOffset(k) == NO_SECTOR)
+        return 0xFF;
+    if (at < ID_BYTES)
+        return idByte(k, at);
+    if (at < DATA_START - 1 - SYNC_BYTES)
+        return 0xFF;
+    if (at < DATA_START - 1)
+        return 0x00;
+    if (at == DATA_START - 1)
+        return DATA_MARK;
+    if (at < DATA_START + SECTOR_BYTES)
+        return sectorByte(k, at - DATA_START);
+    if (at < DATA_START + SECTOR_BYTES + 2) {
+        uint16_t crc = crcUpdate(0xFFFF, DATA_MARK);
+        for (size_t i = 0; i < SECTOR_BYTES; ++i)
+            crc = crcUpdate(crc, sectorByte(k, i));
+        return at == DATA_START + SECTOR_BYTES ? static_cast<uint8_t>(crc >> 8) : static_cast<uint8_t>(crc);
+    }
+    return at >= SLOT_BYTES - SYNC_BYTES && k + 1u < SECTORS_PER_TRACK ? 0x00 : 0xFF;
+}
+
+uint8_t WD1770::fieldByte(size_t i) const {
+    switch (command & 0xF0) {
+        case 0xC0: return idByte(fieldSector, i + 1); // Read Address: the ID after its mark
+        case 0xE0: return trackByte(i);               // Read Track
+        default:   return sectorByte(fieldSector, i);
+    }
+}
+
+size_t WD1770::fieldLength() const {
+    switch (command & 0xF0) {
+        case 0xC0: return ID_BYTES - 1;
+        case 0xE0: return TRACK_BYTES;
+        default:   return SECTOR_BYTES;
+    }
+}
+
+// Timing
+// ------------------------------------------------------------
+
+uint8_t WD1770::nextId() const {
+    uint32_t pos = static_cast<uint32_t>((clock / byteCycles) % TRACK_BYTES);
+    uint32_t k = pos < FIRST_ID ? 0 : (pos - FIRST_ID) / SLOT_BYTES + 1;
+    return static_cast<uint8_t>(k < SECTORS_PER_TRACK ? k : 0);
+}
+
+uint32_t WD1770::revolution() const {
+    return TRACK_BYTES * byteCycles;
+}
+
+uint32_t WD1770::cyclesUntil(uint32_t pos) const {
+    uint64_t rev = revolution();
+    uint64_t d = (static_cast<uint64_t>(pos) * byteCycles + rev - clock % rev) % rev;
+    return d ? static_cast<uint32_t>(d) : 1;
+}
+
+uint32_t WD1770::mechanical(double seconds) const {
+    uint32_t cycles = SEC_TO_CYCLES(seconds) / turbo;
+    return cycles ? cycles : 1;
+}
+
+bool WD1770::typeOne() const {
+    return (command & 0x80) == 0 || (command & 0xF0) == 0xD0;
+}
+
+// Commands
+// ------------------------------------------------------------
 
 void WD1770::executeCommand(uint8_t cmd) {
+    if ((cmd & 0xF0) == 0xD0) {
+        // Force Interrupt: stops any command; I3 interrupts at once
+        busy = false;
+        drq = false;
+        phase = PHASE_IDLE;
+        commandCyclesRemaining = 0;
+        status &= ~STATUS_BUSY;
+        command = cmd;
+        if (cmd & 0x08)
+            irq = true;
+        motorOffAt = clock + static_cast<uint64_t>(MOTOR_OFF_REVS) * revolution();
+        return;
+    }
+    if (busy)
+        return; // the 1770 ignores anything else while busy
+
     command = cmd;
     busy = true;
-    status |= STATUS_BUSY;
+    status = STATUS_BUSY;
     irq = false;
     drq = false;
-    status &= ~(STATUS_DRQ | STATUS_INTRQ);
-
-    bool error = false;
-
-    if ((cmd & 0xF0) == 0x00) { 
-        // Restore: assume max seek to track 0 + settle
-        // For now, assume 40 tracks worst case
-        commandCyclesRemaining = SEC_TO_CYCLES((STEP_TIME_S * 40) + HEAD_SETTLE_S);
-    }
-    else if ((cmd & 0xF0) == 0x10) { 
-        // Seek: assume 1 track step + settle
-        commandCyclesRemaining = SEC_TO_CYCLES(STEP_TIME_S + HEAD_SETTLE_S);
-    }
-    else if ((cmd & 0xF0) == 0x80) { 
-        // Read sector
-        if (!diskInserted) {
-            status |= STATUS_RNF;
-            error = true;
-            commandCyclesRemaining = SEC_TO_CYCLES(QUICK_FAIL_S);
-        } else {
-            data = 0x00; // stubbed data
-            drq = true;
-            status |= STATUS_DRQ;
-            // Worst case: wait for sector to come under head
-            commandCyclesRemaining = SEC_TO_CYCLES(REVOLUTION_S);
+    dataPtr = 0;
+
+    // Spin up first unless the motor is on or h (bit 3) says skip it
+    if (!motorOn) {
+        motorOn = true;
+        if (!(cmd & 0x08)) {
+            phase = PHASE_SPIN_UP;
+            commandCyclesRemaining = SPIN_UP_REVS * revolution();
+            return;
         }
     }
-    else if ((cmd & 0xF0) == 0xA0) { 
-        // Write sector
-        if (!diskInserted) {
-            status |= STATUS_WP;
-            error = true;
-            commandCyclesRemaining = SEC_TO_CYCLES(QUICK_FAIL_S);
-        } else {
-            commandCyclesRemaining = SEC_TO_CYCLES(REVOLUTION_S);
+    startCommand();
+}
+
+void WD1770::startCommand() {
+    if (typeOne()) {
+        status |= STATUS_SPUN_UP;
+        // Restore, Seek, Step, Step In, Step Out; u (bit 4) updates the
+        // track register on steps
+        uint32_t steps = 0;
+        switch (command & 0xE0) {
+            case 0x00:
+                if (command & 0x10) { // Seek to the data register's track
+                    stepIn = data > track;
+                    steps = stepIn ? data - track : track - data;
+                    track = data;
+                } else { // Restore
+                    stepIn = false;
+                    steps = headTrack;
+                    track = 0;
+                }
+                break;
+            case 0x40: stepIn = true; steps = 1; break;
+            case 0x60: stepIn = false; steps = 1; break;
+            default:   steps = 1; break;
         }
+        if ((command & 0xE0) != 0x00 && (command & 0x10))
+            track = static_cast<uint8_t>(stepIn ? track + 1 : track - 1);
+        for (uint32_t i = 0; i < steps; ++i)
+            if (stepIn ? headTrack + 1u < MAX_TRACKS : headTrack > 0)
+                headTrack = static_cast<uint8_t>(stepIn ? headTrack + 1 : headTrack - 1);
+        phase = PHASE_STEP;
+        commandCyclesRemaining = steps ? steps * mechanical(STEP_RATE_S[command & 0x03]) : 1;
+        return;
+    }
+
+    // Type II/III settle first with E (bit 2)
+    if (command & 0x04) {
+        phase = PHASE_SETTLE;
+        commandCyclesRemaining = mechanical(HEAD_SETTLE_S);
+        return;
     }
-    else {
-        // Unknown/unsupported command
-        error = true;
-        commandCyclesRemaining = SEC_TO_CYCLES(QUICK_FAIL_S);
+    search();
+}
+
+// Wait for the field the command wants: a sector's data or ID, the next
+// ID, or the index. Write Track (formatting) always finds the disk write
+// protected.
+void WD1770::search() {
+    phase = PHASE_SEARCH;
+    bool formatting = (command & 0xF0) == 0xF0;
+    if (diskInserted && (formatting || (writeSector() && !overlay.writable()))) {
+        status |= STATUS_WP;
+        commandCyclesRemaining = 1;
+        phase = PHASE_CRC; // finishes at once
+        return;
     }
+    switch (command & 0xF0) {
+        case 0x80: case 0x90: // Read Sector
+            if (track == headTrack && sectorOffset(sector) != NO_SECTOR) {
+                fieldSector = sector;
+                commandCyclesRemaining = cyclesUntil(FIRST_ID + sector * SLOT_BYTES + DATA_START);
+                return;
+            }
+            break;
+        case 0xA0: case 0xB0: // Write Sector: DRQ asks for the first byte two bytes after the ID
+            if (track == headTrack && sectorOffset(sector) != NO_SECTOR) {
+                fieldSector = sector;
+                commandCyclesRemaining = cyclesUntil(FIRST_ID + sector * SLOT_BYTES + ID_BYTES + 2);
+                return;
+            }
+            break;
+        case 0xC0: // Read Address: whichever ID comes next
+            if (sectorOffset(0) != NO_SECTOR) {
+                fieldSector = nextId();
+                commandCyclesRemaining = cyclesUntil(FIRST_ID + fieldSector * SLOT_BYTES + 1);
+                return;
+            }
+            break;
+        case 0xE0: // Read Track, from the index
+            if (diskInserted && !(control & 0x02)) {
+                commandCyclesRemaining = cyclesUntil(0);
+                return;
+            }
+            break;
+        default:
+            break;
+    }
+    // Nothing to find: give up after RNF_REVS index pulses
+    status |= STATUS_RNF;
+    phase = PHASE_CRC;
+    commandCyclesRemaining = RNF_REVS * revolution();
+}
 
-    if (error) {
-        // finishCommand() will set CRCERR or RNF
+void WD1770::deliverByte() {
+    if (drq)
+        status |= STATUS_LOST; // the CPU didn't take the last one
+    data = fieldByte(dataPtr++);
+    drq = true;
+    if (dataPtr < fieldLength()) {
+        commandCyclesRemaining = transferCycles;
+    } else {
+        phase = PHASE_CRC;
+        commandCyclesRemaining = (command & 0xE0) == 0xE0 ? transferCycles : 2 * transferCycles;
+    }
+}
+
+// Writing: the byte the CPU left in REG_DATA goes down, or zero (and
+// lost data) if it didn't write one in time
+void WD1770::acceptByte() {
+    if (drq) {
+        status |= STATUS_LOST;
+        if (dataPtr == 0) { // no first byte: the 1770 gives up before the data mark
+            drq = false;
+            finishCommand();
+            return;
+        }
+    }
+    writeBuffer[dataPtr++] = drq ? 0x00 : data;
+    if (dataPtr < SECTOR_BYTES) {
+        drq = true;
+        commandCyclesRemaining = transferCycles;
+    } else {
+        drq = false;
+        overlay.write(sectorOffset(fieldSector) / SECTOR_BYTES, writeBuffer);
+        phase = PHASE_CRC;
+        commandCyclesRemaining = 2 * transferCycles;
+    }
+}
+
+void WD1770::advance() {
+    switch (phase) {
+        case PHASE_SPIN_UP:
+            startCommand();
+            break;
+        case PHASE_STEP:
+            if (!(command & 0x04)) {
+                finishCommand();
+            } else if (sectorOffset(0) != NO_SECTOR && track == headTrack) {
+                // V (bit 2): read the next ID to check the track
+                phase = PHASE_VERIFY;
+                commandCyclesRemaining = cyclesUntil(FIRST_ID + nextId() * SLOT_BYTES + ID_BYTES);
+            } else {
+                status |= STATUS_RNF;
+                phase = PHASE_CRC;
+                commandCyclesRemaining = RNF_REVS * revolution();
+            }
+            break;
+        case PHASE_VERIFY:
+            finishCommand();
+            break;
+        case PHASE_SETTLE:
+            search();
+            break;
+        case PHASE_SEARCH:
+            phase = PHASE_FIELD;
+            if (writeSector()) {
+                drq = true; // the data mark and first byte follow the gap
+                commandCyclesRemaining = (DATA_START - ID_BYTES - 2) * byteCycles;
+            } else {
+                deliverByte();
+            }
+            break;
+        case PHASE_FIELD:
+            if (writeSector())
+                acceptByte();
+            else
+                deliverByte();
+            break;
+        case PHASE_CRC:
+            if ((command & 0xC0) == 0x80 && (command & 0x10) && !(status & (STATUS_RNF | STATUS_WP))) {
+                // Multiple sectors: on to the next until it isn't found
+                sector++;
+                dataPtr = 0;
+                search();
+                break;
+            }
+            if ((command & 0xF0) == 0xC0 && !(status & STATUS_RNF))
+                sector = idByte(fieldSector, 1); // Read Address leaves the track there
+            finishCommand();
+            break;
+        default:
+            break;
     }
 }
 
 void WD1770::tick() {
-    if (busy && commandCyclesRemaining > 0) {
+    ++clock;
+    if (!busy) {
+        if (motorOn && clock >= motorOffAt)
+            motorOn = false;
+        // Journal writes the ring had no room for reach the writer thread
+        // without waiting for the guest's next write
+        if (overlay.journalBacklogged() && (clock & (JOURNAL_RETRY_CYCLES - 1)) == 0)
+            overlay.flushJournal();
+        return;
+    }
+    if (commandCyclesRemaining > 1) {
         --commandCyclesRemaining;
-        if (commandCyclesRemaining == 0) {
-            finishCommand((status & (STATUS_RNF | STATUS_WP)) != 0);
-        }
+        return;
     }
+    commandCyclesRemaining = 0;
+    advance();
 }
 
-void WD1770::finishCommand(bool error) {
+void WD1770::finishCommand(uint8_t errors) {
     busy = false;
-    status &= ~STATUS_BUSY;
-    if (error) status |= STATUS_CRCERR; // Example error bit
+    phase = PHASE_IDLE;
+    status = static_cast<uint8_t>((status & ~STATUS_BUSY) | errors);
     irq = true;
-    status |= STATUS_INTRQ;
-}
\ No newline at end of file
+    motorOffAt = clock + static_cast<uint64_t>(MOTOR_OFF_REVS) * revolution();
+}
+
+void WD1770::serialize(StateArchive& ar) {
+    ar.io(status);
+    ar.io(track);
+    ar.io(sector);
+    ar.io(data);
+    ar.io(control);
+    ar.io(irq);
+    ar.io(drq);
+    ar.io(busy);
+    ar.io(command);
+    ar.io(dataPtr);
+    ar.io(commandCyclesRemaining);
+    ar.io(phase);
+    ar.io(headTrack);
+    ar.io(stepIn);
+    ar.io(fieldSector);
+    ar.io(motorOn);
+    ar.io(motorOffAt);
+    ar.io(clock);
+    ar.io(writeBuffer);
+    overlay.serialize(ar);
+}
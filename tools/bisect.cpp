@@ -0,0 +1,119 @@
+// Divergence bisector: runs an image under two CPU configurations in
+// lockstep and reports the first instruction where their states differ.
+//
+//   bisect <image> [--load <hex addr>] [--a <mode>] [--b <mode>]
+//          [--interval <n>] [--max <n>] [--6507] [--machine <profile>]
+//
+// Modes: per-cycle (reference), catch-up
+// Profiles: generic (default), 2600, vic20, bbc, pet, plus4
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <type_traits>
+#include <variant>
+#include <vector>
+#include "../include/bisector.h"
+
+static bool parseMode(const std::string &name, ClockMode &mode)
+{
+    if (name == "per-cycle")
+        mode = ClockMode::PerCycle;
+    else if (name == "catch-up")
+        mode = ClockMode::CatchUp;
+    else
+        return false;
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        std::cerr << "usage: bisect <image> [--load <hex addr>] [--a <mode>] [--b <mode>]\n"
+                     "              [--interval <n>] [--max <n>] [--6507] [--machine <profile>]\n";
+        return 2;
+    }
+
+    std::string image = argv[1];
+    uint16_t loadAddr = 0x8000;
+    std::string modeNames[2] = {"per-cycle", "catch-up"};
+    uint64_t interval = 10000;
+    uint64_t maxInstructions = 100000000;
+    bool is6507 = false;
+    std::string machineName = "generic";
+    for (int i = 2; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--load" && hasValue)
+            loadAddr = static_cast<uint16_t>(std::strtoul(argv[++i], nullptr, 16));
+        else if (arg == "--a" && hasValue)
+            modeNames[0] = argv[++i];
+        else if (arg == "--b" && hasValue)
+            modeNames[1] = argv[++i];
+        else if (arg == "--interval" && hasValue)
+            interval = std::strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--max" && hasValue)
+            maxInstructions = std::strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--6507")
+            is6507 = true;
+        else if (arg == "--machine" && hasValue)
+            machineName = argv[++i];
+    }
+
+    MachineType type;
+    if (!parseMachineType(machineName, type))
+    {
+        std::cerr << "Unknown machine: " << machineName << "\n";
+        return 2;
+    }
+
+    ClockMode modes[2];
+    for (int i = 0; i < 2; ++i)
+    {
+        if (!parseMode(modeNames[i], modes[i]))
+        {
+            std::cerr << "Unknown mode: " << modeNames[i] << "\n";
+            return 2;
+        }
+    }
+
+    std::ifstream in(image, std::ios::binary);
+    if (!in)
+    {
+        std::cerr << "Cannot open " << image << "\n";
+        return 2;
+    }
+    std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+    // One power-on state, copied, so both sides start identical (the
+    // CPU randomises its registers on reset)
+    AnyMachine machine = makeMachine(type);
+    auto bisect = [&](auto &reference)
+    {
+        using MachineT = std::decay_t<decltype(reference)>;
+        reference.mem.EnableStateHash(true);
+        reference.mem.Load(loadAddr, bytes.data(), bytes.size());
+        if (loadAddr + bytes.size() < 0xFFFE)
+        {
+            // The image doesn't supply vectors: start at its first byte
+            uint8_t vector[2] = {static_cast<uint8_t>(loadAddr), static_cast<uint8_t>(loadAddr >> 8)};
+            reference.mem.Load(0xFFFC, vector, sizeof(vector));
+        }
+        reference.Reset(is6507 || MachineT::BusType::Is6507);
+
+        MachineT a = reference, b = reference;
+        a.cpu.clockMode = modes[0];
+        b.cpu.clockMode = modes[1];
+
+        Bisector<MachineT::type> bisector(a, b, interval);
+        bisector.setLabels(modeNames[0], modeNames[1]);
+        bool diverged = bisector.run(maxInstructions);
+        bisector.print(std::cout);
+        return diverged ? 1 : 0;
+    };
+    return std::visit(bisect, machine);
+}
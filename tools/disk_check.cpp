@@ -0,0 +1,208 @@
+// Self-check of the disk code's fixed kernels: the 1770's CRC, the ID
+// and data fields it builds, and the DSD geometry that the controller
+// (sector index) and the fast-load catalogue (DfsCatalogue) each encode
+// on their own. Takes no arguments; exits 1 if any check fails.
+//
+//   disk_check
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "../include/dfs.h"
+#include "../include/wd1770.h"
+
+static constexpr uint32_t SECTOR = 256;
+static constexpr uint32_t SECTORS_PER_TRACK = 10;
+static constexpr uint32_t TRACKS = 40;
+
+static int failures = 0;
+
+static void check(bool ok, const std::string &what)
+{
+    std::cout << (ok ? "ok      " : "FAILED  ") << what << "\n";
+    if (!ok)
+        failures++;
+}
+
+// Bit at a time, independent of the controller's table
+static uint16_t referenceCrc(const uint8_t *bytes, std::size_t size, uint16_t crc = 0xFFFF)
+{
+    for (std::size_t i = 0; i < size; ++i)
+    {
+        crc ^= static_cast<uint16_t>(bytes[i] << 8);
+        for (int b = 0; b < 8; ++b)
+            crc = static_cast<uint16_t>((crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1);
+    }
+    return crc;
+}
+
+// Where a DSD keeps (side, track, sector): tracks interleaved by side
+static uint32_t dsdIndex(uint32_t side, uint32_t track, uint32_t sector)
+{
+    return (track * 2 + side) * SECTORS_PER_TRACK + sector;
+}
+
+// A DSD whose sectors each start with their own index, and a catalogue
+// on each side
+static std::vector<uint8_t> makeDsd()
+{
+    std::vector<uint8_t> image(2 * TRACKS * SECTORS_PER_TRACK * SECTOR);
+    for (uint32_t s = 0; s < image.size() / SECTOR; ++s)
+    {
+        uint8_t *p = &image[s * SECTOR];
+        for (uint32_t i = 0; i < SECTOR; ++i)
+            p[i] = static_cast<uint8_t>(s * 7 + i);
+        std::memcpy(p, &s, sizeof(s));
+    }
+
+    struct File
+    {
+        const char *name;
+        uint16_t start;
+        uint32_t length;
+    };
+    const File files[2][2] = {{{"FIRST", 2, 30 * SECTOR}, {"LAST", 395, 5 * SECTOR}},
+                              {{"SECOND", 57, 40 * SECTOR + 17}, {"SHORT", 9, 3 * SECTOR}}};
+    for (uint32_t side = 0; side < 2; ++side)
+    {
+        uint8_t *names = &image[dsdIndex(side, 0, 0) * SECTOR];
+        uint8_t *info = &image[dsdIndex(side, 0, 1) * SECTOR];
+        std::memset(names, ' ', SECTOR);
+        std::memset(info, 0, SECTOR);
+        std::memcpy(names, side ? "SIDE ONE" : "SIDEZERO", 8);
+        info[5] = 2 * 8;
+        info[6] = (TRACKS * SECTORS_PER_TRACK) >> 8;
+        info[7] = (TRACKS * SECTORS_PER_TRACK) & 0xFF;
+        for (int f = 0; f < 2; ++f)
+        {
+            const File &file = files[side][f];
+            uint8_t *n = names + 8 * (f + 1), *a = info + 8 * (f + 1);
+            std::memcpy(n, file.name, std::strlen(file.name));
+            n[7] = '$';
+            a[4] = static_cast<uint8_t>(file.length);
+            a[5] = static_cast<uint8_t>(file.length >> 8);
+            a[6] = static_cast<uint8_t>(((file.length >> 16) & 3) << 4 | (file.start >> 8));
+            a[7] = static_cast<uint8_t>(file.start);
+        }
+    }
+    return image;
+}
+
+// Runs a command to its end, taking each byte the controller offers
+static bool runCommand(WD1770 &fdc, uint8_t command, std::vector<uint8_t> *bytes = nullptr)
+{
+    fdc.write(0, command);
+    for (uint64_t i = 0; i < 100000000; ++i)
+    {
+        fdc.tick();
+        if (fdc.drqLine())
+        {
+            uint8_t b = fdc.read(3);
+            if (bytes)
+                bytes->push_back(b);
+        }
+        if (!(fdc.read(0) & 0x01))
+            return true;
+    }
+    return false;
+}
+
+static bool seek(WD1770 &fdc, uint32_t side, uint32_t track)
+{
+    fdc.writeControl(static_cast<uint8_t>(side << 2));
+    fdc.write(3, static_cast<uint8_t>(track));
+    return runCommand(fdc, 0x10);
+}
+
+static bool readSector(WD1770 &fdc, uint32_t side, uint32_t logical, std::vector<uint8_t> &bytes)
+{
+    bytes.clear();
+    if (!seek(fdc, side, logical / SECTORS_PER_TRACK))
+        return false;
+    fdc.write(2, static_cast<uint8_t>(logical % SECTORS_PER_TRACK));
+    return runCommand(fdc, 0x80, &bytes) && bytes.size() == SECTOR;
+}
+
+int main()
+{
+    const uint8_t digits[] = {'1', '2', '3', '4', '5', '6', '7', '8', '9'};
+    check(referenceCrc(digits, sizeof(digits)) == 0x29B1, "reference CRC-CCITT of \"123456789\" is 29B1");
+    check(crcCcitt(digits, sizeof(digits)) == 0x29B1, "crcCcitt of \"123456789\" is 29B1");
+    const uint8_t id[] = {0xFE, 39, 1, 9, 1};
+    check(crcCcitt(id, 2) == referenceCrc(id, 2) && crcCcitt(id + 2, 3, crcCcitt(id, 2)) == referenceCrc(id, 5),
+          "crcCcitt carries on from an earlier run");
+
+    std::vector<uint8_t> bytes = makeDsd();
+    RomImage image = Image::fromBytes(bytes);
+    WD1770 fdc;
+    fdc.setTurbo(64);
+    fdc.insertDisk(image, true);
+
+    // ID field, as Read Address hands it over: track, side, sector,
+    // size, CRC over those and the mark
+    std::vector<uint8_t> field;
+    bool read = seek(fdc, 1, 7) && runCommand(fdc, 0xC0, &field) && field.size() == 6;
+    check(read && field[0] == 7 && field[1] == 1 && field[2] < SECTORS_PER_TRACK && field[3] == 1,
+          "Read Address on side 1 track 7 gives its ID");
+    if (read)
+    {
+        const uint8_t mark[] = {0xFE, field[0], field[1], field[2], field[3]};
+        uint16_t crc = referenceCrc(mark, sizeof(mark));
+        check(field[4] == (crc >> 8) && field[5] == (crc & 0xFF), "ID field CRC");
+    }
+
+    // The same ID and the data that follows, in the raw track
+    std::vector<uint8_t> track;
+    read = seek(fdc, 0, 3) && runCommand(fdc, 0xE0, &track);
+    std::size_t at = 0;
+    while (read && at < track.size() && track[at] != 0xFE)
+        at++;
+    bool idOk = at + 7 <= track.size() && track[at + 1] == 3 && track[at + 2] == 0 && track[at + 3] == 0 &&
+                referenceCrc(&track[at], 5) == (track[at + 5] << 8 | track[at + 6]);
+    check(idOk, "Read Track: first ID field and its CRC");
+    while (idOk && at < track.size() && track[at] != 0xFB)
+        at++;
+    bool dataOk = at + 1 + SECTOR + 2 <= track.size() &&
+                  std::memcmp(&track[at + 1], &bytes[dsdIndex(0, 3, 0) * SECTOR], SECTOR) == 0 &&
+                  referenceCrc(&track[at], 1 + SECTOR) == (track[at + 1 + SECTOR] << 8 | track[at + 2 + SECTOR]);
+    check(idOk && dataOk, "Read Track: first data field and its CRC");
+
+    // Geometry: every sector the controller reads is where the DSD
+    // layout puts it, and so is every sector the catalogue loads
+    bool controllerOk = true;
+    std::vector<uint8_t> sector;
+    for (uint32_t side = 0; side < 2 && controllerOk; ++side)
+        for (uint32_t logical : {0u, 1u, 9u, 10u, 11u, 57u, 123u, 399u})
+            controllerOk = controllerOk && readSector(fdc, side, logical, sector) &&
+                           std::memcmp(sector.data(), &bytes[dsdIndex(side, logical / 10, logical % 10) * SECTOR],
+                                       SECTOR) == 0;
+    check(controllerOk, "1770 reads DSD sectors from (track * 2 + side) * 10 + sector");
+
+    DfsCatalogue disk;
+    check(disk.read(image, true), "catalogues of both sides read");
+    const char *names[] = {"$.FIRST", "$.LAST", ":2.$.SECOND", ":2.$.SHORT"};
+    for (const char *name : names)
+    {
+        OsFile file;
+        uint32_t side = name[0] == ':';
+        bool same = disk.open(name, file);
+        const DfsEntry *entry = nullptr;
+        for (const DfsEntry &e : disk.entries(side))
+            if (name == std::string(side ? ":2.$." : "$.") + e.name)
+                entry = &e;
+        same = same && entry && file.data.size() == entry->length;
+        for (uint32_t done = 0; same && done < file.data.size(); done += SECTOR)
+        {
+            uint32_t logical = entry->startSector + done / SECTOR;
+            uint32_t n = std::min<uint32_t>(SECTOR, static_cast<uint32_t>(file.data.size()) - done);
+            same = readSector(fdc, side, logical, sector) &&
+                   std::memcmp(&file.data[done], sector.data(), n) == 0 &&
+                   std::memcmp(&file.data[done], &bytes[dsdIndex(side, logical / 10, logical % 10) * SECTOR], n) == 0;
+        }
+        check(same, std::string("catalogue and 1770 agree on ") + name);
+    }
+
+    std::cout << (failures ? "disk_check: failures\n" : "disk_check: all passed\n");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,126 @@
+// Checkpoint-parallel replay verification.
+//
+//   replay <recording> [--capture <n>] [--save <file>] [--threads <n>] [--catch-up]
+//   replay --image <file> [--machine <profile>] [--load <hex addr>] --length <n> --save <file>
+//          [--capture <n>]
+//
+// Every segment between consecutive checkpoints of the recording is
+// replayed on its own core and must end in the state recorded at the next
+// checkpoint. --capture first replays the whole recording once on one
+// core, dropping a checkpoint every n instructions (for recordings saved
+// without them). --image makes an input-free recording of a program. A
+// recording replays on the profile its states were saved by.
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <variant>
+#include <vector>
+#include "../include/replay.h"
+
+int main(int argc, char *argv[])
+{
+    std::string recordingPath, savePath, imagePath;
+    uint16_t loadAddr = 0x8000;
+    uint64_t capture = 0, length = 0;
+    unsigned threads = 0;
+    bool catchUp = false;
+    std::string machineName = "generic";
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--capture" && hasValue)
+            capture = std::strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--save" && hasValue)
+            savePath = argv[++i];
+        else if (arg == "--threads" && hasValue)
+            threads = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--image" && hasValue)
+            imagePath = argv[++i];
+        else if (arg == "--load" && hasValue)
+            loadAddr = static_cast<uint16_t>(std::strtoul(argv[++i], nullptr, 16));
+        else if (arg == "--length" && hasValue)
+            length = std::strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--machine" && hasValue)
+            machineName = argv[++i];
+        else if (arg == "--catch-up")
+            catchUp = true;
+        else
+            recordingPath = arg;
+    }
+
+    InputRecording rec;
+    MachineType type;
+    bool loaded = imagePath.empty() && !recordingPath.empty() && rec.load(recordingPath);
+    if (loaded && (rec.checkpoints().empty() ||
+                   !stateMachineType(rec.checkpoints()[0].state.data(), rec.checkpoints()[0].state.size(), type)))
+    {
+        std::cerr << "No machine state in " << recordingPath << "\n";
+        return 2;
+    }
+    if (!loaded && !imagePath.empty() && !parseMachineType(machineName, type))
+    {
+        std::cerr << "Unknown machine: " << machineName << "\n";
+        return 2;
+    }
+    if (!loaded && imagePath.empty())
+    {
+        std::cerr << "usage: replay <recording> [--capture <n>] [--save <file>] [--threads <n>] [--catch-up]\n"
+                     "       replay --image <file> [--machine <profile>] [--load <hex addr>] --length <n>\n"
+                     "              --save <file> [--capture <n>]\n";
+        return 2;
+    }
+
+    AnyMachine machine = makeMachine(type);
+    auto replay = [&](auto &prototype)
+    {
+        prototype.cpu.clockMode = catchUp ? ClockMode::CatchUp : ClockMode::PerCycle;
+        if (!imagePath.empty())
+        {
+            std::ifstream in(imagePath, std::ios::binary);
+            if (!in)
+            {
+                std::cerr << "Cannot open " << imagePath << "\n";
+                return 2;
+            }
+            std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+            auto m = prototype;
+            m.mem.Load(loadAddr, bytes.data(), bytes.size());
+            if (loadAddr + bytes.size() < 0xFFFE)
+            {
+                uint8_t vector[2] = {static_cast<uint8_t>(loadAddr), static_cast<uint8_t>(loadAddr >> 8)};
+                m.mem.Load(0xFFFC, vector, sizeof(vector));
+            }
+            m.Reset();
+            rec.begin(m);
+            while (m.cpu.instructions < length && !m.cpu.halted && m.cpu.running)
+                m.Step();
+            rec.finish(m);
+        }
+
+        if (capture)
+            captureCheckpoints(prototype, rec, capture);
+        if (!savePath.empty() && !rec.save(savePath))
+        {
+            std::cerr << "Cannot write " << savePath << "\n";
+            return 2;
+        }
+
+        std::vector<SegmentResult> results = verifyReplay(prototype, rec, threads);
+        int failed = 0;
+        for (const SegmentResult &r : results)
+        {
+            if (r.ok)
+                continue;
+            if (failed++ == 0)
+                std::cerr << "Segment " << r.start << ".." << r.end << " ends in state " << std::hex << r.actual
+                          << ", recorded " << r.expected << std::dec << "\n";
+        }
+        std::cout << results.size() << " segments, " << rec.length() << " instructions, " << failed
+                  << " failed\n";
+        return failed ? 1 : 0;
+    };
+    return std::visit(replay, machine);
+}